@@ -0,0 +1,460 @@
+//============================
+// Нагрузочный тест
+//============================
+// Поднимает менеджер и локальные рабочие узлы на петлевом интерфейсе и перебирает
+// число узлов, ядра на узел, функции, ширину отрезка и точность. Для каждого
+// сочетания печатает строку JSON: число вычислений функции в секунду и
+// перцентили задержки одного вызова. В конце печатаются коэффициенты сильной
+// (один интеграл на всё большем числе ядер) и слабой (по интегралу на ядро,
+// одним пакетом) масштабируемости относительно конфигурации с наименьшим числом ядер.
+//
+// Ответы в stdout, служебный вывод библиотеки — в stderr.
+
+#include "manager.c"
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#define BENCH_MAX_VALUES 32U
+#define BENCH_DEFAULT_PORT 29000
+
+// Сколько раз на шаг вычисляется функция.
+static const unsigned bench_rule_points[QUAD_RULES] = {
+    [RULE_MIDPOINT] = 1,
+    [RULE_SIMPSON]  = 2,
+    [RULE_GAUSS2]   = 2,
+    [RULE_GAUSS3]   = 3,
+    [RULE_GAUSS4]   = 4,
+};
+
+static const char *const bench_rule_names[QUAD_RULES] = {
+    [RULE_MIDPOINT] = "midpoint",
+    [RULE_SIMPSON]  = "simpson",
+    [RULE_GAUSS2]   = "gauss2",
+    [RULE_GAUSS3]   = "gauss3",
+    [RULE_GAUSS4]   = "gauss4",
+};
+
+typedef struct
+{
+    const char *worker_path;
+    const char *addr;
+    int base_port;
+    time_t max_time;
+    QUAD_RULE rule;
+    unsigned repeats;
+    bool adaptive;
+
+    char *funcs[BENCH_MAX_VALUES];
+    FUNC_TABLE func_ids[BENCH_MAX_VALUES];
+    size_t num_funcs;
+    double widths[BENCH_MAX_VALUES];
+    size_t num_widths;
+    double precisions[BENCH_MAX_VALUES];
+    size_t num_precisions;
+    long workers[BENCH_MAX_VALUES];
+    size_t num_workers;
+    long cores[BENCH_MAX_VALUES];
+    size_t num_cores;
+} BENCH_CONFIG;
+
+// Медианы задержек одного сочетания функции, ширины и точности на одной конфигурации пула.
+typedef struct
+{
+    long total_cores;
+    double strong_sec;
+    double weak_sec;
+    int status;
+} BENCH_POINT;
+
+static FILE *bench_out;
+
+//============================
+// Разбор параметров
+//============================
+
+static void bench_usage(void)
+{
+    fprintf(stderr,
+            "Usage: bench -w <worker> [-a addr] [-P base_port] [-t max_time] [-r repeats]\n"
+            "             [-n workers,...] [-c cores,...] [-f func,...] [-W width,...]\n"
+            "             [-p precision,...] [-q midpoint|simpson|gauss2|gauss3|gauss4] [-A]\n"
+            "Functions are exp, sin, sqr or an expression of x; -A enables adaptive splitting.\n");
+    exit(EXIT_FAILURE);
+}
+
+// Делит список через запятую на части; строка list изменяется.
+static size_t bench_split(char *list, char *items[])
+{
+    size_t num_items = 0;
+    for (char *save, *item = strtok_r(list, ",", &save); item != NULL; item = strtok_r(NULL, ",", &save))
+    {
+        if (num_items == BENCH_MAX_VALUES)
+        {
+            fprintf(stderr, "At most %u values per list\n", BENCH_MAX_VALUES);
+            exit(EXIT_FAILURE);
+        }
+        items[num_items++] = item;
+    }
+    if (num_items == 0)
+        bench_usage();
+    return num_items;
+}
+
+static size_t bench_parse_doubles(char *list, double values[])
+{
+    char *items[BENCH_MAX_VALUES];
+    size_t num_items = bench_split(list, items);
+    for (size_t item_i = 0; item_i < num_items; ++item_i)
+    {
+        char *endptr;
+        values[item_i] = strtod(items[item_i], &endptr);
+        if (*endptr != '\0' || !(values[item_i] > 0))
+        {
+            fprintf(stderr, "Unable to parse positive number '%s'\n", items[item_i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    return num_items;
+}
+
+static size_t bench_parse_longs(char *list, long values[])
+{
+    char *items[BENCH_MAX_VALUES];
+    size_t num_items = bench_split(list, items);
+    for (size_t item_i = 0; item_i < num_items; ++item_i)
+    {
+        char *endptr;
+        values[item_i] = strtol(items[item_i], &endptr, 10);
+        if (*endptr != '\0' || values[item_i] <= 0)
+        {
+            fprintf(stderr, "Unable to parse positive integer '%s'\n", items[item_i]);
+            exit(EXIT_FAILURE);
+        }
+    }
+    return num_items;
+}
+
+static void bench_parse_args(BENCH_CONFIG *config, int argc, char **argv)
+{
+    static char default_funcs[] = "exp,sin";
+    static char default_widths[] = "1,16";
+    static char default_precisions[] = "1e-10,1e-14";
+    static char default_workers[] = "1,2";
+    static char default_cores[] = "1,2";
+    char *funcs = default_funcs, *widths = default_widths, *precisions = default_precisions;
+    char *workers = default_workers, *cores = default_cores;
+
+    *config = (BENCH_CONFIG){.addr = "127.0.0.1", .base_port = BENCH_DEFAULT_PORT, .max_time = 60,
+                             .rule = RULE_MIDPOINT, .repeats = 5, .adaptive = false};
+    int opt;
+    while ((opt = getopt(argc, argv, "w:a:P:t:r:n:c:f:W:p:q:A")) != -1)
+    {
+        switch (opt)
+        {
+        case 'w': config->worker_path = optarg; break;
+        case 'a': config->addr = optarg; break;
+        case 'P': config->base_port = atoi(optarg); break;
+        case 't': config->max_time = atol(optarg); break;
+        case 'r': config->repeats = (unsigned)atoi(optarg); break;
+        case 'n': workers = optarg; break;
+        case 'c': cores = optarg; break;
+        case 'f': funcs = optarg; break;
+        case 'W': widths = optarg; break;
+        case 'p': precisions = optarg; break;
+        case 'A': config->adaptive = true; break;
+        case 'q':
+        {
+            QUAD_RULE rule = 0;
+            while (rule < QUAD_RULES && strcmp(optarg, bench_rule_names[rule]) != 0)
+                rule++;
+            if (rule == QUAD_RULES)
+                bench_usage();
+            config->rule = rule;
+            break;
+        }
+        default:
+            bench_usage();
+        }
+    }
+    if (config->worker_path == NULL || optind != argc || config->repeats == 0 || config->max_time <= 0 ||
+        config->base_port <= 0 || config->base_port > 65535)
+        bench_usage();
+
+    config->num_funcs = bench_split(funcs, config->funcs);
+    config->num_widths = bench_parse_doubles(widths, config->widths);
+    config->num_precisions = bench_parse_doubles(precisions, config->precisions);
+    config->num_workers = bench_parse_longs(workers, config->workers);
+    config->num_cores = bench_parse_longs(cores, config->cores);
+
+    // Встроенные функции узнаются по имени, остальное считается выражением от x.
+    static const char *const builtin_names[NOT_SUPPORT] = {[EXP] = "exp", [SIN] = "sin", [SQR] = "sqr"};
+    for (size_t func_i = 0; func_i < config->num_funcs; ++func_i)
+    {
+        FUNC_TABLE func_id = 0;
+        while (func_id < NOT_SUPPORT && strcmp(config->funcs[func_i], builtin_names[func_id]) != 0)
+            func_id++;
+        if (func_id == NOT_SUPPORT && integrand_compile(config->funcs[func_i], &func_id) != 0)
+        {
+            fprintf(stderr, "Unable to compile expression '%s'\n", config->funcs[func_i]);
+            exit(EXIT_FAILURE);
+        }
+        config->func_ids[func_i] = func_id;
+    }
+}
+
+//============================
+// Узлы
+//============================
+
+static void bench_spawn_workers(const BENCH_CONFIG *config, const char *port, long num_workers, long cores, pid_t pids[])
+{
+    char cores_arg[32], time_arg[32];
+    snprintf(cores_arg, sizeof(cores_arg), "%ld", cores);
+    snprintf(time_arg, sizeof(time_arg), "%ld", (long)config->max_time);
+    for (long worker_i = 0; worker_i < num_workers; ++worker_i)
+    {
+        pids[worker_i] = fork();
+        if (pids[worker_i] == -1)
+        {
+            fprintf(stderr, "Unable to fork worker: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        if (pids[worker_i] == 0)
+        {
+            // Отчёты узлов о каждом куске не нужны, ошибки остаются в stderr.
+            int null_fd = open("/dev/null", O_WRONLY);
+            if (null_fd != -1)
+                dup2(null_fd, STDOUT_FILENO);
+            execl(config->worker_path, config->worker_path, config->addr, port, cores_arg, time_arg, (char *)NULL);
+            fprintf(stderr, "Unable to exec %s: %s\n", config->worker_path, strerror(errno));
+            _exit(EXIT_FAILURE);
+        }
+    }
+}
+
+static void bench_reap_workers(pid_t pids[], long num_workers)
+{
+    for (long worker_i = 0; worker_i < num_workers; ++worker_i)
+    {
+        int status;
+        if (waitpid(pids[worker_i], &status, 0) == -1 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+            fprintf(stderr, "Worker %d did not exit cleanly\n", (int)pids[worker_i]);
+    }
+}
+
+//============================
+// Замеры
+//============================
+
+static double bench_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + 1e-9 * now.tv_nsec;
+}
+
+static int bench_compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Перцентиль по ближайшему рангу; values отсортированы.
+static double bench_percentile(const double values[], size_t num_values, double percent)
+{
+    size_t rank = (size_t)ceil(percent / 100 * num_values);
+    return values[rank == 0 ? 0 : rank - 1];
+}
+
+// Сколько шагов менеджер выдаст узлам на этот интеграл: отрезок разбивается так же,
+// как при настоящем вычислении.
+static uint64_t bench_count_steps(INFO_MANAGER *manager, const INTEGRAL_REQUEST *request)
+{
+    JOB job = {0};
+    job_push_integral(manager, &job, 0, request);
+    uint64_t num_steps = job.queue.num_count;
+    job_free(&job);
+    return num_steps;
+}
+
+static void bench_print_func(const char *func)
+{
+    fputc('"', bench_out);
+    for (const char *c = func; *c != '\0'; ++c)
+    {
+        if (*c == '"' || *c == '\\')
+            fputc('\\', bench_out);
+        fputc(*c, bench_out);
+    }
+    fputc('"', bench_out);
+}
+
+// Считает copies одинаковых интегралов repeats раз (после прогревочного вызова,
+// на который приходится замер узлов) и печатает строку отчёта. Возвращает медиану
+// задержки или отрицательный код ошибки.
+static double bench_measure(INFO_MANAGER *manager, const BENCH_CONFIG *config, const char *kind, size_t func_i,
+                            double width, double precision, long num_workers, long cores, size_t copies)
+{
+    INTEGRAL_REQUEST *requests = calloc(copies, sizeof(INTEGRAL_REQUEST));
+    double *results = calloc(copies, sizeof(double));
+    double *latencies = calloc(config->repeats, sizeof(double));
+    if (requests == NULL || results == NULL || latencies == NULL)
+    {
+        fprintf(stderr, "Unable to allocate benchmark buffers\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t copy_i = 0; copy_i < copies; ++copy_i)
+    {
+        requests[copy_i] = (INTEGRAL_REQUEST){.func_id = config->func_ids[func_i], .rule = config->rule,
+                                              .left = 0, .right = width, .precision = precision};
+    }
+
+    int rc = manager_pool_submit_batch(manager, requests, copies, results);
+    double total_sec = 0;
+    for (unsigned repeat_i = 0; rc == 0 && repeat_i < config->repeats; ++repeat_i)
+    {
+        double start = bench_now();
+        rc = manager_pool_submit_batch(manager, requests, copies, results);
+        latencies[repeat_i] = bench_now() - start;
+        total_sec += latencies[repeat_i];
+    }
+
+    uint64_t num_steps = copies * bench_count_steps(manager, &requests[0]);
+    double evals = (double)num_steps * bench_rule_points[config->rule];
+    fprintf(bench_out, "{\"record\":\"%s\",\"workers\":%ld,\"cores_per_worker\":%ld,\"func\":", kind, num_workers, cores);
+    bench_print_func(config->funcs[func_i]);
+    fprintf(bench_out, ",\"rule\":\"%s\",\"left\":0,\"right\":%g,\"precision\":%g,\"integrals\":%zu,\"steps\":%" PRIu64
+            ",\"evals\":%.0f,\"status\":%d",
+            bench_rule_names[config->rule], width, precision, copies, num_steps, evals, rc);
+    double median = rc;
+    if (rc == 0)
+    {
+        qsort(latencies, config->repeats, sizeof(double), bench_compare_doubles);
+        median = bench_percentile(latencies, config->repeats, 50);
+        fprintf(bench_out, ",\"result\":%.17g,\"repeats\":%u,\"evals_per_sec\":%.6g,"
+                "\"latency_sec\":{\"min\":%.6g,\"p50\":%.6g,\"p90\":%.6g,\"p99\":%.6g,\"max\":%.6g,\"mean\":%.6g}",
+                results[0], config->repeats, evals * config->repeats / total_sec, latencies[0], median,
+                bench_percentile(latencies, config->repeats, 90), bench_percentile(latencies, config->repeats, 99),
+                latencies[config->repeats - 1], total_sec / config->repeats);
+    }
+    fprintf(bench_out, "}\n");
+    fflush(bench_out);
+
+    free(requests);
+    free(results);
+    free(latencies);
+    return median;
+}
+
+// Печатает масштабируемость каждого сочетания относительно конфигурации с наименьшим числом ядер.
+static void bench_print_scaling(const BENCH_CONFIG *config, const BENCH_POINT *points, size_t num_configs)
+{
+    size_t num_cases = config->num_funcs * config->num_widths * config->num_precisions;
+    size_t base_i = 0;
+    for (size_t config_i = 1; config_i < num_configs; ++config_i)
+    {
+        if (points[config_i * num_cases].total_cores < points[base_i * num_cases].total_cores)
+            base_i = config_i;
+    }
+
+    for (size_t case_i = 0; case_i < num_cases; ++case_i)
+    {
+        size_t func_i = case_i / (config->num_widths * config->num_precisions);
+        size_t width_i = case_i / config->num_precisions % config->num_widths;
+        size_t precision_i = case_i % config->num_precisions;
+        const BENCH_POINT *base = &points[base_i * num_cases + case_i];
+        for (size_t config_i = 0; config_i < num_configs; ++config_i)
+        {
+            const BENCH_POINT *point = &points[config_i * num_cases + case_i];
+            if (base->status != 0 || point->status != 0)
+                continue;
+            long workers = config->workers[config_i / config->num_cores];
+            long cores = config->cores[config_i % config->num_cores];
+            double speedup = base->strong_sec / point->strong_sec;
+            fprintf(bench_out, "{\"record\":\"scaling\",\"workers\":%ld,\"cores_per_worker\":%ld,\"total_cores\":%ld,"
+                    "\"base_total_cores\":%ld,\"func\":", workers, cores, point->total_cores, base->total_cores);
+            bench_print_func(config->funcs[func_i]);
+            fprintf(bench_out, ",\"right\":%g,\"precision\":%g,\"strong_speedup\":%.4f,\"strong_efficiency\":%.4f,"
+                    "\"weak_efficiency\":%.4f}\n",
+                    config->widths[width_i], config->precisions[precision_i], speedup,
+                    speedup * base->total_cores / point->total_cores, base->weak_sec / point->weak_sec);
+        }
+    }
+    fflush(bench_out);
+}
+
+int main(int argc, char **argv)
+{
+    BENCH_CONFIG config;
+    bench_parse_args(&config, argc, argv);
+
+    // Отчёт идёт в исходный stdout, а всё, что библиотека печатает в stdout, — в stderr.
+    bench_out = fdopen(dup(STDOUT_FILENO), "w");
+    if (bench_out == NULL || dup2(STDERR_FILENO, STDOUT_FILENO) == -1)
+    {
+        fprintf(stderr, "Unable to redirect stdout\n");
+        exit(EXIT_FAILURE);
+    }
+    // Узел, оборвавший соединение, не должен завершать тест сигналом.
+    signal(SIGPIPE, SIG_IGN);
+
+    size_t num_cases = config.num_funcs * config.num_widths * config.num_precisions;
+    size_t num_configs = config.num_workers * config.num_cores;
+    BENCH_POINT *points = calloc(num_configs * num_cases, sizeof(BENCH_POINT));
+    if (points == NULL)
+    {
+        fprintf(stderr, "Unable to allocate benchmark results\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t config_i = 0; config_i < num_configs; ++config_i)
+    {
+        long num_workers = config.workers[config_i / config.num_cores];
+        long cores = config.cores[config_i % config.num_cores];
+        // Каждой конфигурации свой порт: узлы прошлой могут ещё не закрыть соединения.
+        char port[16];
+        snprintf(port, sizeof(port), "%d", config.base_port + (int)config_i);
+
+        INFO_MANAGER manager;
+        info_manager_init(&manager, (char *)config.addr, port, config.max_time, (int)num_workers);
+        info_manager_set_adaptive(&manager, config.adaptive);
+        pid_t *pids = calloc(num_workers, sizeof(pid_t));
+        if (pids == NULL)
+        {
+            fprintf(stderr, "Unable to allocate worker pids\n");
+            exit(EXIT_FAILURE);
+        }
+        bench_spawn_workers(&config, port, num_workers, cores, pids);
+        if (manager_pool_start(&manager) != 0)
+        {
+            fprintf(stderr, "Unable to start pool of %ld workers\n", num_workers);
+            exit(EXIT_FAILURE);
+        }
+
+        for (size_t case_i = 0; case_i < num_cases; ++case_i)
+        {
+            size_t func_i = case_i / (config.num_widths * config.num_precisions);
+            double width = config.widths[case_i / config.num_precisions % config.num_widths];
+            double precision = config.precisions[case_i % config.num_precisions];
+            BENCH_POINT *point = &points[config_i * num_cases + case_i];
+            point->total_cores = num_workers * cores;
+            point->strong_sec = bench_measure(&manager, &config, "strong", func_i, width, precision, num_workers, cores, 1);
+            // Для слабой масштабируемости объём работы растёт вместе с числом ядер.
+            point->weak_sec = bench_measure(&manager, &config, "weak", func_i, width, precision, num_workers, cores,
+                                            (size_t)point->total_cores);
+            point->status = point->strong_sec < 0 ? (int)point->strong_sec : point->weak_sec < 0 ? (int)point->weak_sec : 0;
+        }
+
+        manager_pool_stop(&manager);
+        bench_reap_workers(pids, num_workers);
+        free(pids);
+    }
+
+    bench_print_scaling(&config, points, num_configs);
+    free(points);
+    fclose(bench_out);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,403 @@
+//==================
+// Подынтегральные выражения
+//==================
+// Выражение от x разбирается один раз и компилируется в байт-код стековой машины
+// (struct expr_program), который узлы исполняют блоками точек. Менеджер исполняет
+// тот же байт-код поточечно: по значениям оценивает производные для выбора шага.
+// Это оценки, а не строгие границы, поэтому менеджер дополнительно проверяет
+// выбранный шаг удвоением (см. get_step в manager.c).
+//
+// Грамматика:
+//   expr    := term (('+' | '-') term)*
+//   term    := unary (('*' | '/') unary)*
+//   unary   := '-' unary | power
+//   power   := primary (('^' | '**') unary)?
+//   primary := число | 'x' | 'pi' | 'e' | функция '(' expr ')' | '(' expr ')'
+
+// Сколько точек берётся для первой оценки производной и до скольких их число
+// удваивается, пока оценка не перестанет расти быстрее чем в EXPR_REFINE_RATIO раз.
+// Минимальная ширина окна: на слишком узком окне конечные разности высоких
+// порядков тонут в округлении.
+#define EXPR_DERIVATIVE_SAMPLES 64U
+#define EXPR_DERIVATIVE_MAX_SAMPLES 1024U
+#define EXPR_REFINE_RATIO 1.5
+#define EXPR_MIN_WINDOW 1.0
+#define EXPR_MAX_ORDER 8U
+// Запас на то, что максимум производной попал между точками.
+#define EXPR_DERIVATIVE_SAFETY 2.0
+// Сколько точек проверяется на конечность значения при приёме запроса.
+#define EXPR_CHECK_POINTS 1024U
+
+static const struct
+{
+    const char *name;
+    uint8_t op;
+} expr_functions[] = {
+    {"exp", EXPR_EXP},   {"log", EXPR_LOG},   {"sin", EXPR_SIN},   {"cos", EXPR_COS},
+    {"tan", EXPR_TAN},   {"sqrt", EXPR_SQRT}, {"abs", EXPR_ABS},   {"atan", EXPR_ATAN},
+    {"sinh", EXPR_SINH}, {"cosh", EXPR_COSH}, {"tanh", EXPR_TANH},
+};
+
+// Проверяет байт-код, пришедший по сети: индексы констант и глубину стека.
+static bool expr_program_valid(const struct expr_program *program) {
+    if (program->code_length == 0 || program->code_length > EXPR_MAX_CODE || program->num_consts > EXPR_MAX_CONSTS) {
+        return false;
+    }
+    unsigned depth = 0;
+    for (unsigned pc = 0; pc < program->code_length; ++pc) {
+        uint8_t op = program->code[pc];
+        if (op == EXPR_X || op == EXPR_CONST) {
+            if (op == EXPR_CONST && (++pc == program->code_length || program->code[pc] >= program->num_consts)) {
+                return false;
+            }
+            if (++depth > EXPR_MAX_STACK) {
+                return false;
+            }
+        } else if (op <= EXPR_POW) {
+            if (depth < 2) {
+                return false;
+            }
+            depth--;
+        } else if (op < EXPR_OPS) {
+            if (depth < 1) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return depth == 1;
+}
+
+static double expr_apply_unary(uint8_t op, double a) {
+    switch (op)
+    {
+    case EXPR_NEG:  return -a;
+    case EXPR_EXP:  return exp(a);
+    case EXPR_LOG:  return log(a);
+    case EXPR_SIN:  return sin(a);
+    case EXPR_COS:  return cos(a);
+    case EXPR_TAN:  return tan(a);
+    case EXPR_SQRT: return sqrt(a);
+    case EXPR_ABS:  return fabs(a);
+    case EXPR_ATAN: return atan(a);
+    case EXPR_SINH: return sinh(a);
+    case EXPR_COSH: return cosh(a);
+    case EXPR_TANH: return tanh(a);
+    default:        return NAN;
+    }
+}
+
+static double expr_apply_binary(uint8_t op, double a, double b) {
+    switch (op)
+    {
+    case EXPR_ADD: return a + b;
+    case EXPR_SUB: return a - b;
+    case EXPR_MUL: return a * b;
+    case EXPR_DIV: return a / b;
+    case EXPR_POW: return pow(a, b);
+    default:       return NAN;
+    }
+}
+
+// Значение проверенного выражения в точке x.
+static double expr_eval(const struct expr_program *program, double x) {
+    double stack[EXPR_MAX_STACK];
+    unsigned sp = 0;
+    for (unsigned pc = 0; pc < program->code_length; ++pc) {
+        uint8_t op = program->code[pc];
+        if (op == EXPR_X) {
+            stack[sp++] = x;
+        } else if (op == EXPR_CONST) {
+            stack[sp++] = program->consts[program->code[++pc]];
+        } else if (op <= EXPR_POW) {
+            sp--;
+            stack[sp - 1] = expr_apply_binary(op, stack[sp - 1], stack[sp]);
+        } else {
+            stack[sp - 1] = expr_apply_unary(op, stack[sp - 1]);
+        }
+    }
+    return stack[0];
+}
+
+//==================
+// Разбор
+//==================
+
+typedef struct
+{
+    const char *pos;
+    struct expr_program *program;
+    // Глубина стека после уже выданного кода.
+    unsigned depth;
+    bool failed;
+} EXPR_PARSER;
+
+static void expr_skip_spaces(EXPR_PARSER *parser) {
+    while (*parser->pos == ' ' || *parser->pos == '\t') {
+        parser->pos++;
+    }
+}
+
+static void expr_emit(EXPR_PARSER *parser, uint8_t op) {
+    struct expr_program *program = parser->program;
+    if (program->code_length == EXPR_MAX_CODE) {
+        parser->failed = true;
+        return;
+    }
+    program->code[program->code_length++] = op;
+}
+
+// Операция op снимает со стека pop значений и кладёт одно.
+static void expr_emit_op(EXPR_PARSER *parser, uint8_t op, unsigned pop) {
+    expr_emit(parser, op);
+    parser->depth = parser->depth - pop + 1;
+    if (parser->depth > EXPR_MAX_STACK) {
+        parser->failed = true;
+    }
+}
+
+static void expr_emit_const(EXPR_PARSER *parser, double value) {
+    struct expr_program *program = parser->program;
+    uint16_t index = 0;
+    while (index < program->num_consts && program->consts[index] != value) {
+        index++;
+    }
+    if (index == program->num_consts) {
+        if (program->num_consts == EXPR_MAX_CONSTS) {
+            parser->failed = true;
+            return;
+        }
+        program->consts[program->num_consts++] = value;
+    }
+    expr_emit_op(parser, EXPR_CONST, 0);
+    expr_emit(parser, (uint8_t)index);
+}
+
+static bool expr_accept(EXPR_PARSER *parser, const char *token) {
+    expr_skip_spaces(parser);
+    size_t length = strlen(token);
+    if (strncmp(parser->pos, token, length) != 0) {
+        return false;
+    }
+    parser->pos += length;
+    return true;
+}
+
+static void expr_parse_sum(EXPR_PARSER *parser);
+static void expr_parse_unary(EXPR_PARSER *parser);
+
+static void expr_parse_primary(EXPR_PARSER *parser) {
+    expr_skip_spaces(parser);
+    const char *pos = parser->pos;
+    if (isdigit((unsigned char)*pos) || *pos == '.') {
+        char *end;
+        double value = strtod(pos, &end);
+        parser->pos = end;
+        expr_emit_const(parser, value);
+        return;
+    }
+    if (*pos == '(') {
+        parser->pos++;
+        expr_parse_sum(parser);
+        if (!expr_accept(parser, ")")) {
+            parser->failed = true;
+        }
+        return;
+    }
+
+    size_t length = 0;
+    while (isalnum((unsigned char)pos[length]) || pos[length] == '_') {
+        length++;
+    }
+    parser->pos += length;
+    if (length == 1 && *pos == 'x') {
+        expr_emit_op(parser, EXPR_X, 0);
+        return;
+    }
+    if (length == 2 && strncmp(pos, "pi", 2) == 0) {
+        expr_emit_const(parser, M_PI);
+        return;
+    }
+    if (length == 1 && *pos == 'e') {
+        expr_emit_const(parser, M_E);
+        return;
+    }
+    for (size_t func_i = 0; func_i < sizeof(expr_functions) / sizeof(expr_functions[0]); ++func_i) {
+        if (strlen(expr_functions[func_i].name) == length && strncmp(pos, expr_functions[func_i].name, length) == 0) {
+            if (!expr_accept(parser, "(")) {
+                parser->failed = true;
+                return;
+            }
+            expr_parse_sum(parser);
+            if (!expr_accept(parser, ")")) {
+                parser->failed = true;
+                return;
+            }
+            expr_emit_op(parser, expr_functions[func_i].op, 1);
+            return;
+        }
+    }
+    parser->failed = true;
+}
+
+static void expr_parse_power(EXPR_PARSER *parser) {
+    expr_parse_primary(parser);
+    if (expr_accept(parser, "^") || expr_accept(parser, "**")) {
+        expr_parse_unary(parser);
+        expr_emit_op(parser, EXPR_POW, 2);
+    }
+}
+
+static void expr_parse_unary(EXPR_PARSER *parser) {
+    if (expr_accept(parser, "-")) {
+        expr_parse_unary(parser);
+        expr_emit_op(parser, EXPR_NEG, 1);
+        return;
+    }
+    expr_accept(parser, "+");
+    expr_parse_power(parser);
+}
+
+static void expr_parse_product(EXPR_PARSER *parser) {
+    expr_parse_unary(parser);
+    while (!parser->failed) {
+        // "**" — это степень, её разбирает expr_parse_power.
+        expr_skip_spaces(parser);
+        if (parser->pos[0] == '*' && parser->pos[1] != '*') {
+            parser->pos++;
+            expr_parse_unary(parser);
+            expr_emit_op(parser, EXPR_MUL, 2);
+        } else if (expr_accept(parser, "/")) {
+            expr_parse_unary(parser);
+            expr_emit_op(parser, EXPR_DIV, 2);
+        } else {
+            break;
+        }
+    }
+}
+
+static void expr_parse_sum(EXPR_PARSER *parser) {
+    expr_parse_product(parser);
+    while (!parser->failed) {
+        if (expr_accept(parser, "+")) {
+            expr_parse_product(parser);
+            expr_emit_op(parser, EXPR_ADD, 2);
+        } else if (expr_accept(parser, "-")) {
+            expr_parse_product(parser);
+            expr_emit_op(parser, EXPR_SUB, 2);
+        } else {
+            break;
+        }
+    }
+}
+
+// Компилирует выражение. Возвращает false при синтаксической ошибке или если
+// выражение не помещается в struct expr_program.
+static bool expr_compile(const char *expression, struct expr_program *program) {
+    memset(program, 0, sizeof(*program));
+    EXPR_PARSER parser = {.pos = expression, .program = program};
+    expr_parse_sum(&parser);
+    expr_skip_spaces(&parser);
+    if (parser.failed || *parser.pos != '\0') {
+        fprintf(stderr, "Unable to parse expression at: \"%s\"\n", parser.pos);
+        return false;
+    }
+    return expr_program_valid(program);
+}
+
+//==================
+// Оценка производных
+//==================
+
+// Окно [lo, lo + (num - 1) * step] со значениями в values; false, если значение не конечно.
+static bool expr_sample(const struct expr_program *program, double lo, double step, unsigned num, double *values) {
+    for (unsigned k = 0; k < num; ++k) {
+        values[k] = expr_eval(program, lo + step * k);
+        if (!isfinite(values[k])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Наибольшая по модулю конечная разность порядка order по num значениям с шагом
+// step, делённая на step^order. Значения в values портятся. Возвращает -1, если
+// разности не выше уровня округления значений: такой шаг слишком мелок для оценки.
+static double expr_difference_estimate(double *values, unsigned num, unsigned order, double step) {
+    double max_value = 0;
+    for (unsigned k = 0; k < num; ++k) {
+        max_value = fmax(max_value, fabs(values[k]));
+    }
+    for (unsigned pass = 0; pass < order; ++pass) {
+        for (unsigned k = 0; k + pass + 1 < num; ++k) {
+            values[k] = values[k + 1] - values[k];
+        }
+    }
+    double max_difference = 0;
+    for (unsigned k = 0; k + order < num; ++k) {
+        max_difference = fmax(max_difference, fabs(values[k]));
+    }
+    // Разность порядка order накапливает до 2^order ошибок округления значений.
+    if (order != 0 && max_difference <= ldexp(64 * DBL_EPSILON * max_value, (int)order)) {
+        return -1;
+    }
+    return max_difference / pow(step, order);
+}
+
+// Оценка модуля производной порядка order на [left, right] по конечным разностям.
+// Это оценка, а не граница: особенность уже шага выборки (узкий пик) может
+// остаться незамеченной. Выборка сгущается вдвое, пока оценка заметно растёт,
+// результат умножается на EXPR_DERIVATIVE_SAFETY. Узкий отрезок расширяется до
+// EXPR_MIN_WINDOW, если выражение там определено. Возвращает INFINITY, если
+// выражение на отрезке не конечно.
+static double expr_max_derivative(const struct expr_program *program, unsigned order, double left, double right) {
+    if (order > EXPR_MAX_ORDER) {
+        order = EXPR_MAX_ORDER;
+    }
+    if (right == left) {
+        return 0;
+    }
+    double values[EXPR_DERIVATIVE_MAX_SAMPLES + EXPR_MAX_ORDER + 1];
+    double lo = left, width = right - left;
+    unsigned num = EXPR_DERIVATIVE_SAMPLES + order + 1;
+    if (width < EXPR_MIN_WINDOW && expr_sample(program, (left + right) / 2 - EXPR_MIN_WINDOW / 2,
+                                               EXPR_MIN_WINDOW / (num - 1), num, values)) {
+        lo = (left + right) / 2 - EXPR_MIN_WINDOW / 2;
+        width = EXPR_MIN_WINDOW;
+    }
+
+    double estimate = -1;
+    for (unsigned samples = EXPR_DERIVATIVE_SAMPLES; samples <= EXPR_DERIVATIVE_MAX_SAMPLES; samples *= 2) {
+        num = samples + order + 1;
+        double step = width / (num - 1);
+        if (!expr_sample(program, lo, step, num, values)) {
+            return INFINITY;
+        }
+        double refined = expr_difference_estimate(values, num, order, step);
+        if (refined < 0) {
+            break;
+        }
+        bool settled = estimate >= 0 && refined <= EXPR_REFINE_RATIO * estimate;
+        estimate = fmax(estimate, refined);
+        if (settled) {
+            break;
+        }
+    }
+    // Даже самая редкая выборка упёрлась в округление: производная неотличима от нуля.
+    if (estimate < 0) {
+        return 0;
+    }
+    return EXPR_DERIVATIVE_SAFETY * estimate;
+}
+
+// Выражение конечно на сетке из EXPR_CHECK_POINTS точек отрезка.
+static bool expr_finite_on(const struct expr_program *program, double left, double right) {
+    for (unsigned k = 0; k < EXPR_CHECK_POINTS; ++k) {
+        double x = left + (right - left) * k / (EXPR_CHECK_POINTS - 1);
+        if (!isfinite(expr_eval(program, x))) {
+            return false;
+        }
+    }
+    return true;
+}
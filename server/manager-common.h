@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdbool.h>
 #include <stdatomic.h>
@@ -11,6 +12,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <sys/stat.h>
+#include <sys/epoll.h>
 #include <netinet/tcp.h>
 #include <fcntl.h>
 #include <unistd.h>
@@ -20,22 +22,351 @@
 #include <arpa/inet.h>
 #include <time.h>
 #include <math.h>
+#include <ctype.h>
+#include <float.h>
+#include <pthread.h>
 #include "manager.h"
+#include "integrand.h"
+#include "metrics.h"
 #include <netdb.h>
+#include <dlfcn.h>
 
 
 
 enum ERROR_CODE {
     EFUNCID = 1,
     EVALUE = 2,
+    EPOOL = 3,
+    ERULE = 4,
+    ETIMEOUT = 5,
+    ENOWORKERS = 6,
+    ECANCEL = 7,
+    EPLUGIN = 8,
+    EEXPR = 9,
 };
 
-double get_max_derivate_2(FUNC_TABLE func_id, double left, double right) {
+struct node_info 
+{
+    time_t max_worker_time;
+    int n_cores;
+    // Топология: доступные узлу логические ЦП, физические ядра среди них,
+    // процессорные сокеты и узлы NUMA.
+    int n_cpus;
+    int n_physical_cores;
+    int n_packages;
+    int n_numa_nodes;
+};
+
+// Типы кадров протокола обмена с рабочими узлами.
+enum FRAME_TYPE
+{
+    FRAME_NODE_INFO = 1,
+    FRAME_TASK      = 2,
+    FRAME_RESULT    = 3,
+    FRAME_STOP      = 4,
+    // Замер производительности узла на заданной функции и ответ на него.
+    FRAME_CALIBRATE   = 5,
+    FRAME_CALIBRATION = 6,
+    // Несколько кусков в одном кадре и ответ на них — по значению на кусок.
+    FRAME_TASK_BATCH   = 7,
+    FRAME_RESULT_BATCH = 8,
+    // Байт-код подынтегрального выражения; ответа не требует.
+    FRAME_EXPR = 9,
+    // Трасса счёта задания; узел отправляет её перед ответом, если задание
+    // попросило флагом WORK_TRACE.
+    FRAME_TRACE = 10,
+};
+
+// Заголовок кадра, за ним следует length байт полезной нагрузки.
+// Ответ на задание несёт request_id этого задания.
+struct frame_header
+{
+    uint32_t type;
+    uint32_t length;
+    uint64_t request_id;
+};
+
+#define MAX_FRAME_PAYLOAD 4096U
+
+// Флаги задания в worker_data.flags; в пакете действуют флаги первой части.
+enum WORK_FLAGS
+{
+    WORK_TRACE = 1,
+};
+
+struct worker_data{
+int func_id; 
+int rule;
+// SUMMATION_MODE.
+int summation;
+// WORK_FLAGS.
+int flags;
+double left;
+double step;
+uint64_t num_steps;
+};
+
+// Сколько раз на шаге каждой формулы вычисляется функция.
+static const unsigned rule_points[QUAD_RULES] = {
+    [RULE_MIDPOINT] = 1,
+    [RULE_SIMPSON]  = 2,
+    [RULE_GAUSS2]   = 2,
+    [RULE_GAUSS3]   = 3,
+    [RULE_GAUSS4]   = 4,
+};
+
+// Коды ошибок в worker_result.status.
+enum WORKER_STATUS
+{
+    WORKER_EFUNC = 1,
+    WORKER_ERULE = 2,
+};
+
+struct worker_result
+{
+    int status;
+    double value;
+    // Время счёта куска на узле: по часам и суммарно по всем его потокам.
+    double compute_sec;
+    double cpu_sec;
+};
+
+// Сколько кусков помещается в один кадр FRAME_TASK_BATCH.
+#define MAX_BATCH_PARTS (MAX_FRAME_PAYLOAD / sizeof(struct worker_data))
+
+// Ответ на FRAME_TASK_BATCH; передаются только первые num_values значений.
+struct worker_batch_result
+{
+    int status;
+    uint32_t num_values;
+    double compute_sec;
+    double cpu_sec;
+    double values[MAX_BATCH_PARTS];
+};
+
+// Трасса счёта задания (FRAME_TRACE). Времена — в секундах от прихода заголовка
+// задания на узел; передаются только первые num_threads записей потоков.
+#define MAX_TRACE_THREADS 120U
+
+struct trace_thread
+{
+    double start_sec;
+    double end_sec;
+    uint64_t steps;
+    // Ядро, на котором поток начал последнюю часть задания (-1 — неизвестно).
+    int32_t cpu;
+    // Сколько частей задания поток начинал считать.
+    uint32_t parts;
+};
+
+struct worker_trace
+{
+    // Задание прочитано из сокета.
+    double recv_sec;
+    // Все части посчитаны.
+    double join_sec;
+    // Трасса собрана и уходит вместе с ответом.
+    double send_sec;
+    uint32_t num_threads;
+    struct trace_thread threads[MAX_TRACE_THREADS];
+};
+
+struct calibrate_request
+{
+    int func_id;
+    int rule;
+    double left;
+    double right;
+};
+
+struct calibration_result
+{
+    int status;
+    // Сколько шагов заданной формулы узел считает за секунду всеми ядрами.
+    double steps_per_sec;
+};
+
+// Подынтегральное выражение, скомпилированное менеджером в байт-код стековой
+// машины. Узел получает его кадром FRAME_EXPR до первого задания с этой функцией.
+enum EXPR_OP
+{
+    EXPR_X,
+    // За кодом операции следует байт с номером константы.
+    EXPR_CONST,
+    // Двуместные операции.
+    EXPR_ADD,
+    EXPR_SUB,
+    EXPR_MUL,
+    EXPR_DIV,
+    EXPR_POW,
+    // Одноместные операции.
+    EXPR_NEG,
+    EXPR_EXP,
+    EXPR_LOG,
+    EXPR_SIN,
+    EXPR_COS,
+    EXPR_TAN,
+    EXPR_SQRT,
+    EXPR_ABS,
+    EXPR_ATAN,
+    EXPR_SINH,
+    EXPR_COSH,
+    EXPR_TANH,
+    EXPR_OPS,
+};
+
+// Идентификаторы выражений лежат ниже идентификаторов подключаемых функций.
+#define EXPR_ID_BASE 0x20000000
+#define EXPR_MAX_CODE 512U
+#define EXPR_MAX_CONSTS 128U
+#define EXPR_MAX_STACK 16U
+
+struct expr_program
+{
+    int func_id;
+    uint16_t code_length;
+    uint16_t num_consts;
+    uint8_t code[EXPR_MAX_CODE];
+    double consts[EXPR_MAX_CONSTS];
+};
+
+#include "expr.h"
+
+//==================
+// Подключаемые функции
+//==================
+
+#define MAX_INTEGRAND_PLUGINS 16U
+#define MAX_INTEGRAND_EXPRS 64U
+// Сколько всего функций различают таблицы замеров производительности.
+#define MAX_INTEGRANDS (NOT_SUPPORT + MAX_INTEGRAND_PLUGINS + MAX_INTEGRAND_EXPRS)
+
+static const INTEGRAND_PLUGIN *integrand_plugins[MAX_INTEGRAND_PLUGINS];
+static int integrand_plugin_ids[MAX_INTEGRAND_PLUGINS];
+static size_t num_integrand_plugins;
+
+static struct expr_program integrand_exprs[MAX_INTEGRAND_EXPRS];
+static size_t num_integrand_exprs;
+
+// Номер выражения в integrand_exprs или -1, если это не выражение.
+static int integrand_expr_index(int func_id) {
+    for (size_t expr_i = 0; expr_i < num_integrand_exprs; ++expr_i) {
+        if (integrand_exprs[expr_i].func_id == func_id) {
+            return (int)expr_i;
+        }
+    }
+    return -1;
+}
+
+// Номер функции в таблицах менеджера или -1, если функция неизвестна.
+static int integrand_slot(int func_id) {
+    if (func_id >= 0 && func_id < NOT_SUPPORT) {
+        return func_id;
+    }
+    for (size_t plugin_i = 0; plugin_i < num_integrand_plugins; ++plugin_i) {
+        if (integrand_plugin_ids[plugin_i] == func_id) {
+            return NOT_SUPPORT + (int)plugin_i;
+        }
+    }
+    int expr_i = integrand_expr_index(func_id);
+    if (expr_i != -1) {
+        return NOT_SUPPORT + MAX_INTEGRAND_PLUGINS + expr_i;
+    }
+    return -1;
+}
+
+int integrand_load(const char *path, FUNC_TABLE *func_id) {
+    if (path == NULL || func_id == NULL) {
+        return -EVALUE;
+    }
+    if (num_integrand_plugins == MAX_INTEGRAND_PLUGINS) {
+        fprintf(stderr, "Too many integrand plugins\n");
+        return -EPLUGIN;
+    }
+    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (handle == NULL) {
+        fprintf(stderr, "Unable to load integrand plugin: %s\n", dlerror());
+        return -EPLUGIN;
+    }
+    INTEGRAND_PLUGIN_ENTRY entry = (INTEGRAND_PLUGIN_ENTRY)dlsym(handle, INTEGRAND_PLUGIN_SYMBOL);
+    const INTEGRAND_PLUGIN *plugin = entry == NULL ? NULL : entry();
+    // Менеджеру нужна оценка производной, чтобы выбрать шаг.
+    if (plugin == NULL || plugin->abi_version != INTEGRAND_ABI_VERSION || plugin->name == NULL ||
+        plugin->sum == NULL || plugin->max_derivative == NULL) {
+        fprintf(stderr, "Invalid integrand plugin %s\n", path);
+        dlclose(handle);
+        return -EPLUGIN;
+    }
+    int id = integrand_plugin_id(plugin->name);
+    if (integrand_slot(id) != -1) {
+        fprintf(stderr, "Integrand plugin %s is already loaded or clashes by id\n", plugin->name);
+        dlclose(handle);
+        return -EPLUGIN;
+    }
+    integrand_plugins[num_integrand_plugins] = plugin;
+    integrand_plugin_ids[num_integrand_plugins] = id;
+    num_integrand_plugins++;
+    *func_id = (FUNC_TABLE)id;
+    return 0;
+}
+
+// Регистрирует проверенное выражение под его собственным идентификатором; так
+// ретранслятор повторяет выражения вышестоящего менеджера. false, если места нет.
+static bool integrand_define_expr(const struct expr_program *program) {
+    int expr_i = integrand_expr_index(program->func_id);
+    if (expr_i == -1) {
+        if (num_integrand_exprs == MAX_INTEGRAND_EXPRS) {
+            return false;
+        }
+        expr_i = (int)num_integrand_exprs++;
+    }
+    integrand_exprs[expr_i] = *program;
+    return true;
+}
+
+int integrand_compile(const char *expression, FUNC_TABLE *func_id) {
+    if (expression == NULL || func_id == NULL) {
+        return -EVALUE;
+    }
+    struct expr_program program;
+    if (!expr_compile(expression, &program)) {
+        return -EEXPR;
+    }
+    // Одинаковые выражения получают один идентификатор.
+    for (size_t expr_i = 0; expr_i < num_integrand_exprs; ++expr_i) {
+        const struct expr_program *known = &integrand_exprs[expr_i];
+        if (known->code_length == program.code_length && known->num_consts == program.num_consts &&
+            memcmp(known->code, program.code, program.code_length) == 0 &&
+            memcmp(known->consts, program.consts, program.num_consts * sizeof(double)) == 0) {
+            *func_id = (FUNC_TABLE)known->func_id;
+            return 0;
+        }
+    }
+    program.func_id = EXPR_ID_BASE + (int)num_integrand_exprs;
+    if (!integrand_define_expr(&program)) {
+        fprintf(stderr, "Too many integrand expressions\n");
+        return -EEXPR;
+    }
+    *func_id = (FUNC_TABLE)program.func_id;
+    return 0;
+}
+
+// Оценка сверху модуля производной чётного порядка order на [left, right].
+double get_max_derivate(FUNC_TABLE func_id, unsigned order, double left, double right) {
+    int expr_i = integrand_expr_index(func_id);
+    if (expr_i != -1) {
+        return expr_max_derivative(&integrand_exprs[expr_i], order, left, right);
+    }
+    int slot = integrand_slot(func_id);
+    if (slot >= NOT_SUPPORT) {
+        return integrand_plugins[slot - NOT_SUPPORT]->max_derivative(order, left, right);
+    }
     switch (func_id)
     {
     case EXP:
         return exp(right);
     case SIN:
+        // Производные чётного порядка синуса — это ±sin.
         if (right - left >= M_PI) {
             return 1;
         }
@@ -46,26 +377,18 @@ double get_max_derivate_2(FUNC_TABLE func_id, double left, double right) {
         }
         return fabs(sin(right)) > fabs(sin(left)) ? fabs(sin(right)) : fabs(sin(left));
     case SQR:
-        return 1;
+        // (x^2)'' = 2, старшие производные равны нулю.
+        return order == 2 ? 2 : 0;
     case NOT_SUPPORT:
     default:
-        fprintf(stderr, "[get_max_derivate_2]:Function not supported\n");
+        fprintf(stderr, "[get_max_derivate]:Function not supported\n");
         return 0;
     }
 }
 
-struct node_info 
-{
-    time_t max_worker_time;
-    int n_cores;
-};
-
-struct worker_data{
-int func_id; 
-double left;
-double step;
-uint64_t num_steps;
-};
+double get_max_derivate_2(FUNC_TABLE func_id, double left, double right) {
+    return get_max_derivate(func_id, 2, left, right);
+}
 
 
 
@@ -79,23 +402,177 @@ typedef enum
     GET_INFO,
     SEND_TASK,
     GET_ANS,
-    WORK_FINISHED
+    WORK_FINISHED,
+    // Соединение разорвано или узел нарушил протокол; будет удалено из пула.
+    WORK_LOST,
 } WORK_STATE;
 
+// Сколько кусков держим в очереди каждого узла, чтобы скрыть задержку сети.
+#define PIPELINE_DEPTH 4U
+
+// Кусок, выданный узлу и ещё не посчитанный.
 typedef struct
+{
+    uint64_t request_id;
+    // Номер куска в задании или NO_CHUNK, если задание уже прервано.
+    size_t chunk;
+    uint64_t num_steps;
+    uint64_t num_evals;
+    struct timespec sent;
+} IN_FLIGHT_CHUNK;
+
+#define NO_CHUNK SIZE_MAX
+
+// Буфер соединения, данные лежат в [head, tail).
+typedef struct
+{
+    char *data;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+} CONN_BUFFER;
+
+typedef struct work_connection
 {
     // Дескриптор сокета для обмена данными с клиентом.
     int client_sock_fd;
     //Нагрузка
     uint64_t load;
+    // Число ядер узла.
+    int n_cores;
+    // Сведения, которые узел прислал о себе.
+    struct node_info node;
     // Текущее состояние протокола обмена данными с данным клиентом.
     WORK_STATE state;
 
+    // Принятые, но ещё не разобранные данные и ещё не отправленные кадры.
+    CONN_BUFFER rbuf;
+    CONN_BUFFER wbuf;
+    // Менеджер соединения и место в его списке flush_list.
+    INFO_MANAGER *manager;
+    struct work_connection *flush_next;
+    bool flush_queued;
+
+    // Выданные, но ещё не посчитанные куски в порядке выдачи.
+    IN_FLIGHT_CHUNK in_flight[PIPELINE_DEPTH];
+    size_t num_in_flight;
+    // Время получения последнего ответа.
+    struct timespec last_ans;
+    // Измеренная производительность узла в шагах в секунду (0 — ещё не измерена).
+    double rate;
+    // Сколько шагов ещё положено узлу в статическом режиме.
+    uint64_t quota;
+
+    // Замеренная производительность узла для каждой функции и формулы
+    // (0 — замера не было) и время замера. Функции нумеруются integrand_slot.
+    double calibrated[MAX_INTEGRANDS][QUAD_RULES];
+    struct timespec calibrated_at[MAX_INTEGRANDS][QUAD_RULES];
+    // Узлу отправлен запрос на замер, ответ ещё не пришёл.
+    bool calibrating;
+    struct calibrate_request calibration;
+    // Какие выражения из integrand_exprs уже отправлены узлу.
+    uint64_t exprs_sent;
+
+    // Общие счётчики менеджера и счётчики узла (NULL, если записи не хватило).
+    MANAGER_METRICS *metrics;
+    WORKER_METRICS *stats;
+    struct timespec accepted;
+
+    // Трасса, пришедшая перед ответом на задание trace_request_id.
+    struct worker_trace trace;
+    uint64_t trace_request_id;
+    bool has_trace;
+    // Сколько потоков узла уже попало в трассу текущего задания.
+    uint32_t trace_threads;
+
 } WORK_CONNECTION;
 
+// Отрезок интегрирования со своим шагом.
+typedef struct
+{
+    // Номер интеграла в пакете, к которому относится отрезок.
+    size_t request;
+    FUNC_TABLE func_id;
+    QUAD_RULE rule;
+    double left;
+    double step;
+    uint64_t num_steps;
+} SEGMENT;
+
+// Очередь ещё не выданных шагов интегрирования: отрезки выдаются по порядку,
+// мелкие отрезки упаковываются в один кусок.
+typedef struct
+{
+    SEGMENT *segments;
+    size_t num_segments;
+    size_t capacity;
+    // Текущий отрезок и первый ещё не выданный шаг в нём.
+    size_t cur_segment;
+    uint64_t next_step;
+    // Общее число шагов и число уже выданных шагов.
+    uint64_t num_count;
+    uint64_t num_issued;
+} STEP_QUEUE;
+
+// Кусок задания — одна или несколько подряд идущих частей отрезков, которые
+// отправляются одним кадром. Опоздавший кусок может считаться сразу на
+// нескольких узлах, в ответ идёт первое пришедшее значение.
+typedef struct
+{
+    size_t first_part;
+    uint32_t num_parts;
+    // Сколько копий куска выдано узлам.
+    unsigned copies;
+    bool done;
+} JOB_CHUNK;
+
+// Вычисление одного интеграла на пуле.
+typedef struct job
+{
+    STEP_QUEUE queue;
+    // Функция и формула, по замеру которых делится работа.
+    FUNC_TABLE func_id;
+    QUAD_RULE rule;
+    SUMMATION_MODE summation;
+    // Ответы, по одному на интеграл пакета.
+    double *results;
+    size_t num_results;
+    // Части отрезков, уже выданные узлам, и номера их интегралов.
+    struct worker_data *parts;
+    size_t *part_requests;
+    // Ответы частей при компенсированном суммировании: складываются по порядку
+    // частей в конце задания.
+    double *part_values;
+    size_t num_parts;
+    size_t parts_capacity;
+    // Все выданные куски задания.
+    JOB_CHUNK *chunks;
+    size_t num_chunks;
+    size_t chunks_capacity;
+    // Выданные и ещё не посчитанные куски.
+    size_t num_pending;
+    // Куски потерянных узлов, которые надо выдать заново.
+    size_t *retry;
+    size_t num_retry;
+    size_t retry_capacity;
+    // Сколько шагов уже распределено в статическом режиме.
+    uint64_t assigned;
+    // Код ошибки, если узел отказался считать кусок задания.
+    int status;
+    // Коды ошибок интегралов (0 — посчитан). Если массив задан, отказ узла
+    // засчитывается только интегралам, части которых были в куске; иначе
+    // первый же отказ прерывает всё задание с кодом status.
+    int *statuses;
+    // Файл трассы задания (NULL — трасса не пишется), число событий в нём
+    // и начало задания, от которого отсчитываются времена событий.
+    FILE *trace;
+    size_t trace_events;
+    struct timespec trace_start;
+} JOB;
+
 
 void info_manager_init(INFO_MANAGER *manager, char addr[], char port[], time_t seconds, int num_nodes) {
-    struct addrinfo hints, *res, *p;
+    struct addrinfo hints, *res;
     int status;
 
     memset(&hints, 0, sizeof hints);
@@ -108,11 +585,72 @@ void info_manager_init(INFO_MANAGER *manager, char addr[], char port[], time_t s
     }
 
     manager->listen_addr = *res->ai_addr;
+    freeaddrinfo(res);
     manager->max_time = seconds;
     manager->num_nodes = num_nodes;
+    manager->schedule = SCHEDULE_DYNAMIC;
+    manager->adaptive = false;
+    manager->summation = SUMMATION_NAIVE;
+    manager->works = NULL;
+    manager->num_works = 0;
+    manager->works_capacity = 0;
+    manager->num_ready = 0;
+    manager->listen_sock_fd = -1;
+    manager->epoll_fd = -1;
+    manager->job = NULL;
+    manager->value_load = 0;
+    manager->next_request_id = 1;
+    manager->pool_started = false;
+    manager->async = NULL;
+    manager->async_stopping = false;
+    manager->cache = NULL;
+    manager->metrics = calloc(1, sizeof(MANAGER_METRICS));
+    if (manager->metrics == NULL) {
+        fprintf(stderr, "Unable to allocate manager metrics\n");
+        exit(EXIT_FAILURE);
+    }
+    manager->metrics->server_fd = -1;
+    manager->flush_list = NULL;
+    manager->trace_prefix = NULL;
+    manager->num_traces = 0;
     manager->is_init = true;
 }
 
+void info_manager_set_schedule(INFO_MANAGER *manager, SCHEDULE_MODE schedule) {
+    manager->schedule = schedule;
+}
+
+void info_manager_set_adaptive(INFO_MANAGER *manager, bool adaptive) {
+    manager->adaptive = adaptive;
+}
+
+void info_manager_set_summation(INFO_MANAGER *manager, SUMMATION_MODE summation) {
+    manager->summation = summation;
+}
+
+void info_manager_set_trace(INFO_MANAGER *manager, const char *prefix) {
+    free(manager->trace_prefix);
+    manager->trace_prefix = NULL;
+    if (prefix != NULL) {
+        manager->trace_prefix = strdup(prefix);
+        if (manager->trace_prefix == NULL) {
+            fprintf(stderr, "Unable to allocate trace prefix\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+// Компенсированное сложение Ноймайера: comp накапливает потерянные младшие разряды.
+static inline void neumaier_add(double *sum, double *comp, double value) {
+    double t = *sum + value;
+    if (fabs(*sum) >= fabs(value)) {
+        *comp += (*sum - t) + value;
+    } else {
+        *comp += (value - t) + *sum;
+    }
+    *sum = t;
+}
+
 static void manager_init_socket(INFO_MANAGER* manager)
 {
     if (manager->is_init == false) {
@@ -142,12 +680,29 @@ static void manager_init_socket(INFO_MANAGER* manager)
         exit(EXIT_FAILURE);
     }
 
-    // Активируем очередь запросов на подключение.
-    if (listen(manager->listen_sock_fd, manager->num_nodes /* Размер очереди запросов на подключение */) == -1)
+    // Активируем очередь запросов на подключение: при сотнях узлов, подключающихся
+    // одновременно, очередь размером в num_nodes переполнялась бы.
+    if (listen(manager->listen_sock_fd, SOMAXCONN) == -1)
     {
         fprintf(stderr, "[manager_init] Unable to listen() on a socket\n");
         exit(EXIT_FAILURE);
     }
+
+    // Все сокеты менеджера обслуживаются одним epoll в режиме edge-triggered.
+    manager->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (manager->epoll_fd == -1)
+    {
+        fprintf(stderr, "[manager_init] Unable to create epoll instance\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Слушающий сокет отличаем по пустому указателю.
+    struct epoll_event event = {.events = EPOLLIN | EPOLLET, .data.ptr = NULL};
+    if (epoll_ctl(manager->epoll_fd, EPOLL_CTL_ADD, manager->listen_sock_fd, &event) == -1)
+    {
+        fprintf(stderr, "[manager_init] Unable to add listen socket to epoll\n");
+        exit(EXIT_FAILURE);
+    }
 }
 static void manager_close_listen_socket(INFO_MANAGER* manager) {
 
@@ -156,23 +711,52 @@ static void manager_close_listen_socket(INFO_MANAGER* manager) {
         fprintf(stderr, "[manager_close_listen_socket] Unable to close() listen-socket\n");
         exit(EXIT_FAILURE);
     }
+    manager->listen_sock_fd = -1;
 }
 
-static void server_accept_connection_request(INFO_MANAGER* server, WORK_CONNECTION* conn)
+static void manager_add_connection(INFO_MANAGER *manager, WORK_CONNECTION *conn)
 {
-    printf("Wait for worker_node to connect\n");
+    if (manager->num_works == manager->works_capacity)
+    {
+        manager->works_capacity = manager->works_capacity == 0 ? manager->num_nodes : 2 * manager->works_capacity;
+        manager->works = realloc(manager->works, manager->works_capacity * sizeof(WORK_CONNECTION *));
+        if (manager->works == NULL)
+        {
+            fprintf(stderr, "Unable to allocate connection states\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    manager->works[manager->num_works++] = conn;
+}
 
-    // Создаём сокет для клиента из очереди на подключение.
-    conn->client_sock_fd = accept(server->listen_sock_fd, NULL, NULL);
-    if (conn->client_sock_fd == -1)
+// Принимает одно подключение из очереди. Возвращает NULL, когда очередь пуста.
+static WORK_CONNECTION *server_accept_connection_request(INFO_MANAGER* server)
+{
+    int client_sock_fd;
+    while (true)
     {
+        // Создаём сокет для клиента из очереди на подключение.
+        client_sock_fd = accept4(server->listen_sock_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (client_sock_fd != -1)
+            break;
+
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return NULL;
+        // Клиент отвалился, не дождавшись accept(), — это не повод завершать менеджер.
+        if (errno == ECONNABORTED || errno == EINTR || errno == EPROTO)
+            continue;
+        if (errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+        {
+            fprintf(stderr, "[server_accept_connection_request] Out of resources, connection left in backlog\n");
+            return NULL;
+        }
         fprintf(stderr, "[server_accept_connection_request] Unable to accept() connection on a socket\n");
         exit(EXIT_FAILURE);
     }
 
     // Disable Nagle's algorithm:
     int setsockopt_arg = 1;
-    if (setsockopt(conn->client_sock_fd, IPPROTO_TCP, TCP_NODELAY, &setsockopt_arg, sizeof(setsockopt_arg)) == -1)
+    if (setsockopt(client_sock_fd, IPPROTO_TCP, TCP_NODELAY, &setsockopt_arg, sizeof(setsockopt_arg)) == -1)
     {
         fprintf(stderr, "[server_accept_connection_request] Unable to enable TCP_NODELAY socket option");
         exit(EXIT_FAILURE);
@@ -180,56 +764,436 @@ static void server_accept_connection_request(INFO_MANAGER* server, WORK_CONNECTI
 
     // Disable corking:
     setsockopt_arg = 0;
-    if (setsockopt(conn->client_sock_fd, IPPROTO_TCP, TCP_CORK, &setsockopt_arg, sizeof(setsockopt_arg)) == -1)
+    if (setsockopt(client_sock_fd, IPPROTO_TCP, TCP_CORK, &setsockopt_arg, sizeof(setsockopt_arg)) == -1)
     {
         fprintf(stderr, "[server_accept_connection_request] Unable to disable TCP_CORK socket option");
         exit(EXIT_FAILURE);
     }
 
+    WORK_CONNECTION *conn = calloc(1, sizeof(WORK_CONNECTION));
+    if (conn == NULL)
+    {
+        fprintf(stderr, "Unable to allocate connection state\n");
+        exit(EXIT_FAILURE);
+    }
+    conn->client_sock_fd = client_sock_fd;
+    conn->state = GET_INFO;
+    conn->manager = server;
+    clock_gettime(CLOCK_MONOTONIC, &conn->accepted);
+    MANAGER_METRICS *metrics = server->metrics;
+    conn->metrics = metrics;
+    uint64_t worker_i = metric_get(&metrics->num_workers);
+    if (worker_i < MAX_WORKER_METRICS) {
+        conn->stats = &metrics->workers[worker_i];
+        metric_set(&conn->stats->connected, 1);
+        metric_set(&metrics->num_workers, worker_i + 1);
+    }
+    metric_add(&metrics->workers_connected, 1);
+
+    struct epoll_event event = {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET, .data.ptr = conn};
+    if (epoll_ctl(server->epoll_fd, EPOLL_CTL_ADD, client_sock_fd, &event) == -1)
+    {
+        fprintf(stderr, "[server_accept_connection_request] Unable to add socket to epoll\n");
+        exit(EXIT_FAILURE);
+    }
+
+    manager_add_connection(server, conn);
     printf("Worker connected\n");
+    return conn;
 }
 
-static void manager_get_worker_info(WORK_CONNECTION *work)
+//==================
+// Буферы соединений
+//==================
+
+#define CONN_BUFFER_INIT 8192U
+
+// Гарантирует место под length байт после tail.
+static void conn_buffer_reserve(CONN_BUFFER *buf, size_t length)
 {
+    if (buf->head == buf->tail)
+    {
+        buf->head = buf->tail = 0;
+    }
+    if (buf->tail + length <= buf->capacity)
+    {
+        return;
+    }
 
-    struct node_info node;
+    // Сдвигаем необработанные данные в начало буфера.
+    if (buf->head != 0)
+    {
+        memmove(buf->data, buf->data + buf->head, buf->tail - buf->head);
+        buf->tail -= buf->head;
+        buf->head = 0;
+    }
+    if (buf->tail + length <= buf->capacity)
+    {
+        return;
+    }
 
-    size_t bytes_read = recv(work->client_sock_fd, &node, sizeof(node), 0U);
-    if (bytes_read != sizeof(node))
+    size_t capacity = buf->capacity == 0 ? CONN_BUFFER_INIT : buf->capacity;
+    while (capacity < buf->tail + length)
     {
-        fprintf(stderr, "Unable to recv node info from worker\n");
+        capacity *= 2;
+    }
+    buf->data = realloc(buf->data, capacity);
+    if (buf->data == NULL)
+    {
+        fprintf(stderr, "Unable to allocate connection buffer\n");
         exit(EXIT_FAILURE);
     }
+    buf->capacity = capacity;
+}
+
+static void conn_buffer_free(CONN_BUFFER *buf)
+{
+    free(buf->data);
+    buf->data = NULL;
+    buf->head = buf->tail = buf->capacity = 0;
+}
+
+// Отправляет накопленные кадры, пока сокет их принимает. Остаток уйдёт по EPOLLOUT.
+// Возвращает false, если соединение разорвано.
+static bool manager_flush(WORK_CONNECTION *work)
+{
+    CONN_BUFFER *buf = &work->wbuf;
+    while (buf->head != buf->tail)
+    {
+        // MSG_NOSIGNAL: отключившийся узел не должен убивать менеджер сигналом SIGPIPE.
+        ssize_t bytes_written = send(work->client_sock_fd, buf->data + buf->head, buf->tail - buf->head, MSG_NOSIGNAL);
+        if (bytes_written == -1)
+        {
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                return true;
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        buf->head += bytes_written;
+        metric_add(&work->metrics->bytes_sent, bytes_written);
+        if (work->stats != NULL)
+            metric_add(&work->stats->bytes_sent, bytes_written);
+    }
+    return true;
+}
+
+// Дочитывает из сокета всё, что есть. Возвращает false, если соединение закрыто.
+// Если узел не закрывал соединение (hangup == false), короткое чтение значит, что
+// сокет уже пуст, и лишний recv до EAGAIN не нужен: новые данные снова поднимут
+// событие EPOLLET. После EPOLLRDHUP читаем до конца, иначе конец потока потеряется.
+static bool manager_read(WORK_CONNECTION *work, bool hangup)
+{
+    CONN_BUFFER *buf = &work->rbuf;
+    while (true)
+    {
+        conn_buffer_reserve(buf, sizeof(struct frame_header) + MAX_FRAME_PAYLOAD);
+        size_t space = buf->capacity - buf->tail;
+        ssize_t bytes_read = recv(work->client_sock_fd, buf->data + buf->tail, space, 0U);
+        if (bytes_read > 0)
+        {
+            buf->tail += bytes_read;
+            metric_add(&work->metrics->bytes_received, bytes_read);
+            if (work->stats != NULL)
+                metric_add(&work->stats->bytes_received, bytes_read);
+            if ((size_t)bytes_read < space && !hangup)
+                return true;
+            continue;
+        }
+        if (bytes_read == 0)
+            return false;
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return true;
+        if (errno != EINTR)
+            return false;
+    }
+}
+
+// Помечает узел потерянным. Соединение закрывается позже, вне обработчиков событий.
+static void manager_lose_worker(WORK_CONNECTION *work)
+{
+    work->state = WORK_LOST;
+}
+
+// Снимает из буфера очередной полностью принятый кадр. Полезная нагрузка
+// действительна до следующего чтения из сокета.
+static bool manager_next_frame(WORK_CONNECTION *work, struct frame_header *hdr, const char **payload)
+{
+    CONN_BUFFER *buf = &work->rbuf;
+    size_t available = buf->tail - buf->head;
+    if (available < sizeof(*hdr))
+        return false;
+
+    memcpy(hdr, buf->data + buf->head, sizeof(*hdr));
+    if (hdr->length > MAX_FRAME_PAYLOAD)
+    {
+        fprintf(stderr, "Frame from worker is too long\n");
+        manager_lose_worker(work);
+        return false;
+    }
+    if (available < sizeof(*hdr) + hdr->length)
+        return false;
+
+    *payload = buf->data + buf->head + sizeof(*hdr);
+    buf->head += sizeof(*hdr) + hdr->length;
+    metric_add(&work->metrics->frames_received, 1);
+    return true;
+}
+
+static void manager_send_frame(WORK_CONNECTION *work, uint32_t type, uint64_t request_id, const void *payload, uint32_t length)
+{
+    struct frame_header hdr = {.type = type, .length = length, .request_id = request_id};
+    CONN_BUFFER *buf = &work->wbuf;
+    conn_buffer_reserve(buf, sizeof(hdr) + length);
+    memcpy(buf->data + buf->tail, &hdr, sizeof(hdr));
+    if (length != 0) {
+        memcpy(buf->data + buf->tail + sizeof(hdr), payload, length);
+    }
+    buf->tail += sizeof(hdr) + length;
+    metric_add(&work->metrics->frames_sent, 1);
+
+    // Кадр уйдёт в manager_flush_pending вместе с остальными кадрами соединения.
+    if (!work->flush_queued)
+    {
+        work->flush_queued = true;
+        work->flush_next = work->manager->flush_list;
+        work->manager->flush_list = work;
+    }
+}
+
+// Отправляет кадры, накопленные с прошлого вызова: все кадры, выданные узлу за
+// один проход цикла событий (куски, байт-код выражений), уходят одним send.
+static void manager_flush_pending(INFO_MANAGER *manager)
+{
+    while (manager->flush_list != NULL)
+    {
+        WORK_CONNECTION *work = manager->flush_list;
+        manager->flush_list = work->flush_next;
+        work->flush_queued = false;
+        if (work->state != WORK_LOST && !manager_flush(work))
+            manager_lose_worker(work);
+    }
+}
+
+//==================
+// Протокол
+//==================
+
+static double timespec_diff_sec(const struct timespec *from, const struct timespec *to) {
+    return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) * 1e-9;
+}
+
+static bool manager_get_worker_info(WORK_CONNECTION *work, const struct frame_header *hdr, const char *payload)
+{
+    struct node_info node;
+    if (hdr->length != sizeof(node))
+    {
+        fprintf(stderr, "Unable to recv node info from worker\n");
+        return false;
+    }
+    memcpy(&node, payload, sizeof(node));
+    work->node = node;
     work->load = node.max_worker_time * node.n_cores;
+    work->n_cores = node.n_cores > 0 ? node.n_cores : 1;
+    work->state = SEND_TASK;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    metric_observe(&work->metrics->handshake, timespec_diff_sec(&work->accepted, &now));
+    if (work->stats != NULL) {
+        metric_set(&work->stats->n_cores, work->n_cores);
+        metric_set(&work->stats->n_cpus, node.n_cpus);
+        metric_set(&work->stats->n_physical_cores, node.n_physical_cores);
+        metric_set(&work->stats->n_packages, node.n_packages);
+        metric_set(&work->stats->n_numa_nodes, node.n_numa_nodes);
+    }
     DEBUG("Connect node with time: %ld and cores : %d",node.max_worker_time,node.n_cores);
+    return true;
 }
 
-static void manager_send_task(WORK_CONNECTION *work, struct worker_data send_data) {
-    size_t bytes_written = write(work->client_sock_fd, &send_data, sizeof(send_data));
-    if (bytes_written != sizeof(send_data))
-    {
-        fprintf(stderr, "Unable to send data block to client\n");
-        exit(EXIT_FAILURE);
+// Отправляет узлу байт-код выражения, если оно ему ещё не известно.
+static void manager_send_integrand(WORK_CONNECTION *work, int func_id) {
+    int expr_i = integrand_expr_index(func_id);
+    if (expr_i == -1 || (work->exprs_sent & (1ULL << expr_i)) != 0) {
+        return;
+    }
+    manager_send_frame(work, FRAME_EXPR, 0, &integrand_exprs[expr_i], sizeof(struct expr_program));
+    work->exprs_sent |= 1ULL << expr_i;
+}
+
+// Отправляет кусок из num_parts частей: одну часть — кадром FRAME_TASK, несколько — пакетом.
+static void manager_send_task(WORK_CONNECTION *work, uint64_t request_id, const struct worker_data *parts, uint32_t num_parts, size_t chunk_id) {
+    for (uint32_t part_i = 0; part_i < num_parts; ++part_i) {
+        manager_send_integrand(work, parts[part_i].func_id);
+    }
+    uint32_t type = num_parts == 1 ? FRAME_TASK : FRAME_TASK_BATCH;
+    manager_send_frame(work, type, request_id, parts, num_parts * sizeof(struct worker_data));
+
+    IN_FLIGHT_CHUNK *chunk = &work->in_flight[work->num_in_flight++];
+    chunk->request_id = request_id;
+    chunk->chunk = chunk_id;
+    chunk->num_steps = 0;
+    chunk->num_evals = 0;
+    for (uint32_t part_i = 0; part_i < num_parts; ++part_i) {
+        chunk->num_steps += parts[part_i].num_steps;
+        chunk->num_evals += parts[part_i].num_steps * rule_points[parts[part_i].rule];
     }
+    clock_gettime(CLOCK_MONOTONIC, &chunk->sent);
     work->state = GET_ANS;
 }
-static double manager_get_worker_ans(WORK_CONNECTION *work) {
-    double res;
-    size_t bytes_read = recv(work->client_sock_fd, &res, sizeof(res), 0U);
-    if (bytes_read != sizeof(res))
+
+static void manager_send_calibrate(WORK_CONNECTION *work, FUNC_TABLE func_id, QUAD_RULE rule, double left, double right) {
+    manager_send_integrand(work, func_id);
+    work->calibration = (struct calibrate_request){.func_id = func_id, .rule = rule, .left = left, .right = right};
+    manager_send_frame(work, FRAME_CALIBRATE, 0, &work->calibration, sizeof(work->calibration));
+    work->calibrating = true;
+}
+
+static void manager_send_stop(WORK_CONNECTION *work) {
+    manager_send_frame(work, FRAME_STOP, 0, NULL, 0);
+}
+
+// Разбирает ответ узла (FRAME_RESULT или FRAME_RESULT_BATCH) и снимает соответствующий
+// кусок с его очереди. В values возвращается по значению на часть куска, в answered —
+// снятый кусок, в status — код отказа узла (WORKER_STATUS) или 0.
+// Возвращает false, если ответ некорректен.
+static bool manager_get_worker_ans(WORK_CONNECTION *work, const struct frame_header *hdr, const char *payload, double *values, uint32_t *num_values, IN_FLIGHT_CHUNK *answered, int *status) {
+    struct worker_batch_result res;
+    size_t values_offset = offsetof(struct worker_batch_result, values);
+    if (hdr->type == FRAME_RESULT && hdr->length == sizeof(struct worker_result))
+    {
+        struct worker_result single;
+        memcpy(&single, payload, sizeof(single));
+        res.status = single.status;
+        res.num_values = 1;
+        res.compute_sec = single.compute_sec;
+        res.cpu_sec = single.cpu_sec;
+        res.values[0] = single.value;
+    }
+    else if (hdr->type == FRAME_RESULT_BATCH && hdr->length >= values_offset)
+    {
+        memcpy(&res, payload, values_offset);
+        if (res.num_values > MAX_BATCH_PARTS || hdr->length != values_offset + res.num_values * sizeof(double))
+        {
+            fprintf(stderr, "Unable to recv res from worker\n");
+            return false;
+        }
+        memcpy(res.values, payload + values_offset, res.num_values * sizeof(double));
+    }
+    else
     {
         fprintf(stderr, "Unable to recv res from worker\n");
-        exit(EXIT_FAILURE);
+        return false;
+    }
+    // Отказ узла (например, незнакомая ему функция) не нарушает протокол:
+    // кусок снимается с очереди, а задание завершается с ошибкой.
+    if (res.status != 0)
+    {
+        fprintf(stderr, "Worker refused task with status %d\n", res.status);
+    }
+    *status = res.status;
+
+    size_t chunk_i = 0;
+    while (chunk_i < work->num_in_flight && work->in_flight[chunk_i].request_id != hdr->request_id) {
+        chunk_i++;
+    }
+    if (chunk_i == work->num_in_flight) {
+        fprintf(stderr, "Unexpected request id %lu from worker\n", hdr->request_id);
+        return false;
+    }
+    IN_FLIGHT_CHUNK chunk = work->in_flight[chunk_i];
+    // Сохраняем порядок выдачи: по нему оценивается ожидаемое время готовности.
+    memmove(&work->in_flight[chunk_i], &work->in_flight[chunk_i + 1], (work->num_in_flight - chunk_i - 1) * sizeof(IN_FLIGHT_CHUNK));
+    work->num_in_flight--;
+    *answered = chunk;
+
+    // Обновляем оценку производительности узла: кусок считался с момента выдачи
+    // или с момента предыдущего ответа, если до него в очереди были другие куски.
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const struct timespec *start = &chunk.sent;
+    if (timespec_diff_sec(start, &work->last_ans) > 0) {
+        start = &work->last_ans;
     }
-    DEBUG("Return ans: %lf",res);
-    return res;
+    double elapsed = timespec_diff_sec(start, &now);
+    if (elapsed > 0) {
+        work->rate = chunk.num_steps / elapsed;
+    }
+    work->last_ans = now;
+
+    MANAGER_METRICS *metrics = work->metrics;
+    double rtt = timespec_diff_sec(&chunk.sent, &now);
+    metric_observe(&metrics->chunk_rtt, rtt);
+    metric_observe(&metrics->chunk_compute, res.compute_sec);
+    if (res.status == 0 && chunk.chunk != NO_CHUNK) {
+        metric_add(&metrics->steps, chunk.num_steps);
+        metric_add(&metrics->evaluations, chunk.num_evals);
+    }
+    if (work->stats != NULL) {
+        metric_add(&work->stats->chunks, 1);
+        metric_add(&work->stats->steps, chunk.num_steps);
+        metric_add(&work->stats->compute_ns, metric_sec_to_ns(res.compute_sec));
+        metric_add(&work->stats->cpu_ns, metric_sec_to_ns(res.cpu_sec));
+        metric_add(&work->stats->rtt_ns, metric_sec_to_ns(rtt));
+    }
+    if (work->num_in_flight == 0) {
+        work->state = SEND_TASK;
+    }
+    memcpy(values, res.values, res.num_values * sizeof(double));
+    *num_values = res.num_values;
+    return true;
+}
+
+// Запоминает трассу, которую узел прислал перед ответом на задание.
+static bool manager_get_worker_trace(WORK_CONNECTION *work, const struct frame_header *hdr, const char *payload) {
+    size_t threads_offset = offsetof(struct worker_trace, threads);
+    if (hdr->length < threads_offset) {
+        fprintf(stderr, "Unable to recv trace from worker\n");
+        return false;
+    }
+    memcpy(&work->trace, payload, threads_offset);
+    if (work->trace.num_threads > MAX_TRACE_THREADS ||
+        hdr->length != threads_offset + work->trace.num_threads * sizeof(struct trace_thread)) {
+        fprintf(stderr, "Unable to recv trace from worker\n");
+        return false;
+    }
+    memcpy(work->trace.threads, payload + threads_offset, work->trace.num_threads * sizeof(struct trace_thread));
+    work->trace_request_id = hdr->request_id;
+    work->has_trace = true;
+    return true;
 }
+
+// Разбирает ответ на замер производительности и запоминает его.
+static bool manager_get_worker_calibration(WORK_CONNECTION *work, const struct frame_header *hdr, const char *payload) {
+    const struct calibrate_request *req = &work->calibration;
+    struct calibration_result res;
+    if (hdr->length != sizeof(res) || !work->calibrating)
+    {
+        fprintf(stderr, "Unable to recv calibration from worker\n");
+        return false;
+    }
+    memcpy(&res, payload, sizeof(res));
+    work->calibrating = false;
+    if (res.status != 0 || !(res.steps_per_sec > 0))
+    {
+        fprintf(stderr, "Worker calibration failed with status %d\n", res.status);
+        return true;
+    }
+    int slot = integrand_slot(req->func_id);
+    work->calibrated[slot][req->rule] = res.steps_per_sec;
+    clock_gettime(CLOCK_MONOTONIC, &work->calibrated_at[slot][req->rule]);
+    return true;
+}
+
 void manager_close_worker_socket(WORK_CONNECTION *work) {
     if (close(work->client_sock_fd) == -1)
     {
         fprintf(stderr, "[manager_close_worker_socket] Unable to close() worker-socket\n");
         exit(EXIT_FAILURE);
     }
+    conn_buffer_free(&work->rbuf);
+    conn_buffer_free(&work->wbuf);
+    if (work->stats != NULL)
+        metric_set(&work->stats->connected, 0);
     work->state = WORK_FINISHED;
     work->client_sock_fd = -1;
-}
\ No newline at end of file
+}
@@ -1,227 +1,2406 @@
 #include "manager-common.h"
 #include <memory.h>
-#include <poll.h>
 #include <math.h>
 #include <sched.h>
 #include <pthread.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <stdarg.h>
 
 
-static void poll_server_wait_for_worker(struct pollfd* pollfds, INFO_MANAGER* server)
-{
-    struct pollfd* pollfd = &pollfds[0U];
+// Число кусков на узел при первой раздаче в динамическом режиме.
+#define CHUNKS_PER_WORKER 16U
+// Минимальный размер куска в шагах: меньшие куски не окупают обмен по сети.
+#define MIN_CHUNK_STEPS 4096U
+// Желаемое время вычисления одного куска на узле.
+#define TARGET_CHUNK_SEC 0.02
+// Кусок считается опоздавшим, если считается дольше ожидаемого
+// в STRAGGLER_FACTOR раз плюс STRAGGLER_SLACK_SEC на задержку сети.
+#define STRAGGLER_FACTOR 2.0
+#define STRAGGLER_SLACK_SEC 0.01
+// Сколько секунд замер производительности узла считается актуальным.
+#define CALIBRATION_TTL_SEC 60.0
+// Сколько всего копий одного куска может считаться одновременно.
+#define MAX_CHUNK_COPIES 2U
+// Как часто проверяем опоздавшие куски, пока ждём ответов.
+#define STRAGGLER_CHECK_MS 10
+// При компенсированном суммировании каждая часть — целая клетка сетки с этим
+// шагом от начала отрезка: разбиение на части, а с ним и ответ, не зависят
+// ни от размеров кусков, выбранных по скорости узлов, ни от числа узлов.
+#define PART_GRID_STEPS (1ULL << 20)
+// Сколько шагов берётся на отрезке, если производную оценить не удалось.
+#define MAX_SEGMENT_STEPS 0x1p32
+
+// Размер следующего куска для узла.
+static uint64_t next_chunk_size(INFO_MANAGER *manager, STEP_QUEUE *queue, WORK_CONNECTION *work) {
+    uint64_t remaining = queue->num_count - queue->num_issued;
+    if (remaining == 0) {
+        return 0;
+    }
+    if (manager->schedule == SCHEDULE_STATIC) {
+        return work->quota;
+    }
+
+    double size;
+    if (work->rate == 0 && manager->value_load != 0) {
+        // Производительность ещё не измерена — исходим из заявленной нагрузки.
+        size = (double)queue->num_count * work->load / manager->value_load / CHUNKS_PER_WORKER;
+    } else {
+        size = work->rate * TARGET_CHUNK_SEC;
+    }
+    if (size == 0) {
+        size = (double)queue->num_count / CHUNKS_PER_WORKER;
+    }
 
-    pollfd->fd      = server->listen_sock_fd;
-    pollfd->events  = POLLIN;
-    pollfd->revents = 0U;
+    // Под конец куски уменьшаются, чтобы хвост разошёлся по всем узлам.
+    double guided = (double)remaining / (2 * manager->num_works);
+    if (size > guided) {
+        size = guided;
+    }
+    if (size < MIN_CHUNK_STEPS) {
+        size = MIN_CHUNK_STEPS;
+    }
+    if (size > remaining) {
+        size = remaining;
+    }
+    return (uint64_t)size;
 }
 
-static void poll_server_do_not_wait_for_workers(struct pollfd* pollfds)
-{
-    struct pollfd* pollfd = &pollfds[0U];
+static void queue_push_segment(STEP_QUEUE *queue, size_t request, FUNC_TABLE func_id, QUAD_RULE rule, double left, double right, uint64_t num_steps) {
+    if (queue->num_segments == queue->capacity) {
+        queue->capacity = queue->capacity == 0 ? 16U : 2 * queue->capacity;
+        queue->segments = realloc(queue->segments, queue->capacity * sizeof(SEGMENT));
+        if (queue->segments == NULL)
+        {
+            fprintf(stderr, "Unable to allocate segment queue\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    SEGMENT *segment = &queue->segments[queue->num_segments++];
+    segment->request = request;
+    segment->func_id = func_id;
+    segment->rule = rule;
+    segment->left = left;
+    segment->step = (right - left) / num_steps;
+    segment->num_steps = num_steps;
+    queue->num_count += num_steps;
+}
+
+static void queue_free(STEP_QUEUE *queue) {
+    free(queue->segments);
+    queue->segments = NULL;
+    queue->num_segments = queue->capacity = 0;
+}
+
+static void job_add_part(JOB *job, struct worker_data data, size_t request) {
+    if (job->num_parts == job->parts_capacity) {
+        job->parts_capacity = job->parts_capacity == 0 ? 64U : 2 * job->parts_capacity;
+        job->parts = realloc(job->parts, job->parts_capacity * sizeof(struct worker_data));
+        job->part_requests = realloc(job->part_requests, job->parts_capacity * sizeof(size_t));
+        job->part_values = realloc(job->part_values, job->parts_capacity * sizeof(double));
+        if (job->parts == NULL || job->part_requests == NULL || job->part_values == NULL)
+        {
+            fprintf(stderr, "Unable to allocate job parts\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    data.summation = job->summation;
+    data.flags = job->trace != NULL ? WORK_TRACE : 0;
+    job->parts[job->num_parts] = data;
+    job->part_requests[job->num_parts] = request;
+    job->part_values[job->num_parts] = 0;
+    job->num_parts++;
+}
 
-    pollfd->fd      = -1;
-    pollfd->events  = 0U;
-    pollfd->revents = 0U;
+static size_t job_add_chunk(JOB *job, size_t first_part, uint32_t num_parts) {
+    if (job->num_chunks == job->chunks_capacity) {
+        job->chunks_capacity = job->chunks_capacity == 0 ? 64U : 2 * job->chunks_capacity;
+        job->chunks = realloc(job->chunks, job->chunks_capacity * sizeof(JOB_CHUNK));
+        if (job->chunks == NULL)
+        {
+            fprintf(stderr, "Unable to allocate job chunks\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    JOB_CHUNK *chunk = &job->chunks[job->num_chunks];
+    chunk->first_part = first_part;
+    chunk->num_parts = num_parts;
+    chunk->copies = 0;
+    chunk->done = false;
+    job->num_pending++;
+    return job->num_chunks++;
 }
 
-static void poll_manager_wait_for_answer(struct pollfd* pollfds, size_t conn_i, WORK_CONNECTION *work) {
-    struct pollfd* pollfd = &pollfds[1 + conn_i];
+// Засчитывает ответ на кусок. Возвращает false, если число значений не совпадает с числом частей.
+static bool job_complete_chunk(JOB *job, size_t chunk_id, const double *values, uint32_t num_values) {
+    // Берём первый пришедший ответ, остальные копии куска отбрасываем.
+    if (chunk_id == NO_CHUNK || job->chunks[chunk_id].done) {
+        return true;
+    }
+    JOB_CHUNK *chunk = &job->chunks[chunk_id];
+    if (num_values != chunk->num_parts) {
+        return false;
+    }
+    for (uint32_t part_i = 0; part_i < num_values; ++part_i) {
+        size_t part = chunk->first_part + part_i;
+        if (job->summation == SUMMATION_COMPENSATED) {
+            job->part_values[part] = values[part_i];
+        } else {
+            job->results[job->part_requests[part]] += values[part_i];
+        }
+    }
+    chunk->done = true;
+    job->num_pending--;
+    return true;
+}
 
-    pollfd->fd      = work->client_sock_fd;
-    pollfd->events  = POLLIN | POLLHUP;
-    pollfd->revents = 0U;
+static void job_push_retry(JOB *job, size_t chunk_id) {
+    if (job->num_retry == job->retry_capacity) {
+        job->retry_capacity = job->retry_capacity == 0 ? 16U : 2 * job->retry_capacity;
+        job->retry = realloc(job->retry, job->retry_capacity * sizeof(size_t));
+        if (job->retry == NULL)
+        {
+            fprintf(stderr, "Unable to allocate retry queue\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    job->retry[job->num_retry++] = chunk_id;
 }
 
-static void poll_server_do_not_wait_for_ans(struct pollfd* pollfds, size_t conn_i){
-    struct pollfd* pollfd = &pollfds[conn_i + 1];
+// Узел отказался считать кусок с кодом rc. Если задание различает интегралы,
+// отказ засчитывается только им: кусок с частями разных интегралов делится на
+// куски по одной части, и они выдаются заново — так ошибка в одном интеграле
+// пакета не портит соседние. Иначе отказ прерывает всё задание.
+static void job_fail_chunk(JOB *job, size_t chunk_id, int rc) {
+    if (job->chunks[chunk_id].done) {
+        return;
+    }
+    if (job->statuses == NULL) {
+        job->status = rc;
+        return;
+    }
+    JOB_CHUNK *chunk = &job->chunks[chunk_id];
+    size_t first_part = chunk->first_part;
+    uint32_t num_parts = chunk->num_parts;
+    chunk->done = true;
+    job->num_pending--;
+
+    size_t request = job->part_requests[first_part];
+    bool mixed = false;
+    for (uint32_t part_i = 1; part_i < num_parts; ++part_i) {
+        mixed |= job->part_requests[first_part + part_i] != request;
+    }
+    if (!mixed) {
+        job->statuses[request] = rc;
+        return;
+    }
+    // job_add_chunk может перенести массив кусков, chunk дальше не используется.
+    for (uint32_t part_i = 0; part_i < num_parts; ++part_i) {
+        size_t part = first_part + part_i;
+        if (job->statuses[job->part_requests[part]] == 0) {
+            job_push_retry(job, job_add_chunk(job, part, 1));
+        }
+    }
+}
 
-    pollfd->fd      = -1;
-    pollfd->events  = 0U;
-    pollfd->revents = 0U;
+// Складывает ответы частей в порядке их выдачи: порядок прихода ответов
+// и то, какая из копий куска пришла первой, на сумму не влияют.
+static void job_reduce_compensated(JOB *job) {
+    double *comp = calloc(job->num_results == 0 ? 1 : job->num_results, sizeof(double));
+    if (comp == NULL) {
+        fprintf(stderr, "Unable to allocate compensation terms\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t part = 0; part < job->num_parts; ++part) {
+        size_t request = job->part_requests[part];
+        neumaier_add(&job->results[request], &comp[request], job->part_values[part]);
+    }
+    for (size_t request = 0; request < job->num_results; ++request) {
+        job->results[request] += comp[request];
+    }
+    free(comp);
 }
 
-static void poll_manager_wait_work_info(struct pollfd* pollfds, size_t conn_i, WORK_CONNECTION *work) {
-    struct pollfd* pollfd = &pollfds[1 + conn_i];
+static void job_free(JOB *job) {
+    queue_free(&job->queue);
+    free(job->parts);
+    free(job->part_requests);
+    free(job->part_values);
+    free(job->chunks);
+    free(job->retry);
+}
 
-    pollfd->fd      = work->client_sock_fd;
-    pollfd->events  = POLLIN|POLLHUP;
-    pollfd->revents = 0U;
+// Выдаёт узлу копию куска задания.
+static void manager_send_chunk(INFO_MANAGER *manager, WORK_CONNECTION *work, size_t chunk_id) {
+    JOB *job = manager->job;
+    JOB_CHUNK *chunk = &job->chunks[chunk_id];
+    manager_send_task(work, manager->next_request_id++, &job->parts[chunk->first_part], chunk->num_parts, chunk_id);
+    metric_add(chunk->copies == 0 ? &manager->metrics->chunks : &manager->metrics->chunk_copies, 1);
+    chunk->copies++;
 }
 
+// Выдаёт узлу следующий кусок из очереди размером до num_steps шагов. Короткие
+// отрезки упаковываются в один кусок, пока он не наберёт num_steps шагов или
+// MAX_BATCH_PARTS частей. Возвращает false, если очередь пуста.
+static bool manager_send_next_chunk(INFO_MANAGER *manager, WORK_CONNECTION *work, STEP_QUEUE *queue, uint64_t num_steps) {
+    if (num_steps == 0 || queue->cur_segment == queue->num_segments) {
+        return false;
+    }
+    JOB *job = manager->job;
+    size_t first_part = job->num_parts;
+    uint64_t chunk_steps = 0;
+    while (chunk_steps < num_steps && queue->cur_segment != queue->num_segments &&
+           job->num_parts - first_part < MAX_BATCH_PARTS) {
+        SEGMENT *segment = &queue->segments[queue->cur_segment];
+        uint64_t part_steps = num_steps - chunk_steps;
+        if (job->summation == SUMMATION_COMPENSATED) {
+            // Клетка не делится, даже если кусок из-за неё выйдет больше num_steps.
+            part_steps = PART_GRID_STEPS - queue->next_step % PART_GRID_STEPS;
+        }
+        if (part_steps > segment->num_steps - queue->next_step) {
+            part_steps = segment->num_steps - queue->next_step;
+        }
+
+        struct worker_data data;
+        data.func_id = segment->func_id;
+        data.rule = segment->rule;
+        data.left = segment->left + segment->step * queue->next_step;
+        data.step = segment->step;
+        data.num_steps = part_steps;
+        job_add_part(job, data, segment->request);
+        chunk_steps += part_steps;
 
-static double get_step(FUNC_TABLE func_id, double left, double right, double precision) {
-    double max_derivative_2 = get_max_derivate_2(func_id,left,right);
-    if (max_derivative_2 == 0) {
-        return 1;
+        queue->next_step += part_steps;
+        if (queue->next_step == segment->num_steps) {
+            queue->cur_segment++;
+            queue->next_step = 0;
+        }
     }
-    return cbrt(24 * precision / max_derivative_2);
+    manager_send_chunk(manager, work, job_add_chunk(job, first_part, job->num_parts - first_part));
+
+    queue->num_issued += chunk_steps;
+    if (manager->schedule == SCHEDULE_STATIC) {
+        work->quota -= chunk_steps < work->quota ? chunk_steps : work->quota;
+    }
+    return true;
 }
 
-int get_integral(INFO_MANAGER *manager, FUNC_TABLE func_id, double left, double right, double precision, double *res_value) {
-    if (func_id >= NOT_SUPPORT || func_id < 0) {
-        return -EFUNCID;
+// Доводит очередь узла до PIPELINE_DEPTH кусков, пока есть что выдавать.
+static void manager_fill_pipeline(INFO_MANAGER *manager, WORK_CONNECTION *work) {
+    JOB *job = manager->job;
+    STEP_QUEUE *queue = &job->queue;
+    // Сначала раздаём куски потерянных узлов.
+    while (work->state != WORK_LOST && work->num_in_flight < PIPELINE_DEPTH && job->num_retry != 0) {
+        size_t chunk_id = job->retry[--job->num_retry];
+        if (!job->chunks[chunk_id].done) {
+            manager_send_chunk(manager, work, chunk_id);
+        }
     }
-    if (left > right || res_value == NULL) {
-        return -EVALUE;
+    while (work->state != WORK_LOST && work->num_in_flight < PIPELINE_DEPTH) {
+        uint64_t num_steps = next_chunk_size(manager, queue, work);
+        if (!manager_send_next_chunk(manager, work, queue, num_steps)) {
+            break;
+        }
     }
-    if (right == left) {
-        *res_value = 0;
+}
+
+// Узел прислал информацию о себе и может получать куски.
+static bool manager_worker_ready(const WORK_CONNECTION *work) {
+    return work->state == SEND_TASK || work->state == GET_ANS;
+}
+
+// Ожидаемая производительность узла в шагах в секунду. Пока узел не ответил
+// ни разу, берём среднюю производительность ядра остальных узлов.
+static double manager_expected_rate(INFO_MANAGER *manager, WORK_CONNECTION *work) {
+    if (work->rate != 0) {
+        return work->rate;
+    }
+    double core_rate = 0;
+    size_t num_measured = 0;
+    for (size_t conn_i = 0; conn_i < manager->num_works; ++conn_i) {
+        WORK_CONNECTION *other = manager->works[conn_i];
+        if (other->rate != 0) {
+            core_rate += other->rate / other->n_cores;
+            num_measured++;
+        }
+    }
+    if (num_measured == 0) {
         return 0;
     }
-    double step = get_step(func_id, left, right, precision);
-    uint64_t num_count = (uint64_t)(ceil(fabs(right - left) / step)) + 2;
-    // Избавляемся от неполных шагов
-    step = (right - left) / num_count;
+    return core_rate / num_measured * work->n_cores;
+}
+
+// Ищет опоздавший кусок, копию которого можно отдать узлу idle.
+// Возвращает номер самого опоздавшего куска или NO_CHUNK.
+static size_t manager_find_straggler(INFO_MANAGER *manager, WORK_CONNECTION *idle, const struct timespec *now) {
+    JOB *job = manager->job;
+    size_t straggler = NO_CHUNK;
+    double max_late = 0;
+    for (size_t conn_i = 0; conn_i < manager->num_works; ++conn_i) {
+        WORK_CONNECTION *work = manager->works[conn_i];
+        if (work == idle || work->num_in_flight == 0) {
+            continue;
+        }
+        double rate = manager_expected_rate(manager, work);
+        if (rate == 0) {
+            continue;
+        }
+
+        // Узел считает куски по порядку: каждый начинается не раньше,
+        // чем ожидается готовность предыдущего.
+        double ready = timespec_diff_sec(now, &work->in_flight[0].sent);
+        if (work->rate != 0 && timespec_diff_sec(now, &work->last_ans) > ready) {
+            ready = timespec_diff_sec(now, &work->last_ans);
+        }
+        for (size_t chunk_i = 0; chunk_i < work->num_in_flight; ++chunk_i) {
+            IN_FLIGHT_CHUNK *in_flight = &work->in_flight[chunk_i];
+            double start = timespec_diff_sec(now, &in_flight->sent);
+            if (ready > start) {
+                start = ready;
+            }
+            double expected = in_flight->num_steps / rate;
+            ready = start + expected;
+
+            if (in_flight->chunk == NO_CHUNK) {
+                continue;
+            }
+            JOB_CHUNK *chunk = &job->chunks[in_flight->chunk];
+            if (chunk->done || chunk->copies >= MAX_CHUNK_COPIES) {
+                continue;
+            }
+            // Время отсчитывается от now, поэтому опоздание — это -start сверх допустимого.
+            double late = -start - (STRAGGLER_FACTOR * expected + STRAGGLER_SLACK_SEC);
+            if (late > max_late) {
+                max_late = late;
+                straggler = in_flight->chunk;
+            }
+        }
+    }
+    return straggler;
+}
+
+// Отдаёт простаивающим узлам копии опоздавших кусков.
+static void manager_speculate(INFO_MANAGER *manager) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (size_t conn_i = 0; conn_i < manager->num_works; ++conn_i) {
+        WORK_CONNECTION *work = manager->works[conn_i];
+        if (work->state != SEND_TASK || work->num_in_flight != 0) {
+            continue;
+        }
+        size_t chunk_id = manager_find_straggler(manager, work, &now);
+        if (chunk_id == NO_CHUNK) {
+            return;
+        }
+        manager_send_chunk(manager, work, chunk_id);
+    }
+}
+
+// Прерывает задание: ответы на выданные куски будут отброшены.
+static void manager_abandon_job(INFO_MANAGER *manager) {
+    for (size_t conn_i = 0; conn_i < manager->num_works; ++conn_i) {
+        WORK_CONNECTION *work = manager->works[conn_i];
+        for (size_t chunk_i = 0; chunk_i < work->num_in_flight; ++chunk_i) {
+            work->in_flight[chunk_i].chunk = NO_CHUNK;
+        }
+    }
+}
+
+// Удаляет из пула потерянные узлы. Их незаконченные куски, у которых не осталось
+// копий на других узлах, уходят в очередь на повторную выдачу, а нераспределённая
+// в статическом режиме квота передаётся другому узлу.
+static void manager_reap_lost(INFO_MANAGER *manager) {
+    // Список отправки не должен ссылаться на освобождённые соединения.
+    manager_flush_pending(manager);
+    size_t conn_i = 0;
+    while (conn_i < manager->num_works) {
+        WORK_CONNECTION *work = manager->works[conn_i];
+        if (work->state != WORK_LOST) {
+            conn_i++;
+            continue;
+        }
+
+        JOB *job = manager->job;
+        for (size_t chunk_i = 0; chunk_i < work->num_in_flight; ++chunk_i) {
+            size_t chunk_id = work->in_flight[chunk_i].chunk;
+            if (job == NULL || chunk_id == NO_CHUNK) {
+                continue;
+            }
+            JOB_CHUNK *chunk = &job->chunks[chunk_id];
+            chunk->copies--;
+            if (!chunk->done && chunk->copies == 0) {
+                job_push_retry(job, chunk_id);
+            }
+        }
+        // Узел, не приславший информацию о себе, в нагрузке пула не учтён.
+        if (work->n_cores != 0) {
+            manager->value_load -= work->load;
+            manager->num_ready--;
+            metric_set(&manager->metrics->workers_ready, manager->num_ready);
+        }
+        metric_add(&manager->metrics->workers_lost, 1);
+
+        manager->works[conn_i] = manager->works[--manager->num_works];
+        if (job != NULL && work->quota != 0) {
+            for (size_t other_i = 0; other_i < manager->num_works; ++other_i) {
+                WORK_CONNECTION *other = manager->works[other_i];
+                if (manager_worker_ready(other)) {
+                    other->quota += work->quota;
+                    break;
+                }
+            }
+        }
+        manager_close_worker_socket(work);
+        free(work);
+    }
+
+    // Оставшиеся узлы сразу забирают освободившуюся работу.
+    if (manager->job != NULL) {
+        for (conn_i = 0; conn_i < manager->num_works; ++conn_i) {
+            WORK_CONNECTION *work = manager->works[conn_i];
+            if (manager_worker_ready(work)) {
+                manager_fill_pipeline(manager, work);
+            }
+        }
+    }
+}
+
+// Сообщает узлу об окончании сеанса и закрывает соединение.
+static void manager_finish_worker(WORK_CONNECTION *work) {
+    manager_send_stop(work);
+    manager_flush(work);
+    manager_close_worker_socket(work);
+}
+
+// Ошибка формулы на одном шаге h: error_const * h^(order + 1) * max|f^(order)|.
+typedef struct
+{
+    unsigned order;
+    double error_const;
+} RULE_INFO;
+
+static const RULE_INFO rule_infos[QUAD_RULES] = {
+    [RULE_MIDPOINT] = {.order = 2, .error_const = 1.0 / 24},
+    [RULE_SIMPSON]  = {.order = 4, .error_const = 1.0 / 2880},
+    // Для n-точечной формулы Гаусса: (n!)^4 / ((2n + 1) * ((2n)!)^3).
+    [RULE_GAUSS2]   = {.order = 4, .error_const = 16.0 / (5 * 13824.0)},
+    [RULE_GAUSS3]   = {.order = 6, .error_const = 1296.0 / (7 * 373248000.0)},
+    [RULE_GAUSS4]   = {.order = 8, .error_const = 331776.0 / (9 * 65548320768000.0)},
+};
 
+// Узлы на [-1, 1] и веса формул Гаусса-Лежандра, те же, что на узлах.
+typedef struct
+{
+    int n;
+    double nodes[4];
+    double weights[4];
+} GAUSS_RULE;
+
+static const GAUSS_RULE gauss_rules[QUAD_RULES] = {
+    [RULE_GAUSS2] = {2, {-0.57735026918962576, 0.57735026918962576}, {1.0, 1.0}},
+    [RULE_GAUSS3] = {3, {-0.77459666924148338, 0.0, 0.77459666924148338},
+                        {0.55555555555555556, 0.88888888888888889, 0.55555555555555556}},
+    [RULE_GAUSS4] = {4, {-0.86113631159405258, -0.33998104358485626, 0.33998104358485626, 0.86113631159405258},
+                        {0.34785484513745386, 0.65214515486254614, 0.65214515486254614, 0.34785484513745386}},
+};
 
-    WORK_CONNECTION* works = calloc(manager->num_nodes, sizeof(WORK_CONNECTION));
-    if (works == NULL)
+// Сколько шагов, разбросанных по отрезку, проверяется удвоением и сколько раз
+// шаг выражения может быть уменьшен вдвое.
+#define EXPR_CHECK_STEPS 64U
+#define EXPR_MAX_HALVINGS 24U
+
+// Формула rule на одном шаге [a, a + h] для выражения.
+static double expr_rule_step(const struct expr_program *program, QUAD_RULE rule, double a, double h) {
+    switch (rule)
     {
-        fprintf(stderr, "Unable to allocate connection states\n");
+    case RULE_MIDPOINT:
+        return h * expr_eval(program, a + h / 2);
+    case RULE_SIMPSON:
+        return h / 6 * (expr_eval(program, a) + 4 * expr_eval(program, a + h / 2) + expr_eval(program, a + h));
+    default:
+        const GAUSS_RULE *gauss = &gauss_rules[rule];
+        double result = 0;
+        for (int k = 0; k < gauss->n; ++k) {
+            result += gauss->weights[k] * expr_eval(program, a + h * (1 + gauss->nodes[k]) / 2);
+        }
+        return h / 2 * result;
+    }
+}
+
+// Производная выражения оценена по значениям и может оказаться заниженной, поэтому
+// шаг проверяется по правилу Рунге: на EXPR_CHECK_STEPS шагах отрезка формула на
+// шаге h сравнивается с ней же на двух шагах h / 2. Ошибка шага h примерно равна
+// разности, умноженной на 2^order / (2^order - 1); пока она больше precision, шаг
+// уменьшается вдвое. Особенность уже расстояния между проверяемыми шагами всё равно
+// может остаться незамеченной, так что точность для выражений не гарантируется.
+static double expr_check_step(const struct expr_program *program, QUAD_RULE rule, double left, double right, double precision, double step) {
+    double scale = ldexp(1.0, (int)rule_infos[rule].order);
+    double runge = scale / (scale - 1);
+    for (unsigned halving = 0; halving < EXPR_MAX_HALVINGS; ++halving) {
+        double h = step < right - left ? step : right - left;
+        double max_error = 0;
+        for (unsigned k = 0; k < EXPR_CHECK_STEPS; ++k) {
+            double a = left + (right - left - h) * k / (EXPR_CHECK_STEPS - 1);
+            double whole = expr_rule_step(program, rule, a, h);
+            double halves = expr_rule_step(program, rule, a, h / 2) + expr_rule_step(program, rule, a + h / 2, h / 2);
+            double error = runge * fabs(whole - halves);
+            // Разность на уровне округления о шаге ничего не говорит.
+            if (error > 16 * DBL_EPSILON * fabs(whole)) {
+                max_error = fmax(max_error, error);
+            }
+        }
+        if (!(max_error > precision)) {
+            break;
+        }
+        step /= 2;
+    }
+    return step;
+}
+
+static double get_step(FUNC_TABLE func_id, QUAD_RULE rule, double left, double right, double precision) {
+    const RULE_INFO *info = &rule_infos[rule];
+    double max_derivative = get_max_derivate(func_id, info->order, left, right);
+    // Оценка по значениям выражения может упереться в особую точку внутри отрезка.
+    if (!isfinite(max_derivative)) {
+        return (right - left) / MAX_SEGMENT_STEPS;
+    }
+    double step = max_derivative == 0 ? 1 : pow(precision / (info->error_const * max_derivative), 1.0 / (info->order + 1));
+    int expr_i = integrand_expr_index(func_id);
+    if (expr_i != -1 && right > left) {
+        step = expr_check_step(&integrand_exprs[expr_i], rule, left, right, precision, step);
+    }
+    return step;
+}
+
+// Глубина дробления и выигрыш, при котором половинки выгоднее целого отрезка.
+#define ADAPTIVE_MAX_DEPTH 12U
+#define ADAPTIVE_SPLIT_GAIN 0.9
+
+static uint64_t get_num_steps(FUNC_TABLE func_id, QUAD_RULE rule, double left, double right, double precision) {
+    uint64_t num_steps = (uint64_t)ceil((right - left) / get_step(func_id, rule, left, right, precision));
+    return num_steps == 0 ? 1 : num_steps;
+}
+
+// Делит [left, right] пополам, пока шаг по локальной оценке второй производной
+// на половинках заметно уменьшает общее число шагов. Оценка ошибки на каждом шаге
+// остаётся той же, что и при едином шаге, но пологие участки считаются реже.
+static void partition_adaptive(STEP_QUEUE *queue, size_t request, FUNC_TABLE func_id, QUAD_RULE rule, double left, double right, double precision, unsigned depth) {
+    uint64_t num_whole = get_num_steps(func_id, rule, left, right, precision);
+    if (depth < ADAPTIVE_MAX_DEPTH && num_whole > MIN_CHUNK_STEPS) {
+        double mid = left + (right - left) / 2;
+        uint64_t num_split = get_num_steps(func_id, rule, left, mid, precision) + get_num_steps(func_id, rule, mid, right, precision);
+        if (num_split < num_whole * ADAPTIVE_SPLIT_GAIN) {
+            partition_adaptive(queue, request, func_id, rule, left, mid, precision, depth + 1);
+            partition_adaptive(queue, request, func_id, rule, mid, right, precision, depth + 1);
+            return;
+        }
+    }
+    queue_push_segment(queue, request, func_id, rule, left, right, num_whole);
+}
+
+//==================
+// Трасса
+//==================
+// Файл трассы — JSON в формате Chrome trace: процесс 0 — менеджер, процесс N + 1 —
+// узел с номером N в метриках. У узла поток 0 — куски на часах менеджера (от
+// отправки до ответа), поток 1 — главный поток узла, потоки 2 и далее — его пул.
+
+static size_t manager_worker_id(const WORK_CONNECTION *work) {
+    return work->stats != NULL ? (size_t)(work->stats - work->metrics->workers) : MAX_WORKER_METRICS;
+}
+
+// Время от начала задания в микросекундах — единицах Chrome trace.
+static double trace_us(const JOB *job, const struct timespec *time) {
+    return timespec_diff_sec(&job->trace_start, time) * 1e6;
+}
+
+// Записывает событие длительностью dur_us; args — поля объекта args без скобок.
+static void trace_event(JOB *job, const char *name, size_t pid, uint32_t tid, double ts_us, double dur_us, const char *args, ...) {
+    fprintf(job->trace, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%zu,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{",
+            job->trace_events++ == 0 ? "" : ",", name, pid, tid, ts_us, dur_us > 0 ? dur_us : 0);
+    va_list ap;
+    va_start(ap, args);
+    vfprintf(job->trace, args, ap);
+    va_end(ap);
+    fputs("}}", job->trace);
+}
+
+static void trace_name(JOB *job, const char *kind, size_t pid, uint32_t tid, const char *name, ...) {
+    fprintf(job->trace, "%s\n{\"name\":\"%s\",\"ph\":\"M\",\"pid\":%zu,\"tid\":%u,\"args\":{\"name\":\"",
+            job->trace_events++ == 0 ? "" : ",", kind, pid, tid);
+    va_list ap;
+    va_start(ap, name);
+    vfprintf(job->trace, name, ap);
+    va_end(ap);
+    fputs("\"}}", job->trace);
+}
+
+static void job_trace_open(INFO_MANAGER *manager, JOB *job, const struct timespec *start_time) {
+    char *path;
+    if (asprintf(&path, "%s-%lu.json", manager->trace_prefix, ++manager->num_traces) == -1) {
+        fprintf(stderr, "Unable to allocate trace path\n");
         exit(EXIT_FAILURE);
     }
+    job->trace = fopen(path, "w");
+    if (job->trace == NULL) {
+        // Без трассы задание всё равно считается.
+        fprintf(stderr, "Unable to open trace file %s: %s\n", path, strerror(errno));
+        free(path);
+        return;
+    }
+    free(path);
+    job->trace_events = 0;
+    job->trace_start = *start_time;
+    fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", job->trace);
+    for (size_t conn_i = 0; conn_i < manager->num_works; ++conn_i) {
+        manager->works[conn_i]->trace_threads = 0;
+    }
+}
+
+// Записывает кусок, на который ответил узел, и присланную перед ответом трассу.
+static void job_trace_chunk(INFO_MANAGER *manager, WORK_CONNECTION *work, const IN_FLIGHT_CHUNK *answered, int status) {
+    JOB *job = manager->job;
+    size_t pid = manager_worker_id(work) + 1;
+    double sent_us = trace_us(job, &answered->sent);
+    double rtt_us = trace_us(job, &work->last_ans) - sent_us;
+    trace_event(job, "chunk", pid, 0, sent_us, rtt_us, "\"chunk\":%zu,\"request\":%lu,\"steps\":%lu,\"evals\":%lu,\"status\":%d",
+                answered->chunk, answered->request_id, answered->num_steps, answered->num_evals, status);
+    if (!work->has_trace || work->trace_request_id != answered->request_id) {
+        return;
+    }
+
+    // Часы узла не сверены с часами менеджера: считаем, что задание и ответ
+    // шли по сети одинаковое время.
+    const struct worker_trace *trace = &work->trace;
+    double origin_us = sent_us + (rtt_us - trace->send_sec * 1e6) / 2;
+    if (origin_us < sent_us) {
+        origin_us = sent_us;
+    }
+    trace_event(job, "receive", pid, 1, origin_us, trace->recv_sec * 1e6, "");
+    trace_event(job, "compute", pid, 1, origin_us + trace->recv_sec * 1e6, (trace->join_sec - trace->recv_sec) * 1e6,
+                "\"chunk\":%zu", answered->chunk);
+    trace_event(job, "send", pid, 1, origin_us + trace->join_sec * 1e6, (trace->send_sec - trace->join_sec) * 1e6, "");
+    for (uint32_t thread_i = 0; thread_i < trace->num_threads; ++thread_i) {
+        const struct trace_thread *thread = &trace->threads[thread_i];
+        if (thread->parts == 0) {
+            continue;
+        }
+        uint64_t evals = answered->num_steps == 0 ? 0 : (uint64_t)((double)thread->steps * answered->num_evals / answered->num_steps);
+        trace_event(job, "compute", pid, thread_i + 2, origin_us + thread->start_sec * 1e6, (thread->end_sec - thread->start_sec) * 1e6,
+                    "\"chunk\":%zu,\"cpu\":%d,\"steps\":%lu,\"evals\":%lu,\"parts\":%u",
+                    answered->chunk, thread->cpu, thread->steps, evals, thread->parts);
+    }
+    if (trace->num_threads > work->trace_threads) {
+        work->trace_threads = trace->num_threads;
+    }
+}
+
+static void job_trace_close(INFO_MANAGER *manager, JOB *job, int rc, const struct timespec *end_time) {
+    trace_event(job, "job", 0, 0, 0, trace_us(job, end_time), "\"status\":%d,\"steps\":%lu,\"chunks\":%zu",
+                rc, job->queue.num_count, job->num_chunks);
+    trace_name(job, "process_name", 0, 0, "manager");
+    for (size_t conn_i = 0; conn_i < manager->num_works; ++conn_i) {
+        WORK_CONNECTION *work = manager->works[conn_i];
+        size_t pid = manager_worker_id(work) + 1;
+        trace_name(job, "process_name", pid, 0, "worker %zu (%d cores)", pid - 1, work->n_cores);
+        trace_name(job, "thread_name", pid, 0, "chunks");
+        trace_name(job, "thread_name", pid, 1, "main");
+        for (uint32_t thread_i = 0; thread_i < work->trace_threads; ++thread_i) {
+            trace_name(job, "thread_name", pid, thread_i + 2, "thread %u", thread_i);
+        }
+    }
+    fputs("\n]}\n", job->trace);
+    if (fclose(job->trace) != 0) {
+        fprintf(stderr, "Unable to write trace file\n");
+    }
+    job->trace = NULL;
+}
+
+//==================
+// Цикл событий
+//==================
 
-    for (size_t conn_i = 0U; conn_i < manager->num_nodes; conn_i++)
+#define MAX_EVENTS 64U
+
+static void manager_handle_frame(INFO_MANAGER *manager, WORK_CONNECTION *work, const struct frame_header *hdr, const char *payload) {
+    switch (hdr->type)
     {
-        works[conn_i].state  = CONNECTION_EMPTY;
+    case FRAME_NODE_INFO:
+        if (work->state != GET_INFO || !manager_get_worker_info(work, hdr, payload)) {
+            manager_lose_worker(work);
+            break;
+        }
+        manager->value_load += work->load;
+        manager->num_ready++;
+        metric_set(&manager->metrics->workers_ready, manager->num_ready);
+        // Узел, подключившийся посреди вычисления, сразу получает работу.
+        if (manager->job != NULL) {
+            manager_fill_pipeline(manager, work);
+        }
+        break;
+    case FRAME_TRACE:
+        if (work->state != GET_ANS || !manager_get_worker_trace(work, hdr, payload)) {
+            manager_lose_worker(work);
+        }
+        break;
+    case FRAME_RESULT:
+    case FRAME_RESULT_BATCH:
+        IN_FLIGHT_CHUNK answered;
+        double values[MAX_BATCH_PARTS];
+        uint32_t num_values;
+        int status;
+        if (work->state != GET_ANS || !manager_get_worker_ans(work, hdr, payload, values, &num_values, &answered, &status)) {
+            manager_lose_worker(work);
+            break;
+        }
+        size_t chunk_id = answered.chunk;
+        // Ответы на куски прерванного задания в трассу не попадают.
+        if (manager->job != NULL && manager->job->trace != NULL && chunk_id != NO_CHUNK) {
+            job_trace_chunk(manager, work, &answered, status);
+        }
+        work->has_trace = false;
+        if (manager->job == NULL) {
+            break;
+        }
+        if (status != 0 && chunk_id != NO_CHUNK) {
+            job_fail_chunk(manager->job, chunk_id, status == WORKER_ERULE ? -ERULE : -EFUNCID);
+        } else if (!job_complete_chunk(manager->job, chunk_id, values, num_values)) {
+            fprintf(stderr, "Unexpected number of values from worker\n");
+            manager_lose_worker(work);
+            break;
+        }
+        // Прерываемому заданию новые куски не нужны.
+        if (manager->job->status == 0) {
+            manager_fill_pipeline(manager, work);
+        }
+        break;
+    case FRAME_CALIBRATION:
+        if (!manager_get_worker_calibration(work, hdr, payload)) {
+            manager_lose_worker(work);
+        }
+        break;
+    default:
+        fprintf(stderr, "Unexpected frame type %u from worker\n", hdr->type);
+        manager_lose_worker(work);
+    }
+}
+
+static void manager_handle_connection_event(INFO_MANAGER *manager, WORK_CONNECTION *work, uint32_t events) {
+    if (work->state == WORK_LOST) {
+        return;
+    }
+    if (events & EPOLLOUT) {
+        if (!manager_flush(work)) {
+            manager_lose_worker(work);
+            return;
+        }
+    }
+
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        bool alive = manager_read(work, (events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) != 0);
+
+        // Обрабатываем все полностью пришедшие кадры, даже если узел уже отключился.
+        struct frame_header hdr;
+        const char *payload;
+        while (work->state != WORK_LOST && manager_next_frame(work, &hdr, &payload)) {
+            manager_handle_frame(manager, work, &hdr, payload);
+        }
+
+        if (!alive) {
+            manager_lose_worker(work);
+        }
     }
+}
 
-    // Аллоцируем массив файловых дескрипторов для мониторинга.
-    struct pollfd* pollfds = calloc(manager->num_nodes + 1U, sizeof(struct pollfd));
-    if (pollfds == NULL)
+// Ждёт события не дольше timeout_ms и обрабатывает их. Стоимость обработки
+// зависит только от числа пришедших событий, а не от числа соединений.
+static void manager_poll_events(INFO_MANAGER *manager, int timeout_ms) {
+    // Кадры, выданные между проходами (первая раздача задания, копии опоздавших
+    // кусков), уходят до ожидания.
+    manager_flush_pending(manager);
+    struct epoll_event events[MAX_EVENTS];
+    int num_events = epoll_wait(manager->epoll_fd, events, MAX_EVENTS, timeout_ms);
+    if (num_events == -1)
     {
-        fprintf(stderr, "Unable to allocate poll file descriptor array\n");
+        if (errno == EINTR) {
+            return;
+        }
+        fprintf(stderr, "Unable to epoll-wait for data on descriptors!\n");
         exit(EXIT_FAILURE);
     }
 
-    size_t num_connected_workers = 0U;
-    size_t num_init_workers = 0U;
-    uint64_t value_load = 0;
+    for (int event_i = 0; event_i < num_events; ++event_i)
+    {
+        WORK_CONNECTION *work = events[event_i].data.ptr;
+        if (work == NULL) {
+            while (server_accept_connection_request(manager) != NULL) {
+            }
+        } else {
+            manager_handle_connection_event(manager, work, events[event_i].events);
+        }
+    }
+    manager_reap_lost(manager);
+}
 
-    manager_init_socket(manager);
+int manager_pool_start(INFO_MANAGER *manager) {
+    if (manager->pool_started) {
+        return -EPOOL;
+    }
 
+    manager_init_socket(manager);
 
     // Ожидаем подключения всех Рабочих узлов и собираем информацию о них.
-    while (num_init_workers != manager->num_nodes)
+    printf("Wait for worker_node to connect\n");
+    while (manager->num_ready < manager->num_nodes)
     {
-        if (num_connected_workers != manager->num_nodes) {
-            poll_server_wait_for_worker(pollfds, manager);
-        } else {
-            poll_server_do_not_wait_for_workers(pollfds);
+        manager_poll_events(manager, 100000);
+    }
+    // Слушающий сокет остаётся открытым: новые узлы подключаются к пулу на ходу
+    // и заменяют отключившиеся.
+    if (manager->value_load == 0) {
+        fprintf(stderr, "Error workers haven't resourses\n");
+        exit(EXIT_FAILURE);
+    }
+
+    manager->pool_started = true;
+    return 0;
+}
+
+// Запрашивает замер производительности у узлов, для которых он устарел, и ждёт
+// ответов не дольше deadline. Узлы считают задания по порядку, поэтому замер
+// начнётся после кусков, которые ещё остались от прерванных заданий.
+static void manager_calibrate(INFO_MANAGER *manager, FUNC_TABLE func_id, QUAD_RULE rule, double left, double right, const struct timespec *deadline) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    size_t num_waiting = 0;
+    int slot = integrand_slot(func_id);
+    for (size_t conn_i = 0; conn_i < manager->num_works; ++conn_i) {
+        WORK_CONNECTION *work = manager->works[conn_i];
+        if (!manager_worker_ready(work) || work->calibrating) {
+            continue;
+        }
+        if (work->calibrated[slot][rule] != 0 &&
+            timespec_diff_sec(&work->calibrated_at[slot][rule], &now) < CALIBRATION_TTL_SEC) {
+            continue;
         }
+        manager_send_calibrate(work, func_id, rule, left, right);
+        num_waiting++;
+    }
 
-        int pollret = poll(pollfds, 1U + num_connected_workers, 100000);
-        if (pollret == -1)
-        {
-            fprintf(stderr, "Unable to poll-wait for data on descriptors!\n");
-            exit(EXIT_FAILURE);
+    while (num_waiting != 0) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double wait_time = timespec_diff_sec(&now, deadline);
+        if (wait_time < 0) {
+            return;
         }
+        manager_poll_events(manager, (int)(wait_time * 1000) + 1);
 
-        if (pollfds[0U].revents & POLLIN)
-        {
-            server_accept_connection_request(manager, &works[num_connected_workers]);
+        num_waiting = 0;
+        for (size_t conn_i = 0; conn_i < manager->num_works; ++conn_i) {
+            if (manager->works[conn_i]->calibrating) {
+                num_waiting++;
+            }
+        }
+    }
+}
 
-            works[num_connected_workers].state = GET_INFO;
-            poll_manager_wait_work_info(pollfds, num_connected_workers, &works[num_connected_workers]);
+// Раздаёт узлам очередь задания и собирает ответы в job->results. Освобождает задание.
+static int manager_run_job(INFO_MANAGER *manager, JOB *job, const struct timespec *start_time) {
+    int slot = integrand_slot(job->func_id);
+    QUAD_RULE rule = job->rule;
+    uint64_t num_count = job->queue.num_count;
+    manager->job = job;
+    if (manager->trace_prefix != NULL && job->trace == NULL) {
+        job_trace_open(manager, job, start_time);
+    }
 
-            num_connected_workers += 1U;
-        } 
+    // Делим работу пропорционально замеренной производительности узлов, а если
+    // замера нет хотя бы у одного из них — пропорционально заявленной нагрузке.
+    double total_calibrated = 0;
+    bool all_calibrated = true;
+    for (size_t conn_i = 0; conn_i < manager->num_works; ++conn_i) {
+        WORK_CONNECTION *work = manager->works[conn_i];
+        if (!manager_worker_ready(work)) {
+            continue;
+        }
+        double calibrated = work->calibrated[slot][rule];
+        if (calibrated == 0) {
+            all_calibrated = false;
+        } else {
+            // Замер на этой функции точнее скорости, измеренной на прошлых заданиях.
+            work->rate = calibrated;
+        }
+        total_calibrated += calibrated;
+    }
 
-        for (size_t conn_i = 0U; conn_i < num_connected_workers; ++conn_i)
-        {
-            if (pollfds[1U + conn_i].revents & POLLHUP)
-            {  
-                fprintf(stderr, "Unexpected POLLHUP\n");
-                exit(EXIT_FAILURE);
-            }
-
-            if (pollfds[1U + conn_i].revents & POLLIN)
-            {
-                switch (works[conn_i].state)
-                {
-                case CONNECTION_EMPTY:
-                case WORK_FINISHED:
-                case GET_ANS:
-                    fprintf(stderr, "Unexpected state!\n");
-                    exit(EXIT_FAILURE);
-                case GET_INFO:
-                    manager_get_worker_info(&works[conn_i]);
-                    works[conn_i].state = SEND_TASK;
-                    value_load += works[conn_i].load;
-                    num_init_workers++;
-                    break;
-                case SEND_TASK:
-                }
+    size_t num_assigned = 0;
+    for (size_t conn_i = 0; conn_i < manager->num_works; ++conn_i) {
+        WORK_CONNECTION *work = manager->works[conn_i];
+        work->quota = 0;
+        if (!manager_worker_ready(work)) {
+            continue;
+        }
+        if (manager->schedule == SCHEDULE_STATIC) {
+            // Последний узел забирает остаток.
+            if (++num_assigned == manager->num_ready) {
+                work->quota = num_count - job->assigned;
+            } else if (all_calibrated) {
+                work->quota = num_count * (work->calibrated[slot][rule] / total_calibrated);
+            } else {
+                work->quota = num_count * ((double)work->load / manager->value_load);
             }
+            job->assigned += work->quota;
         }
+        manager_fill_pipeline(manager, work);
     }
-    manager_close_listen_socket(manager);
-    if (value_load == 0) {
-        fprintf(stderr, "Error workers haven't resourses\n");
-        exit(EXIT_FAILURE);
-    }
-    time_t start_time = time(NULL);
-    uint64_t num_count_was = 0;
-    struct worker_data data;
-    data.func_id = func_id;
-    for (size_t conn_i = 0; conn_i < manager->num_nodes - 1; ++conn_i) {
-        double part_load = (double)works[conn_i].load / value_load;
-        uint64_t num_steps_i = num_count * (part_load);
-        data.num_steps = num_steps_i;
-        data.left = left + step * num_count_was;
-        num_count_was += num_steps_i;
-        data.step = step;
-        manager_send_task(&works[conn_i], data);
-        poll_manager_wait_for_answer(pollfds,conn_i,&works[conn_i]);
-    }
-    // last worker proccess separate
-    data.num_steps = num_count - num_count_was;
-    data.left = left + step * num_count_was;
-    data.step = step;
-    double ans = 0;
-    manager_send_task(&works[manager->num_nodes - 1],data);
-    poll_manager_wait_for_answer(pollfds,manager->num_nodes - 1,&works[manager->num_nodes - 1]);
-    while (num_connected_workers != 0) {
-        time_t wait_time = manager->max_time - (time(NULL) - start_time);
+    MANAGER_METRICS *metrics = manager->metrics;
+    struct timespec dispatched;
+    clock_gettime(CLOCK_MONOTONIC, &dispatched);
+    metric_observe(&metrics->dispatch, timespec_diff_sec(start_time, &dispatched));
+
+    // Собираем ответы; освободившиеся узлы получают новые куски прямо в обработчике,
+    // а когда выдавать больше нечего — копии опоздавших кусков.
+    // Очереди узлов могут быть заняты кусками прерванного задания, поэтому
+    // ждём, пока не будет выдана и посчитана вся очередь.
+    int rc = 0;
+    while (job->num_pending != 0 || job->queue.num_issued != job->queue.num_count) {
+        metric_set(&metrics->steps_queued, job->queue.num_count - job->queue.num_issued);
+        metric_set(&metrics->chunks_in_flight, job->num_pending);
+        metric_set(&metrics->chunks_retry, job->num_retry);
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double wait_time = manager->max_time - timespec_diff_sec(start_time, &now);
         if(wait_time < 0) {
             fprintf(stderr, "Time ended!\n");
-            exit(EXIT_FAILURE);
+            manager_abandon_job(manager);
+            rc = -ETIMEOUT;
+            break;
         }
-        int pollret = poll(pollfds, 1U + num_connected_workers, wait_time);
-        if (pollret == -1)
-        {
-            fprintf(stderr, "Unable to poll-wait for data on descriptors!\n");
-            exit(EXIT_FAILURE);
+        if (manager->num_ready == 0) {
+            fprintf(stderr, "No workers left\n");
+            rc = -ENOWORKERS;
+            break;
         }
-        for (size_t conn_i = 0U; conn_i < num_connected_workers; ++conn_i)
-        {
-            if (pollfds[1U + conn_i].revents & POLLHUP)
-            {  
-                fprintf(stderr, "Unexpected POLLHUP\n");
-                exit(EXIT_FAILURE);
-            }
-
-            if (pollfds[1U + conn_i].revents & POLLIN)
-            {
-                switch (works[conn_i].state)
-                {
-                case CONNECTION_EMPTY:
-                case GET_INFO:
-                case SEND_TASK:
-                    fprintf(stderr, "Unexpected state!\n");
-                    exit(EXIT_FAILURE);
-                case GET_ANS:
-                    ans += manager_get_worker_ans(&works[conn_i]);
-                    works[conn_i].state = WORK_FINISHED;
-                    num_connected_workers--;
-                    poll_server_do_not_wait_for_ans(pollfds, conn_i);
-                    manager_close_worker_socket(&works[conn_i]);
-                    break;
-                case WORK_FINISHED:
-                }
-            }
+        if (job->status != 0) {
+            manager_abandon_job(manager);
+            rc = job->status;
+            break;
+        }
+        int timeout_ms = (int)(wait_time * 1000) + 1;
+        if (timeout_ms > STRAGGLER_CHECK_MS) {
+            timeout_ms = STRAGGLER_CHECK_MS;
         }
+        manager_poll_events(manager, timeout_ms);
+        manager_speculate(manager);
+    }
+    manager->job = NULL;
+    metric_set(&metrics->steps_queued, 0);
+    metric_set(&metrics->chunks_in_flight, 0);
+    metric_set(&metrics->chunks_retry, 0);
+    struct timespec end_time;
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    double job_sec = timespec_diff_sec(start_time, &end_time);
+    metric_observe(&metrics->job_time, job_sec);
+    metric_add(&metrics->job_ns, metric_sec_to_ns(job_sec));
+    metric_add(&metrics->jobs, 1);
+    if (rc != 0) {
+        metric_add(&metrics->jobs_failed, 1);
+    }
+    if (job->trace != NULL) {
+        job_trace_close(manager, job, rc, &end_time);
+    }
+    if (rc == 0 && job->summation == SUMMATION_COMPENSATED) {
+        job_reduce_compensated(job);
+    }
+    job_free(job);
+    return rc;
+}
+
+static int check_integral_request(const INTEGRAL_REQUEST *request) {
+    if (integrand_slot(request->func_id) == -1) {
+        return -EFUNCID;
+    }
+    if (request->rule >= QUAD_RULES || request->rule < 0) {
+        return -ERULE;
+    }
+    if (!isfinite(request->left) || !isfinite(request->right) || request->left > request->right) {
+        return -EVALUE;
+    }
+    // По precision выбирается шаг: при нулевой точности шагов было бы бесконечно много.
+    if (!(request->precision > 0) || !isfinite(request->precision)) {
+        return -EVALUE;
+    }
+    // Выражение должно быть определено на всём отрезке, иначе шаг не выбрать.
+    int expr_i = integrand_expr_index(request->func_id);
+    if (expr_i != -1 && !expr_finite_on(&integrand_exprs[expr_i], request->left, request->right)) {
+        return -EVALUE;
     }
-    *res_value = ans;
     return 0;
 }
+
+// Раскладывает интеграл номер index по отрезкам очереди задания.
+static void job_push_integral(INFO_MANAGER *manager, JOB *job, size_t index, const INTEGRAL_REQUEST *request) {
+    FUNC_TABLE func_id = request->func_id;
+    QUAD_RULE rule = request->rule;
+    double left = request->left;
+    double right = request->right;
+    if (right == left) {
+        return;
+    }
+    if (manager->adaptive) {
+        partition_adaptive(&job->queue, index, func_id, rule, left, right, request->precision, 0);
+    } else {
+        double step = get_step(func_id, rule, left, right, request->precision);
+        uint64_t num_count = (uint64_t)(ceil(fabs(right - left) / step)) + 2;
+        // Избавляемся от неполных шагов
+        queue_push_segment(&job->queue, index, func_id, rule, left, right, num_count);
+    }
+}
+
+//==================
+// Кэш результатов
+//==================
+
+// На сколько выровненных блоков примерно делится интеграл: запросы, длины
+// которых отличаются не больше чем вдвое, делятся на блоки одного размера.
+#define CACHE_BLOCKS_PER_INTEGRAL 8.0
+// Дальше индексы блоков не представимы точно.
+#define CACHE_MAX_BLOCK_INDEX 0x1p52
+
+typedef enum
+{
+    CACHE_INTEGRAL,
+    CACHE_BLOCK,
+} CACHE_KIND;
+
+typedef struct
+{
+    CACHE_KIND kind;
+    FUNC_TABLE func_id;
+    QUAD_RULE rule;
+    // Разбиение отрезка и способ сложения влияют на ответ.
+    bool adaptive;
+    SUMMATION_MODE summation;
+    double left;
+    double right;
+} CACHE_KEY;
+
+typedef struct cache_entry
+{
+    CACHE_KEY key;
+    // Точность, с которой посчитан ответ.
+    double precision;
+    double value;
+    struct cache_entry *hash_next;
+    // Список по давности использования, в голове — самые свежие.
+    struct cache_entry *lru_prev;
+    struct cache_entry *lru_next;
+} CACHE_ENTRY;
+
+typedef struct result_cache
+{
+    // Статистику можно читать из другого потока, пока идёт вычисление.
+    pthread_mutex_t lock;
+    CACHE_ENTRY **buckets;
+    size_t num_buckets;
+    CACHE_ENTRY *lru_head;
+    CACHE_ENTRY *lru_tail;
+    size_t num_entries;
+    size_t max_entries;
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} RESULT_CACHE;
+
+static uint64_t cache_mix(uint64_t hash, uint64_t value) {
+    hash ^= value + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2);
+    return hash;
+}
+
+static uint64_t cache_hash(const CACHE_KEY *key) {
+    uint64_t left_bits, right_bits;
+    memcpy(&left_bits, &key->left, sizeof(left_bits));
+    memcpy(&right_bits, &key->right, sizeof(right_bits));
+    uint64_t hash = cache_mix(0, key->kind);
+    hash = cache_mix(hash, key->func_id);
+    hash = cache_mix(hash, key->rule);
+    hash = cache_mix(hash, key->adaptive);
+    hash = cache_mix(hash, key->summation);
+    hash = cache_mix(hash, left_bits);
+    return cache_mix(hash, right_bits);
+}
+
+static bool cache_key_equal(const CACHE_KEY *a, const CACHE_KEY *b) {
+    return a->kind == b->kind && a->func_id == b->func_id && a->rule == b->rule && a->adaptive == b->adaptive &&
+           a->summation == b->summation && a->left == b->left && a->right == b->right;
+}
+
+static CACHE_ENTRY **cache_find_slot(RESULT_CACHE *cache, const CACHE_KEY *key) {
+    CACHE_ENTRY **slot = &cache->buckets[cache_hash(key) & (cache->num_buckets - 1)];
+    while (*slot != NULL && !cache_key_equal(&(*slot)->key, key)) {
+        slot = &(*slot)->hash_next;
+    }
+    return slot;
+}
+
+static void cache_lru_unlink(RESULT_CACHE *cache, CACHE_ENTRY *entry) {
+    if (entry->lru_prev != NULL) {
+        entry->lru_prev->lru_next = entry->lru_next;
+    } else {
+        cache->lru_head = entry->lru_next;
+    }
+    if (entry->lru_next != NULL) {
+        entry->lru_next->lru_prev = entry->lru_prev;
+    } else {
+        cache->lru_tail = entry->lru_prev;
+    }
+}
+
+static void cache_lru_push_front(RESULT_CACHE *cache, CACHE_ENTRY *entry) {
+    entry->lru_prev = NULL;
+    entry->lru_next = cache->lru_head;
+    if (cache->lru_head != NULL) {
+        cache->lru_head->lru_prev = entry;
+    } else {
+        cache->lru_tail = entry;
+    }
+    cache->lru_head = entry;
+}
+
+static void cache_evict_lru(RESULT_CACHE *cache) {
+    CACHE_ENTRY *entry = cache->lru_tail;
+    *cache_find_slot(cache, &entry->key) = entry->hash_next;
+    cache_lru_unlink(cache, entry);
+    free(entry);
+    cache->num_entries--;
+    cache->evictions++;
+}
+
+static RESULT_CACHE *cache_create(size_t max_entries) {
+    RESULT_CACHE *cache = calloc(1, sizeof(RESULT_CACHE));
+    if (cache == NULL) {
+        fprintf(stderr, "Unable to allocate result cache\n");
+        exit(EXIT_FAILURE);
+    }
+    // Не больше одной записи на корзину в среднем.
+    cache->num_buckets = 16U;
+    while (cache->num_buckets < max_entries) {
+        cache->num_buckets *= 2;
+    }
+    cache->buckets = calloc(cache->num_buckets, sizeof(CACHE_ENTRY *));
+    if (cache->buckets == NULL) {
+        fprintf(stderr, "Unable to allocate result cache\n");
+        exit(EXIT_FAILURE);
+    }
+    cache->max_entries = max_entries;
+    pthread_mutex_init(&cache->lock, NULL);
+    return cache;
+}
+
+static void cache_free(RESULT_CACHE *cache) {
+    CACHE_ENTRY *entry = cache->lru_head;
+    while (entry != NULL) {
+        CACHE_ENTRY *next = entry->lru_next;
+        free(entry);
+        entry = next;
+    }
+    pthread_mutex_destroy(&cache->lock);
+    free(cache->buckets);
+    free(cache);
+}
+
+// Ищет ответ, посчитанный с точностью не хуже precision. Предварительная
+// проверка (count == false) не трогает ни статистику, ни порядок вытеснения.
+static bool cache_lookup_ex(RESULT_CACHE *cache, const CACHE_KEY *key, double precision, double *value, bool count) {
+    pthread_mutex_lock(&cache->lock);
+    CACHE_ENTRY *entry = *cache_find_slot(cache, key);
+    bool hit = entry != NULL && entry->precision <= precision;
+    if (hit) {
+        *value = entry->value;
+    }
+    if (count && hit) {
+        cache_lru_unlink(cache, entry);
+        cache_lru_push_front(cache, entry);
+        cache->hits++;
+    } else if (count) {
+        cache->misses++;
+    }
+    pthread_mutex_unlock(&cache->lock);
+    return hit;
+}
+
+static bool cache_lookup(RESULT_CACHE *cache, const CACHE_KEY *key, double precision, double *value) {
+    return cache_lookup_ex(cache, key, precision, value, true);
+}
+
+static void cache_insert(RESULT_CACHE *cache, const CACHE_KEY *key, double precision, double value) {
+    pthread_mutex_lock(&cache->lock);
+    CACHE_ENTRY **slot = cache_find_slot(cache, key);
+    CACHE_ENTRY *entry = *slot;
+    if (entry != NULL) {
+        // Более грубый ответ не заменяет более точный.
+        if (precision <= entry->precision) {
+            entry->precision = precision;
+            entry->value = value;
+        }
+        cache_lru_unlink(cache, entry);
+        cache_lru_push_front(cache, entry);
+        pthread_mutex_unlock(&cache->lock);
+        return;
+    }
+
+    entry = malloc(sizeof(CACHE_ENTRY));
+    if (entry == NULL) {
+        fprintf(stderr, "Unable to allocate cache entry\n");
+        exit(EXIT_FAILURE);
+    }
+    entry->key = *key;
+    entry->precision = precision;
+    entry->value = value;
+    entry->hash_next = NULL;
+    *slot = entry;
+    cache_lru_push_front(cache, entry);
+    cache->num_entries++;
+    if (cache->num_entries > cache->max_entries) {
+        cache_evict_lru(cache);
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
+
+void info_manager_set_cache(INFO_MANAGER *manager, size_t max_entries) {
+    RESULT_CACHE *old = manager->cache;
+    manager->cache = max_entries == 0 ? NULL : cache_create(max_entries);
+    if (old == NULL) {
+        return;
+    }
+    // Переносим записи от старых к свежим, чтобы сохранить порядок вытеснения.
+    if (manager->cache != NULL) {
+        manager->cache->hits = old->hits;
+        manager->cache->misses = old->misses;
+        manager->cache->evictions = old->evictions;
+        for (CACHE_ENTRY *entry = old->lru_tail; entry != NULL; entry = entry->lru_prev) {
+            cache_insert(manager->cache, &entry->key, entry->precision, entry->value);
+        }
+    }
+    cache_free(old);
+}
+
+void manager_get_cache_stats(INFO_MANAGER *manager, CACHE_STATS *stats) {
+    memset(stats, 0, sizeof(*stats));
+    RESULT_CACHE *cache = manager->cache;
+    if (cache == NULL) {
+        return;
+    }
+    pthread_mutex_lock(&cache->lock);
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->evictions = cache->evictions;
+    stats->entries = cache->num_entries;
+    stats->max_entries = cache->max_entries;
+    pthread_mutex_unlock(&cache->lock);
+}
+
+static CACHE_KEY cache_key(INFO_MANAGER *manager, CACHE_KIND kind, const INTEGRAL_REQUEST *request, double left, double right) {
+    CACHE_KEY key = {
+        .kind = kind,
+        .func_id = request->func_id,
+        .rule = request->rule,
+        .adaptive = manager->adaptive,
+        .summation = manager->summation,
+        .left = left,
+        .right = right,
+    };
+    return key;
+}
+
+// Часть интеграла при счёте через кэш: голова, выровненный блок или хвост.
+typedef struct
+{
+    size_t request;
+    CACHE_KIND kind;
+    double left;
+    double right;
+    // Ответ из кэша или номер подзапроса, который его посчитает.
+    bool cached;
+    double value;
+    size_t subrequest;
+} CACHE_PIECE;
+
+typedef struct
+{
+    CACHE_PIECE *pieces;
+    size_t num_pieces;
+    size_t capacity;
+    // Непокрытые кэшем части, которые уходят узлам.
+    INTEGRAL_REQUEST *subrequests;
+    size_t num_subrequests;
+} CACHE_PLAN;
+
+static void cache_plan_add(INFO_MANAGER *manager, CACHE_PLAN *plan, size_t request_i, const INTEGRAL_REQUEST *request,
+                           CACHE_KIND kind, double left, double right) {
+    if (left == right) {
+        return;
+    }
+    if (plan->num_pieces == plan->capacity) {
+        plan->capacity = plan->capacity == 0 ? 64U : 2 * plan->capacity;
+        plan->pieces = realloc(plan->pieces, plan->capacity * sizeof(CACHE_PIECE));
+        plan->subrequests = realloc(plan->subrequests, plan->capacity * sizeof(INTEGRAL_REQUEST));
+        if (plan->pieces == NULL || plan->subrequests == NULL) {
+            fprintf(stderr, "Unable to allocate cache plan\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    CACHE_PIECE *piece = &plan->pieces[plan->num_pieces++];
+    piece->request = request_i;
+    piece->kind = kind;
+    piece->left = left;
+    piece->right = right;
+    piece->cached = false;
+    if (kind == CACHE_BLOCK) {
+        CACHE_KEY key = cache_key(manager, CACHE_BLOCK, request, left, right);
+        piece->cached = cache_lookup(manager->cache, &key, request->precision, &piece->value);
+    }
+    if (!piece->cached) {
+        INTEGRAL_REQUEST *subrequest = &plan->subrequests[plan->num_subrequests];
+        *subrequest = *request;
+        subrequest->left = left;
+        subrequest->right = right;
+        piece->subrequest = plan->num_subrequests++;
+    }
+}
+
+// Делит интеграл на голову, блоки длины 2^k с границами, кратными 2^k, и хвост.
+static void cache_plan_request(INFO_MANAGER *manager, CACHE_PLAN *plan, size_t request_i, const INTEGRAL_REQUEST *request) {
+    double left = request->left;
+    double right = request->right;
+    int exponent;
+    frexp((right - left) / CACHE_BLOCKS_PER_INTEGRAL, &exponent);
+    double block = ldexp(1.0, exponent - 1);
+    double first = ceil(left / block);
+    double last = floor(right / block);
+    if (!(first < last) || fabs(first) > CACHE_MAX_BLOCK_INDEX || fabs(last) > CACHE_MAX_BLOCK_INDEX) {
+        cache_plan_add(manager, plan, request_i, request, CACHE_INTEGRAL, left, right);
+        return;
+    }
+    cache_plan_add(manager, plan, request_i, request, CACHE_INTEGRAL, left, first * block);
+    for (double index = first; index < last; ++index) {
+        cache_plan_add(manager, plan, request_i, request, CACHE_BLOCK, index * block, (index + 1) * block);
+    }
+    cache_plan_add(manager, plan, request_i, request, CACHE_INTEGRAL, last * block, right);
+}
+
+static int manager_run_requests(INFO_MANAGER *manager, const INTEGRAL_REQUEST *requests, size_t num_requests, double *results,
+                                int *statuses);
+
+// Считает пакет через кэш: готовые интегралы и блоки берутся из кэша, остальные
+// части считаются одним заданием, ответы сохраняются в кэш. Интеграл, одна из
+// частей которого не посчиталась, получает её код в statuses и в кэш не попадает.
+static int manager_run_cached(INFO_MANAGER *manager, const INTEGRAL_REQUEST *requests, size_t num_requests, double *results,
+                              int *statuses) {
+    RESULT_CACHE *cache = manager->cache;
+    bool *found = calloc(num_requests == 0 ? 1 : num_requests, sizeof(bool));
+    if (found == NULL) {
+        fprintf(stderr, "Unable to allocate cache plan\n");
+        exit(EXIT_FAILURE);
+    }
+    CACHE_PLAN plan = {0};
+    for (size_t request_i = 0; request_i < num_requests; ++request_i) {
+        const INTEGRAL_REQUEST *request = &requests[request_i];
+        results[request_i] = 0;
+        if (request->left == request->right) {
+            found[request_i] = true;
+            continue;
+        }
+        CACHE_KEY key = cache_key(manager, CACHE_INTEGRAL, request, request->left, request->right);
+        found[request_i] = cache_lookup(cache, &key, request->precision, &results[request_i]);
+        if (!found[request_i]) {
+            cache_plan_request(manager, &plan, request_i, request);
+        }
+    }
+
+    int rc = 0;
+    size_t num_values = plan.num_subrequests == 0 ? 1 : plan.num_subrequests;
+    double *values = malloc(num_values * sizeof(double));
+    int *value_statuses = calloc(num_values, sizeof(int));
+    if (values == NULL || value_statuses == NULL) {
+        fprintf(stderr, "Unable to allocate cache plan\n");
+        exit(EXIT_FAILURE);
+    }
+    if (plan.num_subrequests != 0) {
+        rc = manager_run_requests(manager, plan.subrequests, plan.num_subrequests, values, value_statuses);
+    }
+    if (rc == 0) {
+        // Части лежат в плане по порядку, складываем их с компенсацией.
+        double *comp = calloc(num_requests == 0 ? 1 : num_requests, sizeof(double));
+        if (comp == NULL) {
+            fprintf(stderr, "Unable to allocate cache plan\n");
+            exit(EXIT_FAILURE);
+        }
+        for (size_t piece_i = 0; piece_i < plan.num_pieces; ++piece_i) {
+            CACHE_PIECE *piece = &plan.pieces[piece_i];
+            const INTEGRAL_REQUEST *request = &requests[piece->request];
+            if (!piece->cached) {
+                int status = value_statuses[piece->subrequest];
+                if (status != 0) {
+                    statuses[piece->request] = status;
+                    continue;
+                }
+                piece->value = values[piece->subrequest];
+                if (piece->kind == CACHE_BLOCK) {
+                    CACHE_KEY key = cache_key(manager, CACHE_BLOCK, request, piece->left, piece->right);
+                    cache_insert(cache, &key, request->precision, piece->value);
+                }
+            }
+            neumaier_add(&results[piece->request], &comp[piece->request], piece->value);
+        }
+        for (size_t request_i = 0; request_i < num_requests; ++request_i) {
+            const INTEGRAL_REQUEST *request = &requests[request_i];
+            if (found[request_i]) {
+                continue;
+            }
+            if (statuses[request_i] != 0) {
+                results[request_i] = 0;
+                continue;
+            }
+            results[request_i] += comp[request_i];
+            CACHE_KEY key = cache_key(manager, CACHE_INTEGRAL, request, request->left, request->right);
+            cache_insert(cache, &key, request->precision, results[request_i]);
+        }
+        free(comp);
+    }
+    free(values);
+    free(value_statuses);
+    free(plan.subrequests);
+    free(plan.pieces);
+    free(found);
+    return rc;
+}
+
+// Все интегралы пакета уже есть в кэше: тогда пул можно не поднимать.
+static bool manager_cache_lookup_all(INFO_MANAGER *manager, const INTEGRAL_REQUEST *requests, size_t num_requests, double *results) {
+    if (manager->cache == NULL) {
+        return false;
+    }
+    // Сначала проверяем, не засчитывая промахи: иначе их посчитает ещё и задание.
+    for (int pass = 0; pass < 2; ++pass) {
+        for (size_t request_i = 0; request_i < num_requests; ++request_i) {
+            const INTEGRAL_REQUEST *request = &requests[request_i];
+            if (request->left == request->right) {
+                results[request_i] = 0;
+                continue;
+            }
+            CACHE_KEY key = cache_key(manager, CACHE_INTEGRAL, request, request->left, request->right);
+            if (!cache_lookup_ex(manager->cache, &key, request->precision, &results[request_i], pass == 1)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static int async_run_batch(INFO_MANAGER *manager, const INTEGRAL_REQUEST *requests, size_t num_requests, double *results);
+
+// Считает пакет на пуле в вызывающем потоке. Если statuses задан, в него пишутся
+// коды ошибок отдельных интегралов, а возвращается только ошибка всего пакета;
+// иначе возвращается первая ошибка.
+static int manager_run_batch(INFO_MANAGER *manager, const INTEGRAL_REQUEST *requests, size_t num_requests, double *results,
+                             int *statuses) {
+    if (!manager->pool_started) {
+        return -EPOOL;
+    }
+    if (num_requests != 0 && (requests == NULL || results == NULL)) {
+        return -EVALUE;
+    }
+    for (size_t request_i = 0; request_i < num_requests; ++request_i) {
+        int rc = check_integral_request(&requests[request_i]);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+    metric_add(&manager->metrics->integrals, num_requests);
+    int *request_statuses = statuses;
+    if (request_statuses == NULL) {
+        request_statuses = malloc((num_requests == 0 ? 1 : num_requests) * sizeof(int));
+        if (request_statuses == NULL) {
+            fprintf(stderr, "Unable to allocate batch statuses\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    memset(request_statuses, 0, num_requests * sizeof(int));
+    int rc;
+    if (manager->cache != NULL) {
+        rc = manager_run_cached(manager, requests, num_requests, results, request_statuses);
+    } else {
+        rc = manager_run_requests(manager, requests, num_requests, results, request_statuses);
+    }
+    if (statuses == NULL) {
+        for (size_t request_i = 0; request_i < num_requests && rc == 0; ++request_i) {
+            rc = request_statuses[request_i];
+        }
+        free(request_statuses);
+    }
+    return rc;
+}
+
+// Считает проверенные интегралы одним заданием. Коды ошибок отдельных интегралов
+// пишутся в statuses, ответы на них обнуляются.
+static int manager_run_requests(INFO_MANAGER *manager, const INTEGRAL_REQUEST *requests, size_t num_requests, double *results,
+                                int *statuses) {
+    // Время задания, в том числе для метрик, отсчитывается от разбиения отрезков.
+    struct timespec start_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    JOB job = {.summation = manager->summation, .num_results = num_requests, .statuses = statuses};
+    job.results = calloc(num_requests == 0 ? 1 : num_requests, sizeof(double));
+    if (job.results == NULL) {
+        fprintf(stderr, "Unable to allocate batch results\n");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t request_i = 0; request_i < num_requests; ++request_i) {
+        job_push_integral(manager, &job, request_i, &requests[request_i]);
+    }
+    if (job.queue.num_count == 0) {
+        memcpy(results, job.results, num_requests * sizeof(double));
+        free(job.results);
+        job_free(&job);
+        return 0;
+    }
+
+    // Замеряем узлы на каждой встречающейся в пакете паре функции и формулы;
+    // работа делится по замеру первого интеграла пакета.
+    struct timespec deadline = start_time;
+    deadline.tv_sec += manager->max_time;
+    bool calibrated[MAX_INTEGRANDS][QUAD_RULES] = {0};
+    for (size_t request_i = 0; request_i < num_requests; ++request_i) {
+        const INTEGRAL_REQUEST *request = &requests[request_i];
+        int slot = integrand_slot(request->func_id);
+        if (request->left == request->right || calibrated[slot][request->rule]) {
+            continue;
+        }
+        calibrated[slot][request->rule] = true;
+        manager_calibrate(manager, request->func_id, request->rule, request->left, request->right, &deadline);
+    }
+    SEGMENT *first = &job.queue.segments[0];
+    job.func_id = first->func_id;
+    job.rule = first->rule;
+
+    double *job_results = job.results;
+    int rc = manager_run_job(manager, &job, &start_time);
+    if (rc == 0) {
+        for (size_t request_i = 0; request_i < num_requests; ++request_i) {
+            results[request_i] = statuses[request_i] == 0 ? job_results[request_i] : 0;
+        }
+    }
+    free(job_results);
+    return rc;
+}
+
+int manager_pool_submit_batch(INFO_MANAGER *manager, const INTEGRAL_REQUEST *requests, size_t num_requests, double *results) {
+    // Пулом владеет поток асинхронного интерфейса, если он запущен.
+    if (manager->async != NULL) {
+        return async_run_batch(manager, requests, num_requests, results);
+    }
+    return manager_run_batch(manager, requests, num_requests, results, NULL);
+}
+
+int manager_pool_submit(INFO_MANAGER *manager, FUNC_TABLE func_id, double left, double right, double precision, QUAD_RULE rule, double *res_value) {
+    if (res_value == NULL) {
+        return -EVALUE;
+    }
+    INTEGRAL_REQUEST request = {.func_id = func_id, .rule = rule, .left = left, .right = right, .precision = precision};
+    return manager_pool_submit_batch(manager, &request, 1, res_value);
+}
+
+static void manager_async_stop(INFO_MANAGER *manager);
+static void manager_async_reopen(INFO_MANAGER *manager);
+
+void manager_pool_stop(INFO_MANAGER *manager) {
+    if (!manager->pool_started) {
+        return;
+    }
+    manager_async_stop(manager);
+    for (size_t conn_i = 0U; conn_i < manager->num_works; ++conn_i) {
+        if (manager->works[conn_i]->state != WORK_FINISHED) {
+            manager_finish_worker(manager->works[conn_i]);
+        }
+        free(manager->works[conn_i]);
+    }
+    manager->flush_list = NULL;
+    manager_close_listen_socket(manager);
+    close(manager->epoll_fd);
+    manager->epoll_fd = -1;
+    free(manager->works);
+    manager->works = NULL;
+    manager->num_works = manager->works_capacity = 0;
+    manager->num_ready = 0;
+    manager->value_load = 0;
+    manager->pool_started = false;
+    manager_async_reopen(manager);
+}
+
+int get_integral(INFO_MANAGER *manager, FUNC_TABLE func_id, double left, double right, double precision, QUAD_RULE rule, double *res_value) {
+    if (manager->pool_started) {
+        return manager_pool_submit(manager, func_id, left, right, precision, rule, res_value);
+    }
+
+    if (res_value == NULL) {
+        return -EVALUE;
+    }
+    INTEGRAL_REQUEST request = {.func_id = func_id, .rule = rule, .left = left, .right = right, .precision = precision};
+    int rc = check_integral_request(&request);
+    if (rc != 0) {
+        return rc;
+    }
+    if (manager_cache_lookup_all(manager, &request, 1, res_value)) {
+        return 0;
+    }
+
+    int ret = manager_pool_start(manager);
+    if (ret != 0) {
+        return ret;
+    }
+    ret = manager_pool_submit(manager, func_id, left, right, precision, rule, res_value);
+    manager_pool_stop(manager);
+    return ret;
+}
+
+int get_integrals_batch(INFO_MANAGER *manager, const INTEGRAL_REQUEST *requests, size_t num_requests, double *results) {
+    if (manager->pool_started) {
+        return manager_pool_submit_batch(manager, requests, num_requests, results);
+    }
+
+    if (num_requests != 0 && (requests == NULL || results == NULL)) {
+        return -EVALUE;
+    }
+    for (size_t request_i = 0; request_i < num_requests; ++request_i) {
+        int rc = check_integral_request(&requests[request_i]);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+    if (manager_cache_lookup_all(manager, requests, num_requests, results)) {
+        return 0;
+    }
+
+    int ret = manager_pool_start(manager);
+    if (ret != 0) {
+        return ret;
+    }
+    ret = manager_pool_submit_batch(manager, requests, num_requests, results);
+    manager_pool_stop(manager);
+    return ret;
+}
+
+//==================
+// Асинхронный интерфейс
+//==================
+
+typedef enum
+{
+    FUTURE_PENDING,
+    FUTURE_RUNNING,
+    FUTURE_DONE,
+} FUTURE_STATE;
+
+struct integral_future
+{
+    INTEGRAL_REQUEST request;
+    INTEGRAL_CALLBACK callback;
+    void *arg;
+    struct async_loop *loop;
+
+    // Поля ниже защищены loop->lock.
+    FUTURE_STATE state;
+    bool cancelled;
+    // Пользователь уже освободил future, её освободит внутренний поток.
+    bool detached;
+    int status;
+    double value;
+    struct integral_future *next;
+};
+
+typedef struct async_loop
+{
+    INFO_MANAGER *manager;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    // В очереди появились вычисления или пора завершаться.
+    pthread_cond_t submit_cond;
+    // Какое-то вычисление закончилось.
+    pthread_cond_t done_cond;
+    // Очередь ещё не начатых вычислений.
+    INTEGRAL_FUTURE *head;
+    INTEGRAL_FUTURE *tail;
+    // Сколько future ещё не освобождено: структура живёт, пока они есть.
+    size_t num_futures;
+    bool shutdown;
+    // Сигнал приложению об окончании вычислений.
+    int event_fd;
+} ASYNC_LOOP;
+
+// Защищает ленивый запуск и остановку потока асинхронного интерфейса: под ней
+// поток находят и ставят в него вычисления, поэтому остановка их не пропустит.
+static pthread_mutex_t async_start_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void async_loop_free(ASYNC_LOOP *loop) {
+    close(loop->event_fd);
+    pthread_cond_destroy(&loop->done_cond);
+    pthread_cond_destroy(&loop->submit_cond);
+    pthread_mutex_destroy(&loop->lock);
+    free(loop);
+}
+
+// Освобождает future; вызывается под loop->lock. Возвращает true, если после
+// остановки пула это была последняя future и структуру потока пора освободить.
+static bool async_release_future_locked(ASYNC_LOOP *loop, INTEGRAL_FUTURE *future) {
+    free(future);
+    loop->num_futures--;
+    return loop->shutdown && loop->num_futures == 0 && loop->manager == NULL;
+}
+
+static void async_notify(ASYNC_LOOP *loop) {
+    uint64_t one = 1;
+    if (write(loop->event_fd, &one, sizeof(one)) == -1 && errno != EAGAIN) {
+        fprintf(stderr, "Unable to signal completion eventfd\n");
+    }
+}
+
+// Завершает вычисление: вызывает callback вне блокировки, затем публикует результат.
+static void async_finish(ASYNC_LOOP *loop, INTEGRAL_FUTURE *future, int status, double value) {
+    if (future->callback != NULL) {
+        future->callback(future, status, value, future->arg);
+    }
+
+    pthread_mutex_lock(&loop->lock);
+    future->status = status;
+    future->value = value;
+    future->state = FUTURE_DONE;
+    bool release_loop = false;
+    if (future->detached) {
+        release_loop = async_release_future_locked(loop, future);
+    }
+    pthread_cond_broadcast(&loop->done_cond);
+    pthread_mutex_unlock(&loop->lock);
+    async_notify(loop);
+    if (release_loop) {
+        async_loop_free(loop);
+    }
+}
+
+// Забирает из очереди все накопившиеся вычисления и считает их одним пакетом.
+static void *async_loop_thread(void *arg) {
+    ASYNC_LOOP *loop = arg;
+    pthread_mutex_lock(&loop->lock);
+    while (true) {
+        while (loop->head == NULL && !loop->shutdown) {
+            pthread_cond_wait(&loop->submit_cond, &loop->lock);
+        }
+        if (loop->head == NULL) {
+            break;
+        }
+
+        size_t num_requests = 0;
+        for (INTEGRAL_FUTURE *future = loop->head; future != NULL; future = future->next) {
+            num_requests++;
+        }
+        INTEGRAL_FUTURE **batch = malloc(num_requests * sizeof(INTEGRAL_FUTURE *));
+        INTEGRAL_REQUEST *requests = malloc(num_requests * sizeof(INTEGRAL_REQUEST));
+        double *results = malloc(num_requests * sizeof(double));
+        if (batch == NULL || requests == NULL || results == NULL) {
+            fprintf(stderr, "Unable to allocate async batch\n");
+            exit(EXIT_FAILURE);
+        }
+        size_t request_i = 0;
+        for (INTEGRAL_FUTURE *future = loop->head; future != NULL; future = future->next) {
+            future->state = FUTURE_RUNNING;
+            batch[request_i] = future;
+            requests[request_i] = future->request;
+            request_i++;
+        }
+        loop->head = loop->tail = NULL;
+        atomic_fetch_sub_explicit(&loop->manager->metrics->async_queued, num_requests, memory_order_relaxed);
+        bool shutdown = loop->shutdown;
+        pthread_mutex_unlock(&loop->lock);
+
+        // После остановки пула недосчитанные вычисления завершаются с ошибкой.
+        // Запросы проверены при постановке в очередь, поэтому ошибка узла на
+        // одном интеграле пакета достаётся только его future.
+        int *statuses = calloc(num_requests, sizeof(int));
+        if (statuses == NULL) {
+            fprintf(stderr, "Unable to allocate async batch\n");
+            exit(EXIT_FAILURE);
+        }
+        int rc = shutdown ? -ESHUTDOWN : manager_run_batch(loop->manager, requests, num_requests, results, statuses);
+        for (request_i = 0; request_i < num_requests; ++request_i) {
+            INTEGRAL_FUTURE *future = batch[request_i];
+            pthread_mutex_lock(&loop->lock);
+            bool cancelled = future->cancelled;
+            pthread_mutex_unlock(&loop->lock);
+            if (cancelled) {
+                async_finish(loop, future, -ECANCEL, 0);
+            } else {
+                int status = rc != 0 ? rc : statuses[request_i];
+                async_finish(loop, future, status, status == 0 ? results[request_i] : 0);
+            }
+        }
+        free(statuses);
+        free(results);
+        free(requests);
+        free(batch);
+        pthread_mutex_lock(&loop->lock);
+    }
+    pthread_mutex_unlock(&loop->lock);
+    return NULL;
+}
+
+// Запускает поток асинхронного интерфейса, если он ещё не запущен; вызывается
+// под async_start_lock. Пока пул останавливается, возвращает -ESHUTDOWN.
+static int manager_async_start_locked(INFO_MANAGER *manager, ASYNC_LOOP **loop_out) {
+    if (manager->async_stopping) {
+        return -ESHUTDOWN;
+    }
+    ASYNC_LOOP *loop = manager->async;
+    if (loop == NULL) {
+        if (!manager->pool_started) {
+            return -EPOOL;
+        }
+        loop = calloc(1, sizeof(ASYNC_LOOP));
+        if (loop == NULL) {
+            fprintf(stderr, "Unable to allocate async loop\n");
+            exit(EXIT_FAILURE);
+        }
+        loop->manager = manager;
+        loop->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (loop->event_fd == -1) {
+            fprintf(stderr, "Unable to create completion eventfd\n");
+            exit(EXIT_FAILURE);
+        }
+        pthread_mutex_init(&loop->lock, NULL);
+        pthread_cond_init(&loop->submit_cond, NULL);
+        pthread_cond_init(&loop->done_cond, NULL);
+        if (pthread_create(&loop->thread, NULL, async_loop_thread, loop) != 0) {
+            fprintf(stderr, "Unable to create async loop thread\n");
+            exit(EXIT_FAILURE);
+        }
+        manager->async = loop;
+    }
+    *loop_out = loop;
+    return 0;
+}
+
+// Останавливает поток асинхронного интерфейса. Структура освобождается сразу,
+// если не осталось неосвобождённых future, иначе — вместе с последней из них.
+static void manager_async_stop(INFO_MANAGER *manager) {
+    // С этого момента новые вычисления не принимаются, а уже поставленные
+    // в очередь поток успеет завершить.
+    pthread_mutex_lock(&async_start_lock);
+    manager->async_stopping = true;
+    ASYNC_LOOP *loop = manager->async;
+    if (loop != NULL) {
+        pthread_mutex_lock(&loop->lock);
+        loop->shutdown = true;
+        pthread_cond_signal(&loop->submit_cond);
+        pthread_mutex_unlock(&loop->lock);
+    }
+    pthread_mutex_unlock(&async_start_lock);
+    if (loop == NULL) {
+        return;
+    }
+    pthread_join(loop->thread, NULL);
+
+    pthread_mutex_lock(&loop->lock);
+    loop->manager = NULL;
+    bool release_loop = loop->num_futures == 0;
+    pthread_mutex_unlock(&loop->lock);
+    pthread_mutex_lock(&async_start_lock);
+    manager->async = NULL;
+    pthread_mutex_unlock(&async_start_lock);
+    if (release_loop) {
+        async_loop_free(loop);
+    }
+}
+
+// Пул остановлен: асинхронные вычисления снова можно ставить после его запуска.
+static void manager_async_reopen(INFO_MANAGER *manager) {
+    pthread_mutex_lock(&async_start_lock);
+    manager->async_stopping = false;
+    pthread_mutex_unlock(&async_start_lock);
+}
+
+static INTEGRAL_FUTURE *async_submit(ASYNC_LOOP *loop, const INTEGRAL_REQUEST *request, INTEGRAL_CALLBACK callback, void *arg) {
+    INTEGRAL_FUTURE *future = calloc(1, sizeof(INTEGRAL_FUTURE));
+    if (future == NULL) {
+        fprintf(stderr, "Unable to allocate future\n");
+        exit(EXIT_FAILURE);
+    }
+    future->request = *request;
+    future->callback = callback;
+    future->arg = arg;
+    future->loop = loop;
+    future->state = FUTURE_PENDING;
+
+    pthread_mutex_lock(&loop->lock);
+    if (loop->tail == NULL) {
+        loop->head = future;
+    } else {
+        loop->tail->next = future;
+    }
+    loop->tail = future;
+    loop->num_futures++;
+    atomic_fetch_add_explicit(&loop->manager->metrics->async_queued, 1, memory_order_relaxed);
+    pthread_cond_signal(&loop->submit_cond);
+    pthread_mutex_unlock(&loop->lock);
+    return future;
+}
+
+// Проверяет запрос и ставит его в очередь потока асинхронного интерфейса,
+// запуская поток при необходимости.
+static int async_enqueue(INFO_MANAGER *manager, const INTEGRAL_REQUEST *request, INTEGRAL_CALLBACK callback, void *arg,
+                         INTEGRAL_FUTURE **future) {
+    int rc = check_integral_request(request);
+    if (rc != 0) {
+        return rc;
+    }
+    pthread_mutex_lock(&async_start_lock);
+    ASYNC_LOOP *loop;
+    rc = manager_async_start_locked(manager, &loop);
+    if (rc == 0) {
+        *future = async_submit(loop, request, callback, arg);
+    }
+    pthread_mutex_unlock(&async_start_lock);
+    return rc;
+}
+
+// Синхронный пакет на пуле, которым владеет поток асинхронного интерфейса.
+static int async_run_batch(INFO_MANAGER *manager, const INTEGRAL_REQUEST *requests, size_t num_requests, double *results) {
+    if (num_requests != 0 && (requests == NULL || results == NULL)) {
+        return -EVALUE;
+    }
+    for (size_t request_i = 0; request_i < num_requests; ++request_i) {
+        int rc = check_integral_request(&requests[request_i]);
+        if (rc != 0) {
+            return rc;
+        }
+    }
+
+    INTEGRAL_FUTURE **futures = malloc((num_requests == 0 ? 1 : num_requests) * sizeof(INTEGRAL_FUTURE *));
+    if (futures == NULL) {
+        fprintf(stderr, "Unable to allocate futures\n");
+        exit(EXIT_FAILURE);
+    }
+    int rc = 0;
+    for (size_t request_i = 0; request_i < num_requests; ++request_i) {
+        futures[request_i] = NULL;
+        int status = async_enqueue(manager, &requests[request_i], NULL, NULL, &futures[request_i]);
+        if (status != 0 && rc == 0) {
+            rc = status;
+        }
+    }
+    for (size_t request_i = 0; request_i < num_requests; ++request_i) {
+        if (futures[request_i] == NULL) {
+            continue;
+        }
+        int status = integral_future_wait(futures[request_i], &results[request_i]);
+        if (status != 0 && rc == 0) {
+            rc = status;
+        }
+        integral_future_free(futures[request_i]);
+    }
+    free(futures);
+    return rc;
+}
+
+int get_integral_async(INFO_MANAGER *manager, FUNC_TABLE func_id, double left, double right, double precision, QUAD_RULE rule,
+                       INTEGRAL_CALLBACK callback, void *arg, INTEGRAL_FUTURE **future) {
+    if (future == NULL) {
+        return -EVALUE;
+    }
+    INTEGRAL_REQUEST request = {.func_id = func_id, .rule = rule, .left = left, .right = right, .precision = precision};
+    return async_enqueue(manager, &request, callback, arg, future);
+}
+
+int integral_future_poll(INTEGRAL_FUTURE *future) {
+    ASYNC_LOOP *loop = future->loop;
+    pthread_mutex_lock(&loop->lock);
+    bool done = future->state == FUTURE_DONE;
+    pthread_mutex_unlock(&loop->lock);
+    return done;
+}
+
+int integral_future_wait(INTEGRAL_FUTURE *future, double *res_value) {
+    ASYNC_LOOP *loop = future->loop;
+    pthread_mutex_lock(&loop->lock);
+    while (future->state != FUTURE_DONE) {
+        pthread_cond_wait(&loop->done_cond, &loop->lock);
+    }
+    int status = future->status;
+    if (status == 0 && res_value != NULL) {
+        *res_value = future->value;
+    }
+    pthread_mutex_unlock(&loop->lock);
+    return status;
+}
+
+// Снимает future с очереди; вызывается под loop->lock.
+static bool async_unlink_locked(ASYNC_LOOP *loop, INTEGRAL_FUTURE *future) {
+    INTEGRAL_FUTURE *prev = NULL;
+    for (INTEGRAL_FUTURE *cur = loop->head; cur != NULL; prev = cur, cur = cur->next) {
+        if (cur != future) {
+            continue;
+        }
+        if (prev == NULL) {
+            loop->head = cur->next;
+        } else {
+            prev->next = cur->next;
+        }
+        if (loop->tail == cur) {
+            loop->tail = prev;
+        }
+        if (loop->manager != NULL) {
+            atomic_fetch_sub_explicit(&loop->manager->metrics->async_queued, 1, memory_order_relaxed);
+        }
+        return true;
+    }
+    return false;
+}
+
+int integral_future_cancel(INTEGRAL_FUTURE *future) {
+    ASYNC_LOOP *loop = future->loop;
+    pthread_mutex_lock(&loop->lock);
+    switch (future->state)
+    {
+    case FUTURE_PENDING:
+        // Вычисление ещё не начато — завершаем его прямо здесь.
+        async_unlink_locked(loop, future);
+        future->state = FUTURE_RUNNING;
+        pthread_mutex_unlock(&loop->lock);
+        async_finish(loop, future, -ECANCEL, 0);
+        return 1;
+    case FUTURE_RUNNING:
+        // Ответ пакета, в который попало вычисление, будет отброшен.
+        future->cancelled = true;
+        pthread_mutex_unlock(&loop->lock);
+        return 1;
+    case FUTURE_DONE:
+    default:
+        pthread_mutex_unlock(&loop->lock);
+        return 0;
+    }
+}
+
+void integral_future_free(INTEGRAL_FUTURE *future) {
+    if (future == NULL) {
+        return;
+    }
+    ASYNC_LOOP *loop = future->loop;
+    pthread_mutex_lock(&loop->lock);
+    bool release_loop = false;
+    switch (future->state)
+    {
+    case FUTURE_PENDING:
+        async_unlink_locked(loop, future);
+        release_loop = async_release_future_locked(loop, future);
+        break;
+    case FUTURE_RUNNING:
+        future->cancelled = true;
+        future->detached = true;
+        break;
+    case FUTURE_DONE:
+    default:
+        release_loop = async_release_future_locked(loop, future);
+        break;
+    }
+    pthread_mutex_unlock(&loop->lock);
+    if (release_loop) {
+        async_loop_free(loop);
+    }
+}
+
+int manager_async_fd(INFO_MANAGER *manager) {
+    pthread_mutex_lock(&async_start_lock);
+    ASYNC_LOOP *loop;
+    int rc = manager_async_start_locked(manager, &loop);
+    pthread_mutex_unlock(&async_start_lock);
+    return rc != 0 ? rc : loop->event_fd;
+}
+
+//==================
+// Метрики
+//==================
+
+void manager_get_stats(INFO_MANAGER *manager, MANAGER_STATS *stats) {
+    const MANAGER_METRICS *metrics = manager->metrics;
+    memset(stats, 0, sizeof(*stats));
+    stats->jobs = metric_get(&metrics->jobs);
+    stats->jobs_failed = metric_get(&metrics->jobs_failed);
+    stats->integrals = metric_get(&metrics->integrals);
+    stats->chunks = metric_get(&metrics->chunks);
+    stats->chunk_copies = metric_get(&metrics->chunk_copies);
+    stats->steps = metric_get(&metrics->steps);
+    stats->evaluations = metric_get(&metrics->evaluations);
+    uint64_t job_ns = metric_get(&metrics->job_ns);
+    stats->evals_per_sec = job_ns == 0 ? 0 : stats->evaluations / (job_ns * 1e-9);
+    stats->bytes_sent = metric_get(&metrics->bytes_sent);
+    stats->bytes_received = metric_get(&metrics->bytes_received);
+    stats->frames_sent = metric_get(&metrics->frames_sent);
+    stats->frames_received = metric_get(&metrics->frames_received);
+    stats->workers_connected = metric_get(&metrics->workers_connected);
+    stats->workers_lost = metric_get(&metrics->workers_lost);
+    stats->workers_ready = metric_get(&metrics->workers_ready);
+    stats->chunks_in_flight = metric_get(&metrics->chunks_in_flight);
+    stats->steps_queued = metric_get(&metrics->steps_queued);
+    stats->chunks_retry = metric_get(&metrics->chunks_retry);
+    stats->async_queued = metric_get(&metrics->async_queued);
+    metric_histogram_read(&metrics->handshake, &stats->handshake);
+    metric_histogram_read(&metrics->dispatch, &stats->dispatch);
+    metric_histogram_read(&metrics->chunk_rtt, &stats->chunk_rtt);
+    metric_histogram_read(&metrics->chunk_compute, &stats->chunk_compute);
+    metric_histogram_read(&metrics->job_time, &stats->job);
+}
+
+size_t manager_get_worker_stats(INFO_MANAGER *manager, WORKER_STATS *stats, size_t max_stats) {
+    const MANAGER_METRICS *metrics = manager->metrics;
+    size_t num_workers = metric_get(&metrics->num_workers);
+    for (size_t worker_i = 0; worker_i < num_workers && worker_i < max_stats; ++worker_i) {
+        const WORKER_METRICS *worker = &metrics->workers[worker_i];
+        stats[worker_i] = (WORKER_STATS){
+            .id = worker_i,
+            .connected = metric_get(&worker->connected) != 0,
+            .n_cores = (int)metric_get(&worker->n_cores),
+            .n_cpus = (int)metric_get(&worker->n_cpus),
+            .n_physical_cores = (int)metric_get(&worker->n_physical_cores),
+            .n_packages = (int)metric_get(&worker->n_packages),
+            .n_numa_nodes = (int)metric_get(&worker->n_numa_nodes),
+            .chunks = metric_get(&worker->chunks),
+            .steps = metric_get(&worker->steps),
+            .compute_sec = metric_get(&worker->compute_ns) * 1e-9,
+            .cpu_sec = metric_get(&worker->cpu_ns) * 1e-9,
+            .rtt_sec = metric_get(&worker->rtt_ns) * 1e-9,
+            .bytes_sent = metric_get(&worker->bytes_sent),
+            .bytes_received = metric_get(&worker->bytes_received),
+        };
+    }
+    return num_workers;
+}
+
+static void stats_write_value(FILE *out, const char *name, const char *type, const char *help, double value) {
+    fprintf(out, "# HELP integral_%s %s\n# TYPE integral_%s %s\nintegral_%s %.17g\n", name, help, name, type, name, value);
+}
+
+static void stats_write_histogram(FILE *out, const char *name, const char *help, const METRICS_HISTOGRAM *histogram) {
+    fprintf(out, "# HELP integral_%s %s\n# TYPE integral_%s histogram\n", name, help, name);
+    uint64_t cumulative = 0;
+    double bound = METRICS_BUCKET_MIN_SEC;
+    for (unsigned bucket = 0; bucket + 1 < METRICS_BUCKETS; ++bucket, bound *= 2) {
+        cumulative += histogram->buckets[bucket];
+        fprintf(out, "integral_%s_bucket{le=\"%g\"} %lu\n", name, bound, cumulative);
+    }
+    fprintf(out, "integral_%s_bucket{le=\"+Inf\"} %lu\n", name, histogram->count);
+    fprintf(out, "integral_%s_sum %.9f\nintegral_%s_count %lu\n", name, histogram->sum_sec, name, histogram->count);
+}
+
+void manager_write_stats(INFO_MANAGER *manager, FILE *out) {
+    MANAGER_STATS stats;
+    manager_get_stats(manager, &stats);
+    stats_write_value(out, "jobs_total", "counter", "Jobs run on the pool.", stats.jobs);
+    stats_write_value(out, "jobs_failed_total", "counter", "Jobs finished with an error.", stats.jobs_failed);
+    stats_write_value(out, "integrals_total", "counter", "Integrals requested, including cache hits.", stats.integrals);
+    stats_write_value(out, "chunks_total", "counter", "Chunks handed out to workers.", stats.chunks);
+    stats_write_value(out, "chunk_copies_total", "counter", "Speculative and retried chunk copies.", stats.chunk_copies);
+    stats_write_value(out, "steps_total", "counter", "Quadrature steps computed.", stats.steps);
+    stats_write_value(out, "evaluations_total", "counter", "Integrand evaluations.", stats.evaluations);
+    stats_write_value(out, "evaluations_per_second", "gauge", "Evaluations per second of job time.", stats.evals_per_sec);
+    stats_write_value(out, "bytes_sent_total", "counter", "Bytes sent to workers.", stats.bytes_sent);
+    stats_write_value(out, "bytes_received_total", "counter", "Bytes received from workers.", stats.bytes_received);
+    stats_write_value(out, "frames_sent_total", "counter", "Frames sent to workers.", stats.frames_sent);
+    stats_write_value(out, "frames_received_total", "counter", "Frames received from workers.", stats.frames_received);
+    stats_write_value(out, "workers_connected_total", "counter", "Worker connections accepted.", stats.workers_connected);
+    stats_write_value(out, "workers_lost_total", "counter", "Workers dropped from the pool.", stats.workers_lost);
+    stats_write_value(out, "workers_ready", "gauge", "Workers ready to take chunks.", stats.workers_ready);
+    stats_write_value(out, "chunks_in_flight", "gauge", "Chunks of the current job not answered yet.", stats.chunks_in_flight);
+    stats_write_value(out, "steps_queued", "gauge", "Steps of the current job not handed out yet.", stats.steps_queued);
+    stats_write_value(out, "chunks_retry", "gauge", "Chunks of lost workers waiting to be reissued.", stats.chunks_retry);
+    stats_write_value(out, "async_queued", "gauge", "Asynchronous integrals waiting for the pool.", stats.async_queued);
+    stats_write_histogram(out, "handshake_seconds", "From accept to node info.", &stats.handshake);
+    stats_write_histogram(out, "dispatch_seconds", "From job start to the first chunks handed out.", &stats.dispatch);
+    stats_write_histogram(out, "chunk_rtt_seconds", "From sending a chunk to its answer.", &stats.chunk_rtt);
+    stats_write_histogram(out, "chunk_compute_seconds", "Chunk compute time reported by workers.", &stats.chunk_compute);
+    stats_write_histogram(out, "job_seconds", "Job wall time.", &stats.job);
+
+    static const struct
+    {
+        const char *name;
+        const char *type;
+        const char *help;
+    } worker_metrics[] = {
+        {"worker_connected", "gauge", "Whether the worker is connected."},
+        {"worker_cores", "gauge", "Cores reported by the worker."},
+        {"worker_cpus", "gauge", "Logical CPUs available to the worker."},
+        {"worker_physical_cores", "gauge", "Physical cores among the worker's CPUs."},
+        {"worker_packages", "gauge", "Processor packages among the worker's CPUs."},
+        {"worker_numa_nodes", "gauge", "NUMA nodes among the worker's CPUs."},
+        {"worker_chunks_total", "counter", "Chunks answered by the worker."},
+        {"worker_steps_total", "counter", "Steps answered by the worker."},
+        {"worker_compute_seconds_total", "counter", "Wall time the worker spent computing."},
+        {"worker_cpu_seconds_total", "counter", "Thread time the worker spent computing."},
+        {"worker_rtt_seconds_total", "counter", "Sum of chunk round trips."},
+        {"worker_bytes_sent_total", "counter", "Bytes sent to the worker."},
+        {"worker_bytes_received_total", "counter", "Bytes received from the worker."},
+    };
+    size_t num_workers = manager_get_worker_stats(manager, NULL, 0);
+    WORKER_STATS *workers = malloc((num_workers == 0 ? 1 : num_workers) * sizeof(WORKER_STATS));
+    if (workers == NULL) {
+        fprintf(stderr, "Unable to allocate worker stats\n");
+        exit(EXIT_FAILURE);
+    }
+    // Пока идёт опрос, цикл событий может принять новые узлы: выводим только скопированные.
+    size_t num_copied = manager_get_worker_stats(manager, workers, num_workers);
+    if (num_copied < num_workers) {
+        num_workers = num_copied;
+    }
+    for (size_t metric_i = 0; metric_i < sizeof(worker_metrics) / sizeof(worker_metrics[0]); ++metric_i) {
+        fprintf(out, "# HELP integral_%s %s\n# TYPE integral_%s %s\n", worker_metrics[metric_i].name,
+                worker_metrics[metric_i].help, worker_metrics[metric_i].name, worker_metrics[metric_i].type);
+        for (size_t worker_i = 0; worker_i < num_workers; ++worker_i) {
+            const WORKER_STATS *worker = &workers[worker_i];
+            double values[] = {worker->connected, worker->n_cores, worker->n_cpus, worker->n_physical_cores,
+                               worker->n_packages, worker->n_numa_nodes, worker->chunks, worker->steps, worker->compute_sec,
+                               worker->cpu_sec, worker->rtt_sec, worker->bytes_sent, worker->bytes_received};
+            fprintf(out, "integral_%s{worker=\"%zu\"} %.17g\n", worker_metrics[metric_i].name, worker->id, values[metric_i]);
+        }
+    }
+    free(workers);
+}
+
+// Сколько ждём запрос от клиента, прежде чем ответить.
+#define METRICS_REQUEST_TIMEOUT_MS 1000
+
+// Отвечает на один запрос: заголовки запроса не разбираются, на любой путь отдаются метрики.
+static void metrics_serve_client(INFO_MANAGER *manager, int client_fd) {
+    char request[4096];
+    size_t request_length = 0;
+    while (request_length < sizeof(request) - 1) {
+        struct pollfd poll_fd = {.fd = client_fd, .events = POLLIN};
+        if (poll(&poll_fd, 1, METRICS_REQUEST_TIMEOUT_MS) <= 0) {
+            break;
+        }
+        ssize_t bytes_read = recv(client_fd, request + request_length, sizeof(request) - 1 - request_length, 0);
+        if (bytes_read <= 0) {
+            break;
+        }
+        request_length += bytes_read;
+        request[request_length] = '\0';
+        if (strstr(request, "\r\n\r\n") != NULL || strstr(request, "\n\n") != NULL) {
+            break;
+        }
+    }
+
+    char *body = NULL;
+    size_t body_length = 0;
+    FILE *out = open_memstream(&body, &body_length);
+    if (out == NULL) {
+        fprintf(stderr, "Unable to allocate metrics response\n");
+        return;
+    }
+    manager_write_stats(manager, out);
+    fclose(out);
+
+    char header[256];
+    int header_length = snprintf(header, sizeof(header),
+                                 "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %zu\r\n\r\n",
+                                 body_length);
+    if (send(client_fd, header, header_length, MSG_NOSIGNAL) == header_length) {
+        size_t sent = 0;
+        while (sent < body_length) {
+            ssize_t bytes_written = send(client_fd, body + sent, body_length - sent, MSG_NOSIGNAL);
+            if (bytes_written <= 0) {
+                break;
+            }
+            sent += bytes_written;
+        }
+    }
+    free(body);
+}
+
+static void *metrics_server_thread(void *arg) {
+    INFO_MANAGER *manager = arg;
+    MANAGER_METRICS *metrics = manager->metrics;
+    struct pollfd poll_fds[2] = {
+        {.fd = metrics->server_fd, .events = POLLIN},
+        {.fd = metrics->server_stop_fd, .events = POLLIN},
+    };
+    while (true) {
+        if (poll(poll_fds, 2, -1) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fprintf(stderr, "Unable to poll metrics socket\n");
+            break;
+        }
+        if (poll_fds[1].revents != 0) {
+            break;
+        }
+        int client_fd = accept4(metrics->server_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (client_fd == -1) {
+            continue;
+        }
+        metrics_serve_client(manager, client_fd);
+        close(client_fd);
+    }
+    return NULL;
+}
+
+int manager_metrics_listen(INFO_MANAGER *manager, char addr[], char port[]) {
+    MANAGER_METRICS *metrics = manager->metrics;
+    if (metrics->server_fd != -1) {
+        return -EPOOL;
+    }
+    struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *res;
+    int status = getaddrinfo(addr, port, &hints, &res);
+    if (status != 0) {
+        fprintf(stderr, "getaddrinfo error: %s\n", gai_strerror(status));
+        return -EVALUE;
+    }
+    int server_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (server_fd == -1) {
+        fprintf(stderr, "[manager_metrics_listen] Unable to create socket!\n");
+        exit(EXIT_FAILURE);
+    }
+    int setsockopt_yes = 1;
+    setsockopt(server_fd, SOL_SOCKET, SO_REUSEADDR, &setsockopt_yes, sizeof(setsockopt_yes));
+    if (bind(server_fd, res->ai_addr, res->ai_addrlen) == -1 || listen(server_fd, SOMAXCONN) == -1) {
+        fprintf(stderr, "[manager_metrics_listen] Unable to listen on metrics address: %s\n", strerror(errno));
+        freeaddrinfo(res);
+        close(server_fd);
+        return -EVALUE;
+    }
+    freeaddrinfo(res);
+
+    metrics->server_stop_fd = eventfd(0, EFD_CLOEXEC);
+    if (metrics->server_stop_fd == -1) {
+        fprintf(stderr, "Unable to create metrics eventfd\n");
+        exit(EXIT_FAILURE);
+    }
+    metrics->server_fd = server_fd;
+    if (pthread_create(&metrics->server_thread, NULL, metrics_server_thread, manager) != 0) {
+        fprintf(stderr, "Unable to create metrics thread\n");
+        exit(EXIT_FAILURE);
+    }
+    return 0;
+}
+
+void manager_metrics_stop(INFO_MANAGER *manager) {
+    MANAGER_METRICS *metrics = manager->metrics;
+    if (metrics->server_fd == -1) {
+        return;
+    }
+    uint64_t one = 1;
+    if (write(metrics->server_stop_fd, &one, sizeof(one)) != sizeof(one)) {
+        fprintf(stderr, "Unable to stop metrics thread\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_join(metrics->server_thread, NULL);
+    close(metrics->server_stop_fd);
+    close(metrics->server_fd);
+    metrics->server_fd = -1;
+}
@@ -1,9 +1,39 @@
 #define DEBUG(...) printf(__VA_ARGS__);
 
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 #include <time.h>
 #include <arpa/inet.h>
 
+typedef enum
+{
+    // Один кусок на узел, пропорционально заявленной нагрузке.
+    SCHEDULE_STATIC,
+    // Много мелких кусков, выдаваемых по мере получения ответов.
+    SCHEDULE_DYNAMIC,
+} SCHEDULE_MODE;
+
+// Способ сложения частичных сумм.
+typedef enum
+{
+    // Ответы узлов складываются в порядке прихода.
+    SUMMATION_NAIVE,
+    // Компенсированное сложение на узлах и в менеджере, ответы частей складываются
+    // в порядке частей отрезка, а не в порядке прихода. Ошибка округления почти не
+    // растёт с числом шагов, поэтому можно запрашивать менее жёсткую точность.
+    // Части — целые клетки фиксированной сетки, узлы делят их на блоки одного
+    // размера, поэтому ответ побитово один и тот же при любом числе узлов и потоков
+    // на них (если узлы собраны одинаково и работают на одинаковых процессорах).
+    SUMMATION_COMPENSATED,
+} SUMMATION_MODE;
+
+struct work_connection;
+struct job;
+struct async_loop;
+struct result_cache;
+struct manager_metrics;
+
 typedef struct
 {
     //Адрес для прослушивания запросов на подключение.
@@ -14,7 +44,42 @@ typedef struct
     size_t num_nodes;
     // Дескриптор слушающего сокета для первоначального подключения клиентов.
     int listen_sock_fd;
+    // Способ распределения шагов между рабочими узлами.
+    SCHEDULE_MODE schedule;
+    // Дробить отрезок по локальной оценке производной, чтобы шаг был крупнее там, где функция глаже.
+    // По умолчанию выключено, включается info_manager_set_adaptive.
+    bool adaptive;
+    // Способ сложения частичных сумм.
+    SUMMATION_MODE summation;
     bool is_init;
+    // Пул подключённых рабочих узлов (между manager_pool_start и manager_pool_stop).
+    struct work_connection **works;
+    size_t num_works;
+    size_t works_capacity;
+    // Сколько узлов прислали информацию о себе.
+    size_t num_ready;
+    // Дескриптор epoll, обслуживающего все сокеты менеджера.
+    int epoll_fd;
+    // Вычисление, которое сейчас идёт на пуле.
+    struct job *job;
+    // Суммарная заявленная нагрузка узлов пула.
+    uint64_t value_load;
+    // Идентификатор следующего выдаваемого задания.
+    uint64_t next_request_id;
+    bool pool_started;
+    // Поток асинхронного интерфейса (NULL, пока асинхронных вызовов не было).
+    struct async_loop *async;
+    // Пул останавливается: новые асинхронные вычисления не принимаются.
+    bool async_stopping;
+    // Кэш посчитанных интегралов (NULL, если выключен).
+    struct result_cache *cache;
+    // Счётчики и гистограммы работы менеджера и узлов.
+    struct manager_metrics *metrics;
+    // Соединения, в буферах которых ждут отправки кадры.
+    struct work_connection *flush_list;
+    // Начало имён файлов трассы (NULL — трасса выключена) и число записанных трасс.
+    char *trace_prefix;
+    uint64_t num_traces;
 } INFO_MANAGER;
 
 typedef enum
@@ -25,5 +90,199 @@ typedef enum
 	NOT_SUPPORT,
 } FUNC_TABLE;
 
+// Квадратурная формула, применяемая на каждом шаге.
+typedef enum
+{
+	RULE_MIDPOINT,
+	RULE_SIMPSON,
+	RULE_GAUSS2,
+	RULE_GAUSS3,
+	RULE_GAUSS4,
+	QUAD_RULES,
+} QUAD_RULE;
+
+// Один интеграл пакета.
+typedef struct
+{
+	FUNC_TABLE func_id;
+	QUAD_RULE rule;
+	double left;
+	double right;
+	double precision;
+} INTEGRAL_REQUEST;
+
 void info_manager_init(INFO_MANAGER *manager, char addr[], char port[], time_t seconds, int num_nodes);
-int get_integral(INFO_MANAGER *manager, FUNC_TABLE func_id, double left, double right, double precision, double *res_value);
\ No newline at end of file
+void info_manager_set_schedule(INFO_MANAGER *manager, SCHEDULE_MODE schedule);
+void info_manager_set_adaptive(INFO_MANAGER *manager, bool adaptive);
+void info_manager_set_summation(INFO_MANAGER *manager, SUMMATION_MODE summation);
+// Включает трассу: каждое задание пула записывается в файл <prefix>-<номер>.json
+// в формате Chrome trace (открывается в Perfetto и chrome://tracing). Узлы присылают
+// с ответами время этапов и работу каждого потока; по ней видно неравномерную
+// загрузку потоков и ядра, на которых они считали. NULL выключает трассу.
+void info_manager_set_trace(INFO_MANAGER *manager, const char *prefix);
+
+// Загружает подынтегральную функцию из разделяемой библиотеки (см. integrand.h) и
+// возвращает в func_id её идентификатор для запросов. Ту же библиотеку надо передать
+// всем узлам: узел без неё отказывается от кусков, и вычисление завершается с ошибкой.
+// Функции загружаются до начала вычислений.
+int integrand_load(const char *path, FUNC_TABLE *func_id);
+// Компилирует выражение от x (например, "exp(-x*x)*sin(3*x)") и возвращает в func_id
+// его идентификатор. Узлам байт-код выражения отправляется автоматически. Производные
+// для выбора шага оцениваются по значениям выражения, а шаг проверяется удвоением
+// в нескольких точках отрезка. Это оценки, а не границы: особенность уже расстояния
+// между проверяемыми точками (узкий пик) может остаться незамеченной, поэтому
+// точность precision для выражений не гарантируется.
+int integrand_compile(const char *expression, FUNC_TABLE *func_id);
+
+// Кэш результатов
+//==================
+// Кэш хранит ответы на интегралы и на выровненные блоки [i * 2^k, (i + 1) * 2^k),
+// из которых собираются интегралы: пересекающиеся запросы отправляют узлам только
+// непокрытые кэшем блоки. Ответ, посчитанный с точностью precision, годится для
+// запросов с той же или более грубой точностью. При переполнении вытесняются
+// давно не использованные записи.
+
+typedef struct
+{
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	size_t entries;
+	size_t max_entries;
+} CACHE_STATS;
+
+// Включает кэш не более чем на max_entries записей; 0 выключает кэш и освобождает память.
+void info_manager_set_cache(INFO_MANAGER *manager, size_t max_entries);
+void manager_get_cache_stats(INFO_MANAGER *manager, CACHE_STATS *stats);
+
+// Метрики
+//==================
+// Менеджер считает задания, куски, шаги, байты и кадры, глубину очередей и время
+// этапов; узлы присылают вместе с ответом время счёта куска. По гистограммам видно,
+// где теряется время: rtt куска без времени счёта на узле — это сеть и очередь узла,
+// dispatch — замер узлов и разбиение до выдачи первых кусков.
+
+// Гистограммы времени: корзина i считает значения не больше METRICS_BUCKET_MIN_SEC * 2^i,
+// последняя — все остальные.
+#define METRICS_BUCKETS 24U
+#define METRICS_BUCKET_MIN_SEC 1e-6
+
+typedef struct
+{
+	uint64_t count;
+	double sum_sec;
+	uint64_t buckets[METRICS_BUCKETS];
+} METRICS_HISTOGRAM;
+
+typedef struct
+{
+	// Порядковый номер подключения узла.
+	size_t id;
+	bool connected;
+	int n_cores;
+	// Топология узла: логические ЦП, физические ядра, сокеты и узлы NUMA.
+	int n_cpus;
+	int n_physical_cores;
+	int n_packages;
+	int n_numa_nodes;
+	uint64_t chunks;
+	uint64_t steps;
+	// Время счёта кусков на узле: по часам и суммарно по всем потокам узла.
+	double compute_sec;
+	double cpu_sec;
+	// Время от отправки куска до ответа.
+	double rtt_sec;
+	uint64_t bytes_sent;
+	uint64_t bytes_received;
+} WORKER_STATS;
+
+typedef struct
+{
+	uint64_t jobs;
+	uint64_t jobs_failed;
+	uint64_t integrals;
+	uint64_t chunks;
+	// Копии опоздавших и повторно выданных кусков.
+	uint64_t chunk_copies;
+	uint64_t steps;
+	uint64_t evaluations;
+	// Вычислений функции в секунду по всем заданиям.
+	double evals_per_sec;
+	uint64_t bytes_sent;
+	uint64_t bytes_received;
+	uint64_t frames_sent;
+	uint64_t frames_received;
+	uint64_t workers_connected;
+	uint64_t workers_lost;
+	// Текущие значения.
+	uint64_t workers_ready;
+	uint64_t chunks_in_flight;
+	uint64_t steps_queued;
+	uint64_t chunks_retry;
+	uint64_t async_queued;
+	// Подключение узла до получения информации о нём.
+	METRICS_HISTOGRAM handshake;
+	// От начала задания до выдачи узлам первых кусков.
+	METRICS_HISTOGRAM dispatch;
+	METRICS_HISTOGRAM chunk_rtt;
+	METRICS_HISTOGRAM chunk_compute;
+	METRICS_HISTOGRAM job;
+} MANAGER_STATS;
+
+// Снимок счётчиков; безопасен из любого потока, в том числе во время вычисления.
+void manager_get_stats(INFO_MANAGER *manager, MANAGER_STATS *stats);
+// Заполняет до max_stats записей по узлам и возвращает, сколько их всего.
+size_t manager_get_worker_stats(INFO_MANAGER *manager, WORKER_STATS *stats, size_t max_stats);
+// Печатает метрики в текстовом формате Prometheus.
+void manager_write_stats(INFO_MANAGER *manager, FILE *out);
+// Отдаёт метрики по HTTP на addr:port из отдельного потока (GET на любой путь).
+int manager_metrics_listen(INFO_MANAGER *manager, char addr[], char port[]);
+void manager_metrics_stop(INFO_MANAGER *manager);
+
+// Ожидает подключения всех num_nodes узлов и держит соединения открытыми.
+int manager_pool_start(INFO_MANAGER *manager);
+// Считает интеграл на уже подключённых узлах пула.
+int manager_pool_submit(INFO_MANAGER *manager, FUNC_TABLE func_id, double left, double right, double precision, QUAD_RULE rule, double *res_value);
+// Считает пакет интегралов одним заданием: мелкие интегралы упаковываются в общие
+// куски, и узлы не простаивают между интегралами. results[i] — ответ на requests[i].
+int manager_pool_submit_batch(INFO_MANAGER *manager, const INTEGRAL_REQUEST *requests, size_t num_requests, double *results);
+// Завершает сеансы всех узлов пула и закрывает соединения.
+void manager_pool_stop(INFO_MANAGER *manager);
+
+// Если пул запущен, считает на нём; иначе поднимает пул на время одного вычисления.
+// precision — допустимая ошибка формулы на одном шаге (больше нуля); шаг выбирается по оценке производной.
+int get_integral(INFO_MANAGER *manager, FUNC_TABLE func_id, double left, double right, double precision, QUAD_RULE rule, double *res_value);
+//==================
+// Асинхронный интерфейс
+//==================
+// Асинхронные вычисления обслуживает один внутренний поток: все интегралы, поставленные
+// в очередь к моменту, когда пул освободился, считаются одним пакетом. Пока этот поток
+// работает, синхронные вызовы на пуле тоже проходят через него.
+
+typedef struct integral_future INTEGRAL_FUTURE;
+
+// Вызывается из внутреннего потока (или из потока, отменившего вычисление) по его
+// окончании; status — 0 или отрицательный код ошибки. Ждать future из callback нельзя:
+// она считается законченной только после возврата из него.
+typedef void (*INTEGRAL_CALLBACK)(INTEGRAL_FUTURE *future, int status, double value, void *arg);
+
+// Ставит интеграл в очередь на запущенном пуле. callback может быть NULL. Запрос
+// проверяется сразу: ошибка в нём возвращается отсюда, а не через future. Во время
+// manager_pool_stop возвращает -ESHUTDOWN (код из errno.h). Ошибка узла на одном
+// интеграле пакета завершает с ошибкой только его future, остальные досчитываются.
+int get_integral_async(INFO_MANAGER *manager, FUNC_TABLE func_id, double left, double right, double precision, QUAD_RULE rule,
+                       INTEGRAL_CALLBACK callback, void *arg, INTEGRAL_FUTURE **future);
+// 1, если вычисление закончено, иначе 0.
+int integral_future_poll(INTEGRAL_FUTURE *future);
+// Ждёт окончания вычисления и возвращает его код; при успехе записывает ответ в res_value.
+int integral_future_wait(INTEGRAL_FUTURE *future, double *res_value);
+// Отменяет вычисление: ответ будет отброшен с кодом -ECANCEL. 1, если отмена успела, иначе 0.
+int integral_future_cancel(INTEGRAL_FUTURE *future);
+// Освобождает future; незаконченное вычисление отменяется.
+void integral_future_free(INTEGRAL_FUTURE *future);
+// Дескриптор eventfd, который становится читаемым при окончании любого вычисления:
+// его можно добавить в цикл событий приложения. Отрицательный код ошибки, если пул не запущен.
+int manager_async_fd(INFO_MANAGER *manager);
+
+// Как get_integral, но для пакета интегралов.
+int get_integrals_batch(INFO_MANAGER *manager, const INTEGRAL_REQUEST *requests, size_t num_requests, double *results);
\ No newline at end of file
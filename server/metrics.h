@@ -0,0 +1,115 @@
+//==================
+// Метрики
+//==================
+// Счётчики менеджера пишет только поток, в котором идёт цикл событий (вызывающий
+// поток или поток асинхронного интерфейса, но не оба сразу), поэтому обновление —
+// обычные чтение и запись без блокировок и атомарных read-modify-write. Читатель
+// из другого потока видит каждое значение целиком; между собой значения могут
+// расходиться на одно-два события.
+
+typedef _Atomic uint64_t METRIC;
+
+static inline uint64_t metric_get(const METRIC *metric) {
+    return atomic_load_explicit(metric, memory_order_relaxed);
+}
+
+static inline void metric_set(METRIC *metric, uint64_t value) {
+    atomic_store_explicit(metric, value, memory_order_relaxed);
+}
+
+static inline void metric_add(METRIC *metric, uint64_t value) {
+    metric_set(metric, metric_get(metric) + value);
+}
+
+static inline uint64_t metric_sec_to_ns(double sec) {
+    return sec > 0 ? (uint64_t)(sec * 1e9) : 0;
+}
+
+// Гистограмма времени с корзинами METRICS_BUCKET_MIN_SEC * 2^i (см. manager.h).
+typedef struct
+{
+    METRIC count;
+    METRIC sum_ns;
+    METRIC buckets[METRICS_BUCKETS];
+} METRIC_HISTOGRAM;
+
+static void metric_observe(METRIC_HISTOGRAM *histogram, double sec) {
+    unsigned bucket = 0;
+    double bound = METRICS_BUCKET_MIN_SEC;
+    while (bucket + 1 < METRICS_BUCKETS && sec > bound) {
+        bound *= 2;
+        bucket++;
+    }
+    metric_add(&histogram->buckets[bucket], 1);
+    metric_add(&histogram->sum_ns, metric_sec_to_ns(sec));
+    metric_add(&histogram->count, 1);
+}
+
+static void metric_histogram_read(const METRIC_HISTOGRAM *histogram, METRICS_HISTOGRAM *out) {
+    out->count = metric_get(&histogram->count);
+    out->sum_sec = metric_get(&histogram->sum_ns) * 1e-9;
+    for (unsigned bucket = 0; bucket < METRICS_BUCKETS; ++bucket) {
+        out->buckets[bucket] = metric_get(&histogram->buckets[bucket]);
+    }
+}
+
+// Счётчики одного узла. Записи не переиспользуются, поэтому читатель может
+// обходить их без блокировок, даже пока узлы подключаются и отключаются.
+typedef struct
+{
+    METRIC connected;
+    METRIC n_cores;
+    METRIC n_cpus;
+    METRIC n_physical_cores;
+    METRIC n_packages;
+    METRIC n_numa_nodes;
+    METRIC chunks;
+    METRIC steps;
+    METRIC compute_ns;
+    METRIC cpu_ns;
+    METRIC rtt_ns;
+    METRIC bytes_sent;
+    METRIC bytes_received;
+} WORKER_METRICS;
+
+// Сколько узлов за время жизни менеджера получают собственные счётчики;
+// остальные учитываются только в общих.
+#define MAX_WORKER_METRICS 1024U
+
+typedef struct manager_metrics
+{
+    METRIC jobs;
+    METRIC jobs_failed;
+    METRIC integrals;
+    METRIC chunks;
+    METRIC chunk_copies;
+    METRIC steps;
+    METRIC evaluations;
+    METRIC job_ns;
+    METRIC bytes_sent;
+    METRIC bytes_received;
+    METRIC frames_sent;
+    METRIC frames_received;
+    METRIC workers_connected;
+    METRIC workers_lost;
+    METRIC workers_ready;
+    METRIC chunks_in_flight;
+    METRIC steps_queued;
+    METRIC chunks_retry;
+    // Пишется под блокировкой очереди из разных потоков, поэтому атомарный счётчик.
+    METRIC async_queued;
+
+    METRIC_HISTOGRAM handshake;
+    METRIC_HISTOGRAM dispatch;
+    METRIC_HISTOGRAM chunk_rtt;
+    METRIC_HISTOGRAM chunk_compute;
+    METRIC_HISTOGRAM job_time;
+
+    WORKER_METRICS workers[MAX_WORKER_METRICS];
+    METRIC num_workers;
+
+    // Поток, отдающий метрики по HTTP (см. manager_metrics_listen).
+    pthread_t server_thread;
+    int server_fd;
+    int server_stop_fd;
+} MANAGER_METRICS;
@@ -0,0 +1,334 @@
+//============================
+// Узел-ретранслятор
+//============================
+// Для вышестоящего менеджера ретранслятор выглядит как обычный рабочий узел,
+// а для своего поддерева — как менеджер: полученный кусок делится между узлами
+// поддерева, наверх уходит одна частичная сумма. Ретрансляторы вкладываются
+// друг в друга, так что на каждом уровне дерева число соединений ограничено
+// числом непосредственных потомков.
+
+#include "manager.c"
+
+typedef struct
+{
+    // Соединение с вышестоящим менеджером.
+    int parent_fd;
+    struct sockaddr parent_addr;
+    // Время, заявляемое вышестоящему менеджеру, и предел времени на одно задание поддерева.
+    time_t max_time;
+    // Пул узлов поддерева.
+    INFO_MANAGER subtree;
+} INFO_RELAY;
+
+//============================
+// Соединение с вышестоящим менеджером
+//============================
+
+static bool relay_connect_to_parent(INFO_RELAY *relay)
+{
+    relay->parent_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (relay->parent_fd == -1)
+    {
+        fprintf(stderr, "[relay_connect_to_parent] Unable to create socket!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (connect(relay->parent_fd, &relay->parent_addr, sizeof(relay->parent_addr)) == -1)
+    {
+        close(relay->parent_fd);
+        relay->parent_fd = -1;
+        return false;
+    }
+
+    // Ответы уходят наверх по одному, задержка Нейгла здесь только мешает.
+    int setsockopt_arg = 1;
+    if (setsockopt(relay->parent_fd, IPPROTO_TCP, TCP_NODELAY, &setsockopt_arg, sizeof(setsockopt_arg)) == -1)
+    {
+        fprintf(stderr, "[relay_connect_to_parent] Unable to enable TCP_NODELAY socket option\n");
+        exit(EXIT_FAILURE);
+    }
+    return true;
+}
+
+static bool relay_send_frame(INFO_RELAY *relay, uint32_t type, uint64_t request_id, const void *payload, uint32_t length)
+{
+    char buf[sizeof(struct frame_header) + MAX_FRAME_PAYLOAD];
+    struct frame_header hdr = {.type = type, .length = length, .request_id = request_id};
+    memcpy(buf, &hdr, sizeof(hdr));
+    memcpy(buf + sizeof(hdr), payload, length);
+
+    ssize_t bytes_written = send(relay->parent_fd, buf, sizeof(hdr) + length, MSG_NOSIGNAL);
+    return bytes_written == (ssize_t)(sizeof(hdr) + length);
+}
+
+// Принимает кадр целиком. Возвращает false, если соединение закрыто или кадр некорректен.
+static bool relay_recv_frame(INFO_RELAY *relay, struct frame_header *hdr, char *payload)
+{
+    ssize_t bytes_read = recv(relay->parent_fd, hdr, sizeof(*hdr), MSG_WAITALL);
+    if (bytes_read != sizeof(*hdr) || hdr->length > MAX_FRAME_PAYLOAD)
+        return false;
+    if (hdr->length == 0)
+        return true;
+    bytes_read = recv(relay->parent_fd, payload, hdr->length, MSG_WAITALL);
+    return bytes_read == (ssize_t)hdr->length;
+}
+
+//============================
+// Обработка заданий
+//============================
+
+static int relay_check_task(int func_id, int rule)
+{
+    if (integrand_slot(func_id) == -1)
+        return WORKER_EFUNC;
+    if (rule < 0 || rule >= QUAD_RULES)
+        return WORKER_ERULE;
+    return 0;
+}
+
+// Суммарное время счёта, о котором отчитались узлы поддерева.
+static double relay_subtree_cpu_sec(INFO_RELAY *relay)
+{
+    const MANAGER_METRICS *metrics = relay->subtree.metrics;
+    uint64_t cpu_ns = 0;
+    for (uint64_t worker_i = 0; worker_i < metric_get(&metrics->num_workers); ++worker_i)
+        cpu_ns += metric_get(&metrics->workers[worker_i].cpu_ns);
+    return cpu_ns * 1e-9;
+}
+
+// Считает части куска на поддереве ровно с тем шагом, который выбрал вышестоящий
+// менеджер; все части идут одним заданием.
+static bool relay_run_task(INFO_RELAY *relay, const struct worker_data *parts, uint32_t num_parts, struct worker_batch_result *res)
+{
+    res->num_values = num_parts;
+    res->status = 0;
+    res->compute_sec = 0;
+    res->cpu_sec = 0;
+    memset(res->values, 0, num_parts * sizeof(double));
+    for (uint32_t part_i = 0; part_i < num_parts && res->status == 0; ++part_i)
+        res->status = relay_check_task(parts[part_i].func_id, parts[part_i].rule);
+    if (res->status != 0)
+        return true;
+
+    struct timespec start_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+
+    // Поддерево складывает так же, как просил вышестоящий менеджер.
+    JOB job = {.func_id = parts[0].func_id, .rule = parts[0].rule, .results = res->values, .num_results = num_parts,
+               .summation = parts[0].summation == SUMMATION_COMPENSATED ? SUMMATION_COMPENSATED : SUMMATION_NAIVE};
+    for (uint32_t part_i = 0; part_i < num_parts; ++part_i)
+    {
+        const struct worker_data *data = &parts[part_i];
+        if (data->num_steps == 0)
+            continue;
+        double right = data->left + data->step * data->num_steps;
+        queue_push_segment(&job.queue, part_i, data->func_id, data->rule, data->left, right, data->num_steps);
+        // Шаг, пересчитанный из концов отрезка, может разойтись в последнем разряде.
+        job.queue.segments[job.queue.num_segments - 1].step = data->step;
+    }
+    double cpu_sec = relay_subtree_cpu_sec(relay);
+    int rc = manager_run_job(&relay->subtree, &job, &start_time);
+    struct timespec end_time;
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    res->compute_sec = timespec_diff_sec(&start_time, &end_time);
+    res->cpu_sec = relay_subtree_cpu_sec(relay) - cpu_sec;
+    // Отказ узлов поддерева передаём наверх как отказ ретранслятора.
+    if (rc == -EFUNCID || rc == -ERULE)
+    {
+        res->status = rc == -EFUNCID ? WORKER_EFUNC : WORKER_ERULE;
+        return true;
+    }
+    if (rc != 0)
+    {
+        fprintf(stderr, "Subtree failed with code %d\n", rc);
+        return false;
+    }
+    return true;
+}
+
+// Производительность поддерева — сумма производительностей его узлов.
+static void relay_calibrate(INFO_RELAY *relay, const struct calibrate_request *req, struct calibration_result *res)
+{
+    res->steps_per_sec = 0;
+    res->status = relay_check_task(req->func_id, req->rule);
+    if (res->status != 0)
+        return;
+
+    INFO_MANAGER *subtree = &relay->subtree;
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += relay->max_time;
+    manager_calibrate(subtree, req->func_id, req->rule, req->left, req->right, &deadline);
+
+    for (size_t conn_i = 0; conn_i < subtree->num_works; ++conn_i)
+    {
+        WORK_CONNECTION *work = subtree->works[conn_i];
+        if (manager_worker_ready(work))
+            res->steps_per_sec += work->calibrated[integrand_slot(req->func_id)][req->rule];
+    }
+}
+
+static struct node_info relay_node_info(INFO_RELAY *relay)
+{
+    struct node_info info = {.max_worker_time = relay->max_time, .n_cores = 0};
+    for (size_t conn_i = 0; conn_i < relay->subtree.num_works; ++conn_i)
+    {
+        WORK_CONNECTION *work = relay->subtree.works[conn_i];
+        if (!manager_worker_ready(work))
+            continue;
+        // Топология поддерева — сумма топологий его узлов.
+        info.n_cores += work->n_cores;
+        info.n_cpus += work->node.n_cpus;
+        info.n_physical_cores += work->node.n_physical_cores;
+        info.n_packages += work->node.n_packages;
+        info.n_numa_nodes += work->node.n_numa_nodes;
+    }
+    return info;
+}
+
+// Обслуживает вышестоящего менеджера до конца сеанса. Возвращает false при ошибке:
+// тогда соединение закрывается, и менеджер раздаёт куски поддерева другим узлам.
+static bool relay_serve(INFO_RELAY *relay)
+{
+    struct node_info info = relay_node_info(relay);
+    if (!relay_send_frame(relay, FRAME_NODE_INFO, 0, &info, sizeof(info)))
+    {
+        fprintf(stderr, "Unable to send node info to parent\n");
+        return false;
+    }
+
+    char payload[MAX_FRAME_PAYLOAD];
+    struct frame_header hdr;
+    while (relay_recv_frame(relay, &hdr, payload))
+    {
+        switch (hdr.type)
+        {
+        case FRAME_STOP:
+            return true;
+        case FRAME_TASK:
+        case FRAME_TASK_BATCH:
+        {
+            struct worker_data parts[MAX_BATCH_PARTS];
+            struct worker_batch_result res;
+            if (hdr.length == 0 || hdr.length % sizeof(struct worker_data) != 0)
+                return false;
+            if (hdr.type == FRAME_TASK && hdr.length != sizeof(struct worker_data))
+                return false;
+            memcpy(parts, payload, hdr.length);
+            if (!relay_run_task(relay, parts, hdr.length / sizeof(struct worker_data), &res))
+                return false;
+
+            bool sent;
+            if (hdr.type == FRAME_TASK)
+            {
+                struct worker_result single = {.status = res.status, .value = res.values[0], .compute_sec = res.compute_sec,
+                                              .cpu_sec = res.cpu_sec};
+                sent = relay_send_frame(relay, FRAME_RESULT, hdr.request_id, &single, sizeof(single));
+            }
+            else
+            {
+                uint32_t length = offsetof(struct worker_batch_result, values) + res.num_values * sizeof(double);
+                sent = relay_send_frame(relay, FRAME_RESULT_BATCH, hdr.request_id, &res, length);
+            }
+            if (!sent)
+                return false;
+            break;
+        }
+        case FRAME_CALIBRATE:
+        {
+            struct calibrate_request req;
+            struct calibration_result res;
+            if (hdr.length != sizeof(req))
+                return false;
+            memcpy(&req, payload, sizeof(req));
+            relay_calibrate(relay, &req, &res);
+            if (!relay_send_frame(relay, FRAME_CALIBRATION, hdr.request_id, &res, sizeof(res)))
+                return false;
+            break;
+        }
+        case FRAME_EXPR:
+        {
+            // Выражение запоминается под идентификатором вышестоящего менеджера,
+            // узлам поддерева оно уйдёт вместе с первым заданием.
+            struct expr_program program;
+            if (hdr.length != sizeof(program))
+                return false;
+            memcpy(&program, payload, sizeof(program));
+            if (!expr_program_valid(&program) || !integrand_define_expr(&program))
+                fprintf(stderr, "Rejected expression %#x from parent\n", (unsigned)program.func_id);
+            break;
+        }
+        default:
+            fprintf(stderr, "Unexpected frame type %u from parent\n", hdr.type);
+            return false;
+        }
+    }
+    // Вышестоящий менеджер закрыл соединение — считаем это окончанием сеанса.
+    return true;
+}
+
+//============================
+// Основная процедура ретранслятора.
+//============================
+
+int main(int argc, char** argv)
+{
+    if (argc < 7)
+    {
+        fprintf(stderr, "Usage: relay <listen_node> <listen_service> <num_workers> <parent_node> <parent_service> <max_time> [integrand.so ...]\n");
+        exit(EXIT_FAILURE);
+    }
+
+    char *endptr = argv[3];
+    long num_workers = strtol(argv[3], &endptr, 10);
+    if (*argv[3] == '\0' || *endptr != '\0' || num_workers <= 0)
+    {
+        fprintf(stderr, "Unable to parse number of workers!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    endptr = argv[6];
+    long max_time = strtol(argv[6], &endptr, 10);
+    if (*argv[6] == '\0' || *endptr != '\0' || max_time <= 0)
+    {
+        fprintf(stderr, "Unable to parse time!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Ретранслятор должен знать те же подключаемые функции, что и его поддерево.
+    for (int arg_i = 7; arg_i < argc; ++arg_i)
+    {
+        FUNC_TABLE func_id;
+        if (integrand_load(argv[arg_i], &func_id) != 0)
+            exit(EXIT_FAILURE);
+    }
+
+    INFO_RELAY relay = {.parent_fd = -1, .max_time = max_time};
+    struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *res;
+    int status = getaddrinfo(argv[4], argv[5], &hints, &res);
+    if (status != 0)
+    {
+        fprintf(stderr, "getaddrinfo error: %s\n", gai_strerror(status));
+        exit(EXIT_FAILURE);
+    }
+    relay.parent_addr = *res->ai_addr;
+    freeaddrinfo(res);
+
+    // Сначала собираем поддерево: вышестоящему менеджеру сообщается его суммарная мощность.
+    info_manager_init(&relay.subtree, argv[1], argv[2], max_time, num_workers);
+    manager_pool_start(&relay.subtree);
+
+    while (!relay_connect_to_parent(&relay))
+    {
+        // Ожидаем, пока менеджер проснётся.
+        sleep(1U);
+
+        printf("Wait for parent to start\n");
+    }
+
+    bool success = relay_serve(&relay);
+    close(relay.parent_fd);
+    manager_pool_stop(&relay.subtree);
+    return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,223 @@
+//============================
+// Общее для тестов
+//============================
+// Тесты, как и нагрузочный тест, собираются вместе с исходниками менеджера и
+// поднимают локальные рабочие узлы на петлевом интерфейсе. Ответы сверяются с
+// интегралами, известными аналитически.
+//
+// Аргументы теста: путь к рабочему узлу и (необязательно) к ретранслятору.
+// Служебный вывод библиотеки и узлов отбрасывается, итоги проверок идут в stderr.
+// Код возврата — EXIT_FAILURE, если не прошла хотя бы одна проверка.
+
+#include <float.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <sys/wait.h>
+
+#define TEST_ADDR "127.0.0.1"
+#define TEST_MAX_TIME 30
+#define TEST_MAX_WORKERS 8U
+// Тест, который не уложился в это время, считается зависшим.
+#define TEST_ALARM_SEC 120U
+// Тестовая подключаемая функция x^3 (test_plugin.c); тесты запускаются из каталога server.
+#define TEST_PLUGIN_PATH "build/test_plugin.so"
+
+typedef struct
+{
+    INFO_MANAGER manager;
+    char port[16];
+    pid_t pids[TEST_MAX_WORKERS];
+    long num_workers;
+} TEST_POOL;
+
+static const char *test_worker_path;
+static const char *test_relay_path;
+static int test_next_port;
+static unsigned test_failures;
+
+static inline void test_check(bool ok, const char *file, int line, const char *format, ...)
+{
+    if (ok)
+        fprintf(stderr, "ok    ");
+    else
+        fprintf(stderr, "FAIL  %s:%d: ", file, line);
+    va_list ap;
+    va_start(ap, format);
+    vfprintf(stderr, format, ap);
+    va_end(ap);
+    fputc('\n', stderr);
+    test_failures += !ok;
+}
+
+#define TEST_CHECK(ok, ...) test_check((ok), __FILE__, __LINE__, __VA_ARGS__)
+
+static inline void test_init(int argc, char **argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <worker> [<relay>]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    test_worker_path = argv[1];
+    test_relay_path = argc > 2 ? argv[2] : NULL;
+    // Порты от номера процесса: соединения прошлых запусков могут ещё не закрыться.
+    test_next_port = 30000 + getpid() % 20000;
+
+    int null_fd = open("/dev/null", O_WRONLY);
+    if (null_fd == -1 || dup2(null_fd, STDOUT_FILENO) == -1)
+    {
+        fprintf(stderr, "Unable to redirect stdout\n");
+        exit(EXIT_FAILURE);
+    }
+    close(null_fd);
+    // Узел, оборвавший соединение, не должен завершать тест сигналом.
+    signal(SIGPIPE, SIG_IGN);
+    alarm(TEST_ALARM_SEC);
+}
+
+static inline int test_finish(void)
+{
+    if (test_failures != 0)
+    {
+        fprintf(stderr, "%u checks failed\n", test_failures);
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+//============================
+// Узлы
+//============================
+
+// Запускает программу с аргументами argv (argv[0] — путь); NULL в конце обязателен.
+static inline pid_t test_spawn(char *const argv[])
+{
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        fprintf(stderr, "Unable to fork: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0)
+    {
+        execv(argv[0], argv);
+        fprintf(stderr, "Unable to exec %s: %s\n", argv[0], strerror(errno));
+        _exit(EXIT_FAILURE);
+    }
+    return pid;
+}
+
+// Рабочий узел с cores потоками, подключающийся к port; plugin может быть NULL.
+static inline pid_t test_spawn_worker(const char *port, long cores, const char *plugin)
+{
+    char cores_arg[32], time_arg[32];
+    snprintf(cores_arg, sizeof(cores_arg), "%ld", cores);
+    snprintf(time_arg, sizeof(time_arg), "%d", TEST_MAX_TIME);
+    char *argv[] = {(char *)test_worker_path, TEST_ADDR, (char *)port, cores_arg, time_arg, (char *)plugin, NULL};
+    return test_spawn(argv);
+}
+
+static inline bool test_reap(pid_t pid)
+{
+    int status;
+    return waitpid(pid, &status, 0) != -1 && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static inline void test_pool_init(TEST_POOL *pool, long num_workers)
+{
+    if (num_workers > (long)TEST_MAX_WORKERS)
+    {
+        fprintf(stderr, "At most %u workers per pool\n", TEST_MAX_WORKERS);
+        exit(EXIT_FAILURE);
+    }
+    snprintf(pool->port, sizeof(pool->port), "%d", test_next_port++);
+    pool->num_workers = num_workers;
+    info_manager_init(&pool->manager, TEST_ADDR, pool->port, TEST_MAX_TIME, (int)num_workers);
+}
+
+// Запускает узлы пула и ждёт их подключения; настройки менеджера задаются до этого.
+static inline void test_pool_start(TEST_POOL *pool, long cores, const char *plugin)
+{
+    for (long worker_i = 0; worker_i < pool->num_workers; ++worker_i)
+        pool->pids[worker_i] = test_spawn_worker(pool->port, cores, plugin);
+    if (manager_pool_start(&pool->manager) != 0)
+    {
+        fprintf(stderr, "Unable to start pool of %ld workers\n", pool->num_workers);
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Запускает пул, в котором к менеджеру подключён один ретранслятор, а к нему —
+// num_workers узлов с cores потоками; plugin получают и ретранслятор, и узлы.
+// Пул инициализируется test_pool_init(pool, 1).
+static inline void test_relay_pool_start(TEST_POOL *pool, long num_workers, long cores, const char *plugin)
+{
+    if (test_relay_path == NULL || 1 + num_workers > (long)TEST_MAX_WORKERS)
+    {
+        fprintf(stderr, "Relay pool needs a relay path and at most %u processes\n", TEST_MAX_WORKERS);
+        exit(EXIT_FAILURE);
+    }
+    char relay_port[16], workers_arg[32], time_arg[32];
+    snprintf(relay_port, sizeof(relay_port), "%d", test_next_port++);
+    snprintf(workers_arg, sizeof(workers_arg), "%ld", num_workers);
+    snprintf(time_arg, sizeof(time_arg), "%d", TEST_MAX_TIME);
+    char *argv[] = {(char *)test_relay_path, TEST_ADDR, relay_port, workers_arg, TEST_ADDR, pool->port, time_arg,
+                    (char *)plugin, NULL};
+    pool->pids[0] = test_spawn(argv);
+    for (long worker_i = 0; worker_i < num_workers; ++worker_i)
+        pool->pids[1 + worker_i] = test_spawn_worker(relay_port, cores, plugin);
+    pool->num_workers = 1 + num_workers;
+    if (manager_pool_start(&pool->manager) != 0)
+    {
+        fprintf(stderr, "Unable to start pool behind a relay\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+// Останавливает пул; узлы, убитые тестом, завершаются не чисто, и это не ошибка.
+static inline void test_pool_stop(TEST_POOL *pool)
+{
+    manager_pool_stop(&pool->manager);
+    for (long worker_i = 0; worker_i < pool->num_workers; ++worker_i)
+    {
+        if (pool->pids[worker_i] > 0 && !test_reap(pool->pids[worker_i]))
+            fprintf(stderr, "Worker %d did not exit cleanly\n", (int)pool->pids[worker_i]);
+    }
+}
+
+//============================
+// Ответы
+//============================
+
+// Первообразные встроенных функций.
+static inline double test_exact(FUNC_TABLE func_id, double left, double right)
+{
+    switch (func_id)
+    {
+    case EXP:
+        return exp(right) - exp(left);
+    case SIN:
+        return cos(left) - cos(right);
+    case SQR:
+        return (right * right * right - left * left * left) / 3;
+    default:
+        return NAN;
+    }
+}
+
+// Сколько шагов менеджер выдаст узлам на этот интеграл при текущих настройках.
+static inline uint64_t test_count_steps(INFO_MANAGER *manager, const INTEGRAL_REQUEST *request)
+{
+    JOB job = {0};
+    job_push_integral(manager, &job, 0, request);
+    uint64_t num_steps = job.queue.num_count;
+    job_free(&job);
+    return num_steps;
+}
+
+// Допустимая ошибка интеграла: precision ограничивает ошибку формулы на одном шаге,
+// к ней добавляется ошибка округления при сложении num_steps слагаемых порядка scale.
+static inline double test_tolerance(uint64_t num_steps, double precision, double scale)
+{
+    return num_steps * (precision + 4 * DBL_EPSILON * fabs(scale));
+}
@@ -0,0 +1,68 @@
+//============================
+// Тест адаптивного разбиения
+//============================
+// Адаптивное разбиение выключено по умолчанию. Включённое, оно должно выдавать
+// не больше шагов, чем равномерное, и держать ту же точность: ошибка формулы
+// на каждом шаге не больше precision.
+
+#include "manager.c"
+#include "test-common.h"
+
+#define TEST_PRECISION 1e-10
+
+static const char *const test_rule_names[QUAD_RULES] = {
+    [RULE_MIDPOINT] = "midpoint",
+    [RULE_SIMPSON]  = "simpson",
+    [RULE_GAUSS2]   = "gauss2",
+    [RULE_GAUSS3]   = "gauss3",
+    [RULE_GAUSS4]   = "gauss4",
+};
+
+int main(int argc, char **argv)
+{
+    test_init(argc, argv);
+
+    TEST_POOL pool;
+    test_pool_init(&pool, 2);
+    INFO_MANAGER *manager = &pool.manager;
+    TEST_CHECK(!manager->adaptive, "adaptive splitting is off by default");
+    test_pool_start(&pool, 2, NULL);
+
+    // Отрезки, на которых производные сильно меняются: у EXP — на порядки.
+    static const INTEGRAL_REQUEST cases[] = {
+        {.func_id = EXP, .left = 0, .right = 10},
+        {.func_id = SIN, .left = 0, .right = 10},
+        {.func_id = SIN, .left = 1, .right = 1.5},
+        {.func_id = SQR, .left = -3, .right = 5},
+    };
+    static const char *const func_names[NOT_SUPPORT] = {[EXP] = "exp", [SIN] = "sin", [SQR] = "sqr"};
+    for (size_t case_i = 0; case_i < sizeof(cases) / sizeof(cases[0]); ++case_i)
+    {
+        for (QUAD_RULE rule = 0; rule < QUAD_RULES; ++rule)
+        {
+            INTEGRAL_REQUEST request = cases[case_i];
+            request.rule = rule;
+            request.precision = TEST_PRECISION;
+            double exact = test_exact(request.func_id, request.left, request.right);
+
+            info_manager_set_adaptive(manager, false);
+            uint64_t uniform_steps = test_count_steps(manager, &request);
+            info_manager_set_adaptive(manager, true);
+            uint64_t adaptive_steps = test_count_steps(manager, &request);
+
+            double value = 0;
+            int rc = manager_pool_submit(manager, request.func_id, request.left, request.right, request.precision, rule, &value);
+            double error = fabs(value - exact);
+            double tolerance = test_tolerance(adaptive_steps, request.precision, exact);
+            TEST_CHECK(rc == 0 && error <= tolerance, "%s on [%g, %g], %s: error %.3g, allowed %.3g over %lu steps (rc %d)",
+                       func_names[request.func_id], request.left, request.right, test_rule_names[rule], error, tolerance,
+                       adaptive_steps, rc);
+            TEST_CHECK(adaptive_steps <= uniform_steps, "%s on [%g, %g], %s: %lu adaptive steps, %lu uniform",
+                       func_names[request.func_id], request.left, request.right, test_rule_names[rule], adaptive_steps,
+                       uniform_steps);
+        }
+    }
+
+    test_pool_stop(&pool);
+    return test_finish();
+}
@@ -0,0 +1,239 @@
+//============================
+// Тест асинхронного интерфейса
+//============================
+// Future, callback и eventfd на пуле из двух узлов; отмена ещё не начатого
+// вычисления; проверка запросов при постановке в очередь. Узлы запускаются без
+// тестовой подключаемой функции, которую знает менеджер: отказ узлов считать её
+// должен доставаться только её интегралу, а не всему пакету. Остановка пула
+// завершает недосчитанные вычисления и новые не принимает.
+
+#include "manager.c"
+#include "test-common.h"
+
+#define TEST_PRECISION 1e-10
+#define TEST_NUM_FUTURES 8U
+// С такой точностью EXP на [0, 10] считается заметное время: десятки миллионов шагов.
+#define TEST_LONG_PRECISION 1e-16
+
+typedef struct
+{
+    atomic_uint calls;
+    // Код, с которым get_integral_async отказал, будучи вызванным из callback.
+    int submit_rc;
+    INFO_MANAGER *manager;
+} CALLBACK_STATE;
+
+static void count_callback(INTEGRAL_FUTURE *future, int status, double value, void *arg)
+{
+    (void)future;
+    (void)status;
+    (void)value;
+    CALLBACK_STATE *state = arg;
+    atomic_fetch_add(&state->calls, 1);
+}
+
+// Пытается поставить новое вычисление из внутреннего потока во время остановки пула.
+static void resubmit_callback(INTEGRAL_FUTURE *future, int status, double value, void *arg)
+{
+    (void)future;
+    (void)value;
+    CALLBACK_STATE *state = arg;
+    if (status == -ESHUTDOWN)
+    {
+        INTEGRAL_FUTURE *next = NULL;
+        state->submit_rc = get_integral_async(state->manager, SIN, 0, 1, TEST_PRECISION, RULE_SIMPSON, NULL, NULL, &next);
+        integral_future_free(next);
+    }
+    atomic_fetch_add(&state->calls, 1);
+}
+
+static FUTURE_STATE test_future_state(INTEGRAL_FUTURE *future)
+{
+    pthread_mutex_lock(&future->loop->lock);
+    FUTURE_STATE state = future->state;
+    pthread_mutex_unlock(&future->loop->lock);
+    return state;
+}
+
+// Короткие интегралы попадают в один кусок; узлы не знают cube, и кусок
+// делится, чтобы отказ достался только её интегралу.
+static void test_batch_isolation(INFO_MANAGER *manager, FUNC_TABLE cube)
+{
+    const INTEGRAL_REQUEST requests[] = {
+        {.func_id = EXP, .rule = RULE_SIMPSON, .left = 0, .right = 1, .precision = 1e-8},
+        {.func_id = cube, .rule = RULE_SIMPSON, .left = 0, .right = 2, .precision = 1e-8},
+        {.func_id = SIN, .rule = RULE_SIMPSON, .left = 0, .right = 1, .precision = 1e-8},
+        {.func_id = SQR, .rule = RULE_SIMPSON, .left = 0, .right = 2, .precision = 1e-8},
+    };
+    const size_t num_requests = sizeof(requests) / sizeof(requests[0]);
+    for (int cached = 0; cached < 2; ++cached)
+    {
+        info_manager_set_cache(manager, cached ? 64 : 0);
+        double results[sizeof(requests) / sizeof(requests[0])];
+        int statuses[sizeof(requests) / sizeof(requests[0])];
+        int rc = manager_run_batch(manager, requests, num_requests, results, statuses);
+        TEST_CHECK(rc == 0, "batch with an unknown function runs (rc %d, cache %d)", rc, cached);
+        for (size_t request_i = 0; request_i < num_requests; ++request_i)
+        {
+            const INTEGRAL_REQUEST *request = &requests[request_i];
+            if (request->func_id == cube)
+            {
+                TEST_CHECK(statuses[request_i] == -EFUNCID, "integral %zu fails alone (status %d, cache %d)", request_i,
+                           statuses[request_i], cached);
+                continue;
+            }
+            double exact = test_exact(request->func_id, request->left, request->right);
+            double tolerance = test_tolerance(test_count_steps(manager, request), request->precision, exact);
+            TEST_CHECK(statuses[request_i] == 0 && fabs(results[request_i] - exact) <= tolerance,
+                       "integral %zu is %.17g, expected %.17g (status %d, cache %d)", request_i, results[request_i], exact,
+                       statuses[request_i], cached);
+        }
+        // Синхронный вызов возвращает первую ошибку пакета.
+        rc = manager_pool_submit_batch(manager, requests, num_requests, results);
+        TEST_CHECK(rc == -EFUNCID, "synchronous batch reports the failure (rc %d, cache %d)", rc, cached);
+    }
+    info_manager_set_cache(manager, 0);
+}
+
+static void test_futures(INFO_MANAGER *manager, FUNC_TABLE cube)
+{
+    int event_fd = manager_async_fd(manager);
+    TEST_CHECK(event_fd >= 0, "async eventfd is available (%d)", event_fd);
+
+    CALLBACK_STATE state = {0};
+    INTEGRAL_FUTURE *futures[TEST_NUM_FUTURES];
+    double lefts[TEST_NUM_FUTURES];
+    for (unsigned future_i = 0; future_i < TEST_NUM_FUTURES; ++future_i)
+    {
+        lefts[future_i] = -1.0 * future_i;
+        FUNC_TABLE func_id = future_i % 2 == 0 ? EXP : SIN;
+        int rc = get_integral_async(manager, func_id, lefts[future_i], 2, TEST_PRECISION, RULE_GAUSS3, count_callback, &state,
+                                    &futures[future_i]);
+        TEST_CHECK(rc == 0, "future %u is queued (rc %d)", future_i, rc);
+    }
+    // Интеграл, который узлы не могут посчитать, в том же пакете.
+    INTEGRAL_FUTURE *failing;
+    int rc = get_integral_async(manager, cube, 0, 1, TEST_PRECISION, RULE_GAUSS3, count_callback, &state, &failing);
+    TEST_CHECK(rc == 0, "future of an unknown function is queued (rc %d)", rc);
+
+    for (unsigned future_i = 0; future_i < TEST_NUM_FUTURES; ++future_i)
+    {
+        double value = 0;
+        FUNC_TABLE func_id = future_i % 2 == 0 ? EXP : SIN;
+        INTEGRAL_REQUEST request = {.func_id = func_id, .rule = RULE_GAUSS3, .left = lefts[future_i], .right = 2,
+                                    .precision = TEST_PRECISION};
+        double exact = test_exact(func_id, lefts[future_i], 2);
+        double tolerance = test_tolerance(test_count_steps(manager, &request), TEST_PRECISION, exact);
+        int status = integral_future_wait(futures[future_i], &value);
+        TEST_CHECK(status == 0 && fabs(value - exact) <= tolerance, "future %u is %.17g, expected %.17g (status %d)", future_i,
+                   value, exact, status);
+        TEST_CHECK(integral_future_poll(futures[future_i]) == 1, "future %u polls as done", future_i);
+        integral_future_free(futures[future_i]);
+    }
+    int status = integral_future_wait(failing, NULL);
+    TEST_CHECK(status == -EFUNCID, "unknown function fails only its own future (status %d)", status);
+    integral_future_free(failing);
+    TEST_CHECK(atomic_load(&state.calls) == TEST_NUM_FUTURES + 1, "every callback ran (%u)", atomic_load(&state.calls));
+
+    struct pollfd pfd = {.fd = event_fd, .events = POLLIN};
+    TEST_CHECK(poll(&pfd, 1, 0) == 1, "eventfd is readable after completions");
+    uint64_t count;
+    TEST_CHECK(read(event_fd, &count, sizeof(count)) == sizeof(count) && count != 0, "eventfd counts completions");
+
+    // Синхронный пакет через поток асинхронного интерфейса.
+    INTEGRAL_REQUEST batch[] = {
+        {.func_id = SQR, .rule = RULE_MIDPOINT, .left = -1, .right = 3, .precision = TEST_PRECISION},
+        {.func_id = cube, .rule = RULE_MIDPOINT, .left = -1, .right = 3, .precision = TEST_PRECISION},
+    };
+    double results[2];
+    rc = manager_pool_submit_batch(manager, batch, 2, results);
+    TEST_CHECK(rc == -EFUNCID, "synchronous batch through the async loop reports the failure (rc %d)", rc);
+}
+
+static void test_invalid(INFO_MANAGER *manager)
+{
+    INTEGRAL_FUTURE *future = NULL;
+    int rc = get_integral_async(manager, SIN, 0, 1, TEST_PRECISION, (QUAD_RULE)99, NULL, NULL, &future);
+    TEST_CHECK(rc == -ERULE && future == NULL, "unknown rule is rejected at enqueue (rc %d)", rc);
+    rc = get_integral_async(manager, (FUNC_TABLE)12345, 0, 1, TEST_PRECISION, RULE_MIDPOINT, NULL, NULL, &future);
+    TEST_CHECK(rc == -EFUNCID && future == NULL, "unknown function id is rejected at enqueue (rc %d)", rc);
+    rc = get_integral_async(manager, SIN, 1, 0, TEST_PRECISION, RULE_MIDPOINT, NULL, NULL, &future);
+    TEST_CHECK(rc == -EVALUE && future == NULL, "reversed bounds are rejected at enqueue (rc %d)", rc);
+    rc = get_integral_async(manager, SIN, 0, 1, 0, RULE_MIDPOINT, NULL, NULL, &future);
+    TEST_CHECK(rc == -EVALUE && future == NULL, "zero precision is rejected at enqueue (rc %d)", rc);
+    rc = get_integral_async(manager, SIN, 0, INFINITY, TEST_PRECISION, RULE_MIDPOINT, NULL, NULL, &future);
+    TEST_CHECK(rc == -EVALUE && future == NULL, "infinite bound is rejected at enqueue (rc %d)", rc);
+}
+
+// Пока считается длинный интеграл, следующий ждёт в очереди, и его можно отменить.
+static void test_cancel(INFO_MANAGER *manager)
+{
+    INTEGRAL_FUTURE *running, *pending;
+    int rc = get_integral_async(manager, EXP, 0, 10, TEST_LONG_PRECISION, RULE_MIDPOINT, NULL, NULL, &running);
+    while (rc == 0 && test_future_state(running) == FUTURE_PENDING)
+        sched_yield();
+    rc = rc != 0 ? rc : get_integral_async(manager, SIN, 0, 1, TEST_PRECISION, RULE_MIDPOINT, NULL, NULL, &pending);
+    TEST_CHECK(rc == 0, "futures are queued (rc %d)", rc);
+    if (rc != 0)
+        return;
+    TEST_CHECK(integral_future_cancel(pending) == 1, "pending future is cancelled");
+    int status = integral_future_wait(pending, NULL);
+    TEST_CHECK(status == -ECANCEL, "cancelled future reports -ECANCEL (status %d)", status);
+    TEST_CHECK(integral_future_cancel(pending) == 0, "finished future cannot be cancelled");
+    double value;
+    status = integral_future_wait(running, &value);
+    TEST_CHECK(status == 0, "running future is not affected (status %d)", status);
+    integral_future_free(pending);
+    integral_future_free(running);
+}
+
+// Вычисление, стоящее в очереди за длинным, остановка пула завершает с -ESHUTDOWN;
+// новые вычисления в это время, в том числе из callback, не принимаются.
+static void test_shutdown(TEST_POOL *pool)
+{
+    INFO_MANAGER *manager = &pool->manager;
+    CALLBACK_STATE state = {.manager = manager};
+    INTEGRAL_FUTURE *running, *queued;
+    int rc = get_integral_async(manager, EXP, 0, 10, TEST_LONG_PRECISION, RULE_MIDPOINT, NULL, NULL, &running);
+    while (rc == 0 && test_future_state(running) == FUTURE_PENDING)
+        sched_yield();
+    rc = rc != 0 ? rc : get_integral_async(manager, SIN, 0, 1, TEST_PRECISION, RULE_MIDPOINT, resubmit_callback, &state, &queued);
+    TEST_CHECK(rc == 0, "futures are queued before stop (rc %d)", rc);
+    if (rc != 0)
+        return;
+
+    test_pool_stop(pool);
+    int status = integral_future_wait(running, NULL);
+    TEST_CHECK(status == 0, "running future completes during stop (status %d)", status);
+    status = integral_future_wait(queued, NULL);
+    TEST_CHECK(status == -ESHUTDOWN, "queued future reports -ESHUTDOWN (status %d)", status);
+    TEST_CHECK(atomic_load(&state.calls) == 1 && state.submit_rc == -ESHUTDOWN,
+               "enqueue during stop returns -ESHUTDOWN (rc %d)", state.submit_rc);
+    INTEGRAL_FUTURE *future = NULL;
+    rc = get_integral_async(manager, SIN, 0, 1, TEST_PRECISION, RULE_MIDPOINT, NULL, NULL, &future);
+    TEST_CHECK(rc == -EPOOL && future == NULL, "enqueue after stop returns -EPOOL (rc %d)", rc);
+    TEST_CHECK(!manager->async_stopping, "stopped pool can be started again");
+    integral_future_free(queued);
+    integral_future_free(running);
+}
+
+int main(int argc, char **argv)
+{
+    test_init(argc, argv);
+
+    FUNC_TABLE cube;
+    int rc = integrand_load(TEST_PLUGIN_PATH, &cube);
+    TEST_CHECK(rc == 0, "test plugin loads on the manager (rc %d)", rc);
+    if (rc != 0)
+        return test_finish();
+
+    TEST_POOL pool;
+    test_pool_init(&pool, 2);
+    test_pool_start(&pool, 1, NULL);
+    test_batch_isolation(&pool.manager, cube);
+    test_futures(&pool.manager, cube);
+    test_invalid(&pool.manager);
+    test_cancel(&pool.manager);
+    test_shutdown(&pool);
+    return test_finish();
+}
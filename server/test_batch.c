@@ -0,0 +1,102 @@
+//============================
+// Тест пакетного интерфейса
+//============================
+// get_integrals_batch сам поднимает пул, считает тысячу разнородных интегралов
+// (функции, формулы, отрезки, точности, пустые отрезки) и останавливает пул.
+// Ответы сверяются с аналитическими; короткие интегралы должны упаковываться
+// в общие куски. Ошибка в любом запросе отклоняет пакет до раздачи.
+
+#include "manager.c"
+#include "test-common.h"
+
+#define NUM_REQUESTS 1000U
+
+static void make_requests(INTEGRAL_REQUEST *requests)
+{
+    static const double precisions[] = {1e-6, 1e-9, 1e-12};
+    for (size_t request_i = 0; request_i < NUM_REQUESTS; ++request_i)
+    {
+        double left = -5 + 0.01 * request_i;
+        // Каждый десятый отрезок пустой, остальные — разной длины.
+        double width = request_i % 10 == 0 ? 0 : 0.05 * (request_i % 7 + 1);
+        requests[request_i] = (INTEGRAL_REQUEST){
+            .func_id = (FUNC_TABLE)(request_i % NOT_SUPPORT),
+            .rule = (QUAD_RULE)(request_i / NOT_SUPPORT % QUAD_RULES),
+            .left = left,
+            .right = left + width,
+            .precision = precisions[request_i % 3],
+        };
+    }
+}
+
+static size_t count_wrong(INFO_MANAGER *manager, const INTEGRAL_REQUEST *requests, const double *results)
+{
+    size_t num_wrong = 0;
+    for (size_t request_i = 0; request_i < NUM_REQUESTS; ++request_i)
+    {
+        const INTEGRAL_REQUEST *request = &requests[request_i];
+        double exact = test_exact(request->func_id, request->left, request->right);
+        double tolerance = test_tolerance(test_count_steps(manager, request), request->precision, exact);
+        if (!(fabs(results[request_i] - exact) <= tolerance))
+        {
+            if (num_wrong == 0)
+                fprintf(stderr, "      request %zu: %.17g, expected %.17g\n", request_i, results[request_i], exact);
+            num_wrong++;
+        }
+    }
+    return num_wrong;
+}
+
+int main(int argc, char **argv)
+{
+    test_init(argc, argv);
+    static INTEGRAL_REQUEST requests[NUM_REQUESTS];
+    static double results[NUM_REQUESTS];
+    make_requests(requests);
+
+    // Пакет без запущенного пула: пул поднимается на время вызова.
+    TEST_POOL pool;
+    test_pool_init(&pool, 2);
+    for (long worker_i = 0; worker_i < pool.num_workers; ++worker_i)
+        pool.pids[worker_i] = test_spawn_worker(pool.port, 1, NULL);
+    int rc = get_integrals_batch(&pool.manager, requests, NUM_REQUESTS, results);
+    TEST_CHECK(rc == 0, "get_integrals_batch computes %u integrals (rc %d)", NUM_REQUESTS, rc);
+    size_t num_wrong = rc == 0 ? count_wrong(&pool.manager, requests, results) : NUM_REQUESTS;
+    TEST_CHECK(num_wrong == 0, "%zu of %u integrals are wrong", num_wrong, NUM_REQUESTS);
+    MANAGER_STATS stats;
+    manager_get_stats(&pool.manager, &stats);
+    TEST_CHECK(stats.jobs == 1 && stats.integrals == NUM_REQUESTS, "one job for the whole batch (%lu jobs, %lu integrals)",
+               stats.jobs, stats.integrals);
+    TEST_CHECK(stats.chunks < NUM_REQUESTS / 2, "short integrals share chunks (%lu chunks)", stats.chunks);
+    TEST_CHECK(!pool.manager.pool_started, "pool is stopped after the call");
+    for (long worker_i = 0; worker_i < pool.num_workers; ++worker_i)
+        TEST_CHECK(test_reap(pool.pids[worker_i]), "worker %ld exits after the call", worker_i);
+
+    // Проверки запросов — до раздачи и на запущенном пуле.
+    test_pool_init(&pool, 2);
+    test_pool_start(&pool, 1, NULL);
+    rc = manager_pool_submit_batch(&pool.manager, requests, 0, NULL);
+    TEST_CHECK(rc == 0, "empty batch succeeds (rc %d)", rc);
+    rc = manager_pool_submit_batch(&pool.manager, requests, NUM_REQUESTS, NULL);
+    TEST_CHECK(rc == -EVALUE, "missing results are rejected (rc %d)", rc);
+    manager_get_stats(&pool.manager, &stats);
+    uint64_t jobs_before = stats.jobs;
+    INTEGRAL_REQUEST bad = requests[NUM_REQUESTS / 2];
+    requests[NUM_REQUESTS / 2].rule = QUAD_RULES;
+    rc = manager_pool_submit_batch(&pool.manager, requests, NUM_REQUESTS, results);
+    TEST_CHECK(rc == -ERULE, "unknown rule in the middle rejects the batch (rc %d)", rc);
+    requests[NUM_REQUESTS / 2] = bad;
+    requests[NUM_REQUESTS - 1].left = requests[NUM_REQUESTS - 1].right + 1;
+    rc = manager_pool_submit_batch(&pool.manager, requests, NUM_REQUESTS, results);
+    TEST_CHECK(rc == -EVALUE, "reversed bounds at the end reject the batch (rc %d)", rc);
+    manager_get_stats(&pool.manager, &stats);
+    TEST_CHECK(stats.jobs == jobs_before, "rejected batches dispatch nothing (%lu jobs)", stats.jobs - jobs_before);
+
+    // Тот же пакет на запущенном пуле.
+    make_requests(requests);
+    rc = manager_pool_submit_batch(&pool.manager, requests, NUM_REQUESTS, results);
+    num_wrong = rc == 0 ? count_wrong(&pool.manager, requests, results) : NUM_REQUESTS;
+    TEST_CHECK(rc == 0 && num_wrong == 0, "batch on a started pool: %zu wrong (rc %d)", num_wrong, rc);
+    test_pool_stop(&pool);
+    return test_finish();
+}
@@ -0,0 +1,111 @@
+//============================
+// Тест кэша результатов
+//============================
+// Повторный интеграл берётся из кэша без задания, в том числе при более грубой
+// точности; более точный запрос считается заново. Пересекающийся отрезок
+// отправляет узлам только непокрытые блоки. Переполненный кэш вытесняет давно
+// не использованные записи, а интеграл, целиком лежащий в кэше, считается и
+// без запущенного пула. Все ответы сверяются с аналитическими.
+
+#include "manager.c"
+#include "test-common.h"
+
+#define TEST_PRECISION 1e-10
+// Части интеграла в кэше (голова, блоки, хвост) добавляют до двух шагов каждая.
+#define PIECE_STEPS_SLACK 64U
+
+typedef struct
+{
+    MANAGER_STATS manager;
+    CACHE_STATS cache;
+} SNAPSHOT;
+
+static SNAPSHOT snapshot(INFO_MANAGER *manager)
+{
+    SNAPSHOT s;
+    manager_get_stats(manager, &s.manager);
+    manager_get_cache_stats(manager, &s.cache);
+    return s;
+}
+
+static double check_integral(INFO_MANAGER *manager, const char *what, double left, double right, double precision)
+{
+    double value = 0;
+    int rc = get_integral(manager, EXP, left, right, precision, RULE_SIMPSON, &value);
+    INTEGRAL_REQUEST request = {.func_id = EXP, .rule = RULE_SIMPSON, .left = left, .right = right, .precision = precision};
+    double exact = test_exact(EXP, left, right);
+    double tolerance = test_tolerance(test_count_steps(manager, &request) + PIECE_STEPS_SLACK, precision, exact);
+    TEST_CHECK(rc == 0 && fabs(value - exact) <= tolerance, "%s: exp on [%g, %g] at %g is %.17g, expected %.17g (rc %d)",
+               what, left, right, precision, value, exact, rc);
+    return value;
+}
+
+int main(int argc, char **argv)
+{
+    test_init(argc, argv);
+
+    TEST_POOL pool;
+    test_pool_init(&pool, 2);
+    INFO_MANAGER *manager = &pool.manager;
+    info_manager_set_cache(manager, 64);
+    test_pool_start(&pool, 1, NULL);
+
+    SNAPSHOT before = snapshot(manager);
+    double first = check_integral(manager, "first call", 0, 8, TEST_PRECISION);
+    SNAPSHOT after = snapshot(manager);
+    TEST_CHECK(after.cache.misses > before.cache.misses && after.manager.jobs == before.manager.jobs + 1,
+               "first call misses and runs a job");
+    uint64_t full_steps = after.manager.steps - before.manager.steps;
+
+    before = after;
+    double again = check_integral(manager, "repeat", 0, 8, TEST_PRECISION);
+    after = snapshot(manager);
+    TEST_CHECK(after.cache.hits == before.cache.hits + 1 && after.manager.jobs == before.manager.jobs,
+               "repeat is a hit without a job");
+    TEST_CHECK(memcmp(&first, &again, sizeof(double)) == 0, "repeat returns the cached value bit for bit");
+
+    before = after;
+    check_integral(manager, "coarser precision", 0, 8, 100 * TEST_PRECISION);
+    after = snapshot(manager);
+    TEST_CHECK(after.manager.jobs == before.manager.jobs, "coarser precision is served from the cache");
+
+    before = after;
+    check_integral(manager, "finer precision", 0, 8, TEST_PRECISION / 100);
+    after = snapshot(manager);
+    TEST_CHECK(after.manager.jobs == before.manager.jobs + 1, "finer precision runs a new job");
+
+    // Блоки [1, 2) .. [7, 8) уже посчитаны, узлам уходит только [8, 9).
+    before = after;
+    check_integral(manager, "overlap", 1, 9, TEST_PRECISION);
+    after = snapshot(manager);
+    uint64_t overlap_steps = after.manager.steps - before.manager.steps;
+    TEST_CHECK(after.manager.jobs == before.manager.jobs + 1 && overlap_steps < full_steps,
+               "overlapping range dispatches only uncovered blocks (%lu steps, full range took %lu)", overlap_steps,
+               full_steps);
+
+    // Другое правило — другой ключ.
+    before = after;
+    double value;
+    int rc = get_integral(manager, EXP, 0, 8, TEST_PRECISION, RULE_GAUSS3, &value);
+    after = snapshot(manager);
+    TEST_CHECK(rc == 0 && after.manager.jobs == before.manager.jobs + 1, "another rule is not a hit (rc %d)", rc);
+
+    // Вытеснение: кэш на несколько записей переполняется разными отрезками.
+    info_manager_set_cache(manager, 4);
+    before = snapshot(manager);
+    for (int shift = 0; shift < 4; ++shift)
+        check_integral(manager, "eviction", 20 + shift, 20.5 + shift, TEST_PRECISION);
+    after = snapshot(manager);
+    TEST_CHECK(after.cache.entries <= 4 && after.cache.evictions > before.cache.evictions,
+               "small cache evicts (%zu entries, %lu evictions)", after.cache.entries,
+               after.cache.evictions - before.cache.evictions);
+    test_pool_stop(&pool);
+
+    // Свежий интеграл остался в кэше: пул для него не поднимается.
+    before = snapshot(manager);
+    check_integral(manager, "stopped pool", 23, 23.5, TEST_PRECISION);
+    after = snapshot(manager);
+    TEST_CHECK(after.cache.hits == before.cache.hits + 1 && !manager->pool_started,
+               "cached integral is served without workers");
+    return test_finish();
+}
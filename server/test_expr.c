@@ -0,0 +1,147 @@
+//============================
+// Тест выражений
+//============================
+// Разбор и байт-код проверяются на менеджере: приоритеты и ассоциативность
+// операций, функции, константы, синтаксические ошибки, общий идентификатор
+// одинаковых выражений. Затем интегралы выражений с известными первообразными
+// считаются на узлах, которые исполняют тот же байт-код блоками точек.
+
+#include "manager.c"
+#include "test-common.h"
+
+#define TEST_PRECISION 1e-10
+
+typedef struct
+{
+    const char *expression;
+    double x;
+    double expected;
+} EVAL_CASE;
+
+typedef struct
+{
+    const char *expression;
+    double left;
+    double right;
+    double exact;
+} INTEGRAL_CASE;
+
+static void test_eval(void)
+{
+    const EVAL_CASE cases[] = {
+        {"2 + 3 * x", 2, 8},
+        {"(2 + 3) * x", 2, 10},
+        {"10 - 4 - 3", 0, 3},
+        {"12 / 3 / 2", 0, 2},
+        {"-x^2", 3, -9},
+        {"2^3^2", 0, 512},
+        {"2 ** x", 10, 1024},
+        {"x * -2", 4, -8},
+        {"+x - -x", 1.5, 3},
+        {"1.5e2 + .5", 0, 150.5},
+        {"pi", 0, M_PI},
+        {"e", 0, M_E},
+        {"exp(x) * log(x)", 2, exp(2) * log(2)},
+        {"sin(x)^2 + cos(x)^2", 0.7, 1},
+        {"tan(x) - atan(x)", 0.3, tan(0.3) - atan(0.3)},
+        {"sqrt(abs(x))", -16, 4},
+        {"sinh(x) + cosh(x) + tanh(x)", 0.5, sinh(0.5) + cosh(0.5) + tanh(0.5)},
+        {"1 / (1 + x * x)", 2, 0.2},
+    };
+    for (size_t case_i = 0; case_i < sizeof(cases) / sizeof(cases[0]); ++case_i)
+    {
+        const EVAL_CASE *c = &cases[case_i];
+        struct expr_program program;
+        bool compiled = expr_compile(c->expression, &program);
+        double value = compiled ? expr_eval(&program, c->x) : NAN;
+        TEST_CHECK(compiled && fabs(value - c->expected) <= 1e-12 * fmax(1, fabs(c->expected)),
+                   "\"%s\" at x = %g is %.17g, expected %.17g", c->expression, c->x, value, c->expected);
+    }
+
+    const char *const invalid[] = {"", "x +", "foo(x)", "(x", "sin x", "1 2", "x)", "*x", "sin()"};
+    for (size_t case_i = 0; case_i < sizeof(invalid) / sizeof(invalid[0]); ++case_i)
+    {
+        FUNC_TABLE func_id;
+        int rc = integrand_compile(invalid[case_i], &func_id);
+        TEST_CHECK(rc == -EEXPR, "\"%s\" is rejected (rc %d)", invalid[case_i], rc);
+    }
+}
+
+static void test_ids(void)
+{
+    FUNC_TABLE first, second, spaced, other;
+    int rc = integrand_compile("x * x + 1", &first);
+    rc = rc != 0 ? rc : integrand_compile("x * x + 1", &second);
+    rc = rc != 0 ? rc : integrand_compile("x*x+1", &spaced);
+    rc = rc != 0 ? rc : integrand_compile("x ^ 2 + 1", &other);
+    TEST_CHECK(rc == 0, "expressions compile (rc %d)", rc);
+    TEST_CHECK(rc == 0 && first == second && first == spaced, "equal expressions share an id");
+    TEST_CHECK(rc == 0 && first != other, "different bytecode gets another id");
+    TEST_CHECK(rc == 0 && integrand_slot(first) != -1 && integrand_slot(first) != integrand_slot(other),
+               "expressions have their own slots");
+}
+
+static void test_integrals(INFO_MANAGER *manager)
+{
+    const INTEGRAL_CASE cases[] = {
+        {"exp(-x * x)", 0, 2, sqrt(M_PI) / 2 * erf(2)},
+        {"x * sin(x)", 0, 10, sin(10) - 10 * cos(10)},
+        {"1 / (1 + x * x)", -5, 5, 2 * atan(5)},
+        {"sqrt(x)", 1, 4, 14.0 / 3},
+        {"log(x)", 1, 2, 2 * log(2) - 1},
+        {"cosh(x) - x^3", -1, 2, sinh(2) + sinh(1) - 15.0 / 4},
+        // Узкие пики: по редким точкам производная недооценивается, шаг уменьшает проверка удвоением.
+        {"exp(-400 * (x - 0.3)^2)", 0, 4, sqrt(M_PI) / 40 * (erf(74) + erf(6))},
+        {"exp(-10000 * (x - 0.3)^2)", 0, 10, sqrt(M_PI) / 200 * (erf(970) + erf(30))},
+        {"1 / (0.001 + (x - 3.21)^2)", 0, 10, (atan(6.79 / sqrt(0.001)) + atan(3.21 / sqrt(0.001))) / sqrt(0.001)},
+    };
+    const QUAD_RULE rules[] = {RULE_MIDPOINT, RULE_SIMPSON, RULE_GAUSS3, RULE_GAUSS4};
+    static const char *const rule_names[QUAD_RULES] = {
+        [RULE_MIDPOINT] = "midpoint", [RULE_SIMPSON] = "simpson", [RULE_GAUSS3] = "gauss3", [RULE_GAUSS4] = "gauss4",
+    };
+    for (size_t case_i = 0; case_i < sizeof(cases) / sizeof(cases[0]); ++case_i)
+    {
+        const INTEGRAL_CASE *c = &cases[case_i];
+        FUNC_TABLE func_id;
+        if (integrand_compile(c->expression, &func_id) != 0)
+        {
+            TEST_CHECK(false, "\"%s\" compiles", c->expression);
+            continue;
+        }
+        for (size_t rule_i = 0; rule_i < sizeof(rules) / sizeof(rules[0]); ++rule_i)
+        {
+            INTEGRAL_REQUEST request = {.func_id = func_id, .rule = rules[rule_i], .left = c->left, .right = c->right,
+                                        .precision = TEST_PRECISION};
+            uint64_t num_steps = test_count_steps(manager, &request);
+            double value = 0;
+            int rc = manager_pool_submit(manager, func_id, c->left, c->right, TEST_PRECISION, rules[rule_i], &value);
+            double error = fabs(value - c->exact);
+            double tolerance = test_tolerance(num_steps, TEST_PRECISION, c->exact);
+            TEST_CHECK(rc == 0 && error <= tolerance, "\"%s\" on [%g, %g], %s: error %.3g, allowed %.3g over %lu steps (rc %d)",
+                       c->expression, c->left, c->right, rule_names[rules[rule_i]], error, tolerance, num_steps, rc);
+        }
+    }
+
+    // Выражение, не определённое на части отрезка, отклоняется до раздачи.
+    FUNC_TABLE func_id;
+    double value;
+    int rc = integrand_compile("log(x)", &func_id);
+    rc = rc != 0 ? rc : manager_pool_submit(manager, func_id, -1, 1, TEST_PRECISION, RULE_MIDPOINT, &value);
+    TEST_CHECK(rc == -EVALUE, "log(x) on [-1, 1] is rejected (rc %d)", rc);
+}
+
+int main(int argc, char **argv)
+{
+    test_init(argc, argv);
+    test_eval();
+    test_ids();
+
+    TEST_POOL pool;
+    test_pool_init(&pool, 2);
+    test_pool_start(&pool, 1, NULL);
+    test_integrals(&pool.manager);
+    info_manager_set_adaptive(&pool.manager, true);
+    test_integrals(&pool.manager);
+    test_pool_stop(&pool);
+    return test_finish();
+}
@@ -28,7 +28,7 @@ int main(int argc, char *argv[]) {
 
     info_manager_init(&info_manager, argv[1], argv[2], max_time, num_workers);
     double res_value = 0;
-    if (get_integral(&info_manager, 0, 1, 2, 0.01, &res_value)) {
+    if (get_integral(&info_manager, 0, 1, 2, 0.01, RULE_MIDPOINT, &res_value)) {
         fprintf(stderr, "Error in get_integral\n");
         return 1;
     }
@@ -0,0 +1,42 @@
+//============================
+// Подключаемая функция для тестов
+//============================
+// f(x) = x^3. Имя задаётся при сборке через TEST_PLUGIN_NAME: библиотеки с одним
+// именем получают один идентификатор, на этом проверяются конфликты.
+
+#include <math.h>
+#include <stdint.h>
+#include "integrand.h"
+
+#ifndef TEST_PLUGIN_NAME
+#define TEST_PLUGIN_NAME "test_cube"
+#endif
+
+static double cube_sum(double x0, double h, uint64_t n)
+{
+    double sum = 0;
+    for (uint64_t i = 0; i < n; ++i)
+    {
+        double x = x0 + i * h;
+        sum += x * x * x;
+    }
+    return sum;
+}
+
+// (x^3)'' = 6x, старшие производные равны нулю.
+static double cube_max_derivative(unsigned order, double left, double right)
+{
+    return order == 2 ? 6 * fmax(fabs(left), fabs(right)) : 0;
+}
+
+static const INTEGRAND_PLUGIN cube_plugin = {
+    .abi_version = INTEGRAND_ABI_VERSION,
+    .name = TEST_PLUGIN_NAME,
+    .sum = cube_sum,
+    .max_derivative = cube_max_derivative,
+};
+
+const INTEGRAND_PLUGIN *integrand_plugin(void)
+{
+    return &cube_plugin;
+}
@@ -0,0 +1,78 @@
+//============================
+// Тест подключаемых функций
+//============================
+// Повторная загрузка библиотеки и библиотека, чьё имя даёт тот же
+// идентификатор, отклоняются и менеджером, и узлом. Подключаемая функция
+// считается узлами по всем формулам и совпадает с (r^4 - l^4) / 4. Функция,
+// которой нет на узлах, завершает запрос с -EFUNCID, не отключая узлы.
+
+#include "manager.c"
+#include "test-common.h"
+
+#define TEST_PRECISION 1e-10
+// Сборки test_plugin.c под именами с одинаковым integrand_plugin_id (см. Makefile).
+#define TEST_CLASH_A_PATH "build/test_plugin_clash_a.so"
+#define TEST_CLASH_B_PATH "build/test_plugin_clash_b.so"
+
+static const char *const test_rule_names[QUAD_RULES] = {
+    [RULE_MIDPOINT] = "midpoint",
+    [RULE_SIMPSON]  = "simpson",
+    [RULE_GAUSS2]   = "gauss2",
+    [RULE_GAUSS3]   = "gauss3",
+    [RULE_GAUSS4]   = "gauss4",
+};
+
+static void check_cube(INFO_MANAGER *manager, FUNC_TABLE cube, const char *what, double left, double right, QUAD_RULE rule)
+{
+    INTEGRAL_REQUEST request = {.func_id = cube, .rule = rule, .left = left, .right = right, .precision = TEST_PRECISION};
+    double value = 0;
+    int rc = get_integral(manager, cube, left, right, TEST_PRECISION, rule, &value);
+    double exact = (pow(right, 4) - pow(left, 4)) / 4;
+    double tolerance = test_tolerance(test_count_steps(manager, &request), TEST_PRECISION, exact);
+    TEST_CHECK(rc == 0 && fabs(value - exact) <= tolerance, "%s: cube on [%g, %g], %s: %.17g, expected %.17g (rc %d)", what,
+               left, right, test_rule_names[rule], value, exact, rc);
+}
+
+int main(int argc, char **argv)
+{
+    test_init(argc, argv);
+
+    FUNC_TABLE cube, clash_a, unused;
+    int rc = integrand_load(TEST_PLUGIN_PATH, &cube);
+    TEST_CHECK(rc == 0, "plugin loads (rc %d)", rc);
+    if (rc != 0)
+        return test_finish();
+    rc = integrand_load(TEST_PLUGIN_PATH, &unused);
+    TEST_CHECK(rc == -EPLUGIN, "second load of the same plugin is rejected (rc %d)", rc);
+    rc = integrand_load(TEST_CLASH_A_PATH, &clash_a);
+    TEST_CHECK(rc == 0 && clash_a != cube, "plugin with another name loads (rc %d)", rc);
+    if (rc != 0)
+        return test_finish();
+    rc = integrand_load(TEST_CLASH_B_PATH, &unused);
+    TEST_CHECK(rc == -EPLUGIN, "plugin whose name clashes by id is rejected (rc %d)", rc);
+
+    // Узел с конфликтующими библиотеками не запускается.
+    TEST_POOL pool;
+    test_pool_init(&pool, 2);
+    char *clash_argv[] = {(char *)test_worker_path, TEST_ADDR, pool.port, "1", "1", TEST_CLASH_A_PATH,
+                          TEST_CLASH_B_PATH, NULL};
+    TEST_CHECK(!test_reap(test_spawn(clash_argv)), "worker refuses plugins that clash by id");
+
+    // Узлы знают только cube.
+    test_pool_start(&pool, 2, TEST_PLUGIN_PATH);
+    INFO_MANAGER *manager = &pool.manager;
+    for (QUAD_RULE rule = 0; rule < QUAD_RULES; ++rule)
+        check_cube(manager, cube, "workers with the plugin", -1.5, 2, rule);
+
+    double value = 0;
+    rc = get_integral(manager, clash_a, 0, 1, TEST_PRECISION, RULE_SIMPSON, &value);
+    TEST_CHECK(rc == -EFUNCID, "plugin missing on the workers fails with -EFUNCID (rc %d)", rc);
+    MANAGER_STATS stats;
+    manager_get_stats(manager, &stats);
+    TEST_CHECK(stats.workers_lost == 0 && stats.workers_ready == 2, "workers stay connected (%lu lost, %lu ready)",
+               stats.workers_lost, stats.workers_ready);
+    check_cube(manager, cube, "after the refusal", 0, 3, RULE_GAUSS2);
+
+    test_pool_stop(&pool);
+    return test_finish();
+}
@@ -0,0 +1,258 @@
+//============================
+// Тест протокола кадров
+//============================
+// Вместо рабочего узла к менеджеру подключается поддельный, который говорит
+// кадрами напрямую: копит присланные куски и отвечает на них в обратном порядке,
+// каждой части — точным интегралом по её отрезку. Ответ менеджера тогда совпадает
+// с аналитическим, только если он сопоставил ответы кускам по request_id. Узел
+// сообщает кодом выхода, сколько кусков одновременно ждали у него ответа.
+// Второй поддельный узел сразу отвечает на незнакомый request_id: менеджер
+// должен отключить его и досчитать задание на настоящем узле.
+
+#include "manager.c"
+#include "test-common.h"
+
+#define TEST_PRECISION 1e-12
+// Поддельный узел ждёт следующего куска столько, прежде чем ответить на накопленные.
+#define FAKE_IDLE_MS 20
+#define FAKE_EXIT_PROTOCOL 100
+
+typedef enum
+{
+    FAKE_REVERSE,
+    FAKE_BOGUS_ID,
+} FAKE_MODE;
+
+typedef struct
+{
+    uint64_t request_id;
+    uint32_t type;
+    uint32_t num_parts;
+    struct worker_data parts[MAX_BATCH_PARTS];
+} FAKE_TASK;
+
+static bool fake_read(int fd, void *buf, size_t length)
+{
+    char *p = buf;
+    while (length != 0)
+    {
+        ssize_t got = recv(fd, p, length, 0);
+        if (got <= 0)
+            return false;
+        p += got;
+        length -= got;
+    }
+    return true;
+}
+
+static void fake_send(int fd, uint32_t type, uint64_t request_id, const void *payload, uint32_t length)
+{
+    char buf[sizeof(struct frame_header) + sizeof(struct worker_batch_result)];
+    struct frame_header hdr = {.type = type, .length = length, .request_id = request_id};
+    memcpy(buf, &hdr, sizeof(hdr));
+    memcpy(buf + sizeof(hdr), payload, length);
+    if (send(fd, buf, sizeof(hdr) + length, 0) != (ssize_t)(sizeof(hdr) + length))
+        _exit(FAKE_EXIT_PROTOCOL);
+}
+
+static double fake_part_value(const struct worker_data *part)
+{
+    return test_exact(part->func_id, part->left, part->left + part->step * part->num_steps);
+}
+
+static void fake_answer(int fd, const FAKE_TASK *task, uint64_t request_id)
+{
+    if (task->type == FRAME_TASK)
+    {
+        struct worker_result res = {.value = fake_part_value(&task->parts[0])};
+        fake_send(fd, FRAME_RESULT, request_id, &res, sizeof(res));
+        return;
+    }
+    struct worker_batch_result res = {.num_values = task->num_parts};
+    for (uint32_t part_i = 0; part_i < task->num_parts; ++part_i)
+        res.values[part_i] = fake_part_value(&task->parts[part_i]);
+    fake_send(fd, FRAME_RESULT_BATCH, request_id, &res,
+              offsetof(struct worker_batch_result, values) + task->num_parts * sizeof(double));
+}
+
+// Поддельный узел; код выхода — наибольшее число кусков, ждавших ответа разом.
+static void fake_worker(const char *port, FAKE_MODE mode)
+{
+    struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *res;
+    if (getaddrinfo(TEST_ADDR, port, &hints, &res) != 0)
+        _exit(FAKE_EXIT_PROTOCOL);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    while (connect(fd, res->ai_addr, res->ai_addrlen) == -1)
+        usleep(10000);
+    freeaddrinfo(res);
+
+    struct node_info node = {.max_worker_time = TEST_MAX_TIME, .n_cores = 1, .n_cpus = 1, .n_physical_cores = 1,
+                             .n_packages = 1, .n_numa_nodes = 1};
+    fake_send(fd, FRAME_NODE_INFO, 0, &node, sizeof(node));
+
+    FAKE_TASK held[PIPELINE_DEPTH];
+    uint32_t num_held = 0, max_held = 0;
+    while (true)
+    {
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        if (num_held != 0 && (mode == FAKE_BOGUS_ID || num_held == PIPELINE_DEPTH || poll(&pfd, 1, FAKE_IDLE_MS) == 0))
+        {
+            // Отвечаем на накопленные куски с конца.
+            while (num_held != 0)
+            {
+                FAKE_TASK *task = &held[--num_held];
+                fake_answer(fd, task, mode == FAKE_BOGUS_ID ? task->request_id + 1000000 : task->request_id);
+            }
+            continue;
+        }
+
+        struct frame_header hdr;
+        char payload[MAX_FRAME_PAYLOAD];
+        if (!fake_read(fd, &hdr, sizeof(hdr)))
+            break;
+        if (hdr.length > sizeof(payload) || !fake_read(fd, payload, hdr.length))
+            _exit(FAKE_EXIT_PROTOCOL);
+        switch (hdr.type)
+        {
+        case FRAME_TASK:
+        case FRAME_TASK_BATCH:
+        {
+            FAKE_TASK *task = &held[num_held++];
+            task->request_id = hdr.request_id;
+            task->type = hdr.type;
+            task->num_parts = hdr.length / sizeof(struct worker_data);
+            if (task->num_parts == 0 || task->num_parts * sizeof(struct worker_data) != hdr.length ||
+                (hdr.type == FRAME_TASK && task->num_parts != 1))
+                _exit(FAKE_EXIT_PROTOCOL);
+            memcpy(task->parts, payload, hdr.length);
+            if (num_held > max_held)
+                max_held = num_held;
+            break;
+        }
+        case FRAME_CALIBRATE:
+        {
+            struct calibration_result calibration = {.steps_per_sec = 1e8};
+            fake_send(fd, FRAME_CALIBRATION, hdr.request_id, &calibration, sizeof(calibration));
+            break;
+        }
+        case FRAME_STOP:
+            close(fd);
+            _exit((int)max_held);
+        default:
+            _exit(FAKE_EXIT_PROTOCOL);
+        }
+    }
+    close(fd);
+    _exit((int)max_held);
+}
+
+static pid_t spawn_fake_worker(const char *port, FAKE_MODE mode)
+{
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        fprintf(stderr, "Unable to fork: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if (pid == 0)
+        fake_worker(port, mode);
+    return pid;
+}
+
+static int fake_exit_code(pid_t pid)
+{
+    int status;
+    if (waitpid(pid, &status, 0) == -1 || !WIFEXITED(status))
+        return -1;
+    return WEXITSTATUS(status);
+}
+
+static void check_value(const char *what, int rc, double value, double exact)
+{
+    TEST_CHECK(rc == 0 && fabs(value - exact) <= 1e-12 * fmax(1, fabs(exact)), "%s is %.17g, expected %.17g (rc %d)", what,
+               value, exact, rc);
+}
+
+// Один поддельный узел: длинный интеграл идёт кусками через конвейер, короткие
+// упаковываются в пакетные кадры.
+static void test_reordered_answers(void)
+{
+    TEST_POOL pool;
+    test_pool_init(&pool, 1);
+    pool.pids[0] = spawn_fake_worker(pool.port, FAKE_REVERSE);
+    pool.num_workers = 0;
+    if (manager_pool_start(&pool.manager) != 0)
+    {
+        fprintf(stderr, "Unable to start pool with a fake worker\n");
+        exit(EXIT_FAILURE);
+    }
+
+    double value = 0;
+    int rc = manager_pool_submit(&pool.manager, EXP, 0, 10, TEST_PRECISION, RULE_MIDPOINT, &value);
+    check_value("exp on [0, 10] over reordered answers", rc, value, test_exact(EXP, 0, 10));
+
+    enum { NUM_SHORT = 200 };
+    INTEGRAL_REQUEST requests[NUM_SHORT];
+    double results[NUM_SHORT];
+    for (size_t request_i = 0; request_i < NUM_SHORT; ++request_i)
+    {
+        requests[request_i] = (INTEGRAL_REQUEST){.func_id = (FUNC_TABLE)(request_i % NOT_SUPPORT), .rule = RULE_SIMPSON,
+                                                 .left = 0.01 * request_i, .right = 0.01 * request_i + 0.5,
+                                                 .precision = 1e-6};
+    }
+    rc = manager_pool_submit_batch(&pool.manager, requests, NUM_SHORT, results);
+    TEST_CHECK(rc == 0, "batch of %d short integrals over batch frames (rc %d)", NUM_SHORT, rc);
+    size_t num_wrong = 0;
+    for (size_t request_i = 0; request_i < NUM_SHORT && rc == 0; ++request_i)
+    {
+        const INTEGRAL_REQUEST *request = &requests[request_i];
+        double exact = test_exact(request->func_id, request->left, request->right);
+        num_wrong += fabs(results[request_i] - exact) > 1e-12 * fmax(1, fabs(exact));
+    }
+    TEST_CHECK(num_wrong == 0, "%zu of %d short integrals match their own parts", NUM_SHORT - num_wrong, NUM_SHORT);
+
+    manager_pool_stop(&pool.manager);
+    int max_held = fake_exit_code(pool.pids[0]);
+    TEST_CHECK(max_held > 1 && max_held <= (int)PIPELINE_DEPTH, "worker had %d chunks in flight at once (at most %u)",
+               max_held, PIPELINE_DEPTH);
+}
+
+// Ответ на незнакомый request_id нарушает протокол: узел отключается, его куски
+// досчитывает настоящий узел.
+static void test_bogus_request_id(void)
+{
+    TEST_POOL pool;
+    test_pool_init(&pool, 1);
+    pid_t fake = spawn_fake_worker(pool.port, FAKE_BOGUS_ID);
+    if (manager_pool_start(&pool.manager) != 0)
+    {
+        fprintf(stderr, "Unable to start pool with a fake worker\n");
+        exit(EXIT_FAILURE);
+    }
+    // Настоящий узел подключается вторым: задание сначала заполняет конвейер
+    // поддельного, и без его ответа задание не завершится.
+    pool.pids[0] = test_spawn_worker(pool.port, 1, NULL);
+    while (pool.manager.num_ready < 2)
+        manager_poll_events(&pool.manager, 100);
+    double value = 0;
+    int rc = manager_pool_submit(&pool.manager, SIN, 0, 30, TEST_PRECISION, RULE_GAUSS2, &value);
+    INTEGRAL_REQUEST request = {.func_id = SIN, .rule = RULE_GAUSS2, .left = 0, .right = 30, .precision = TEST_PRECISION};
+    double exact = test_exact(SIN, 0, 30);
+    double tolerance = test_tolerance(test_count_steps(&pool.manager, &request), TEST_PRECISION, exact);
+    TEST_CHECK(rc == 0 && fabs(value - exact) <= tolerance, "sin on [0, 30] with a misbehaving worker is %.17g, expected %.17g (rc %d)",
+               value, exact, rc);
+    MANAGER_STATS stats;
+    manager_get_stats(&pool.manager, &stats);
+    TEST_CHECK(stats.workers_lost == 1, "misbehaving worker is dropped (%lu lost)", stats.workers_lost);
+    test_pool_stop(&pool);
+    fake_exit_code(fake);
+}
+
+int main(int argc, char **argv)
+{
+    test_init(argc, argv);
+    test_reordered_answers();
+    test_bogus_request_id();
+    return test_finish();
+}
@@ -0,0 +1,98 @@
+//============================
+// Тест потери узлов
+//============================
+// Узел убивается посреди задания: его куски должны досчитать оставшиеся узлы,
+// а ответ — совпасть с аналитическим. Узел, подключившийся посреди задания,
+// сразу получает работу. Когда не остаётся ни одного узла, задание завершается
+// с -ENOWORKERS.
+
+#include "manager.c"
+#include "test-common.h"
+
+// EXP на [0, 10] с такой точностью — сотня миллионов шагов, задание идёт
+// достаточно долго, чтобы успеть убить узел.
+#define TEST_LONG_PRECISION 1e-18
+
+static INTEGRAL_FUTURE *submit_long(INFO_MANAGER *manager)
+{
+    INTEGRAL_FUTURE *future = NULL;
+    int rc = get_integral_async(manager, EXP, 0, 10, TEST_LONG_PRECISION, RULE_MIDPOINT, NULL, NULL, &future);
+    if (rc != 0)
+    {
+        fprintf(stderr, "Unable to submit a long integral: %d\n", rc);
+        exit(EXIT_FAILURE);
+    }
+    return future;
+}
+
+// Ждёт, пока узлы не вернут первые куски задания.
+static void wait_progress(INFO_MANAGER *manager, uint64_t steps_before)
+{
+    MANAGER_STATS stats;
+    do
+    {
+        usleep(1000);
+        manager_get_stats(manager, &stats);
+    } while (stats.steps == steps_before);
+}
+
+static void check_long(const char *what, int status, double value)
+{
+    INTEGRAL_REQUEST request = {.func_id = EXP, .rule = RULE_MIDPOINT, .left = 0, .right = 10,
+                                .precision = TEST_LONG_PRECISION};
+    INFO_MANAGER counter = {0};
+    double exact = test_exact(EXP, 0, 10);
+    double tolerance = test_tolerance(test_count_steps(&counter, &request), TEST_LONG_PRECISION, exact);
+    TEST_CHECK(status == 0 && fabs(value - exact) <= tolerance, "%s: %.17g, expected %.17g (status %d)", what, value, exact,
+               status);
+}
+
+int main(int argc, char **argv)
+{
+    test_init(argc, argv);
+
+    TEST_POOL pool;
+    test_pool_init(&pool, 2);
+    test_pool_start(&pool, 1, NULL);
+    INFO_MANAGER *manager = &pool.manager;
+
+    // Один из двух узлов погибает посреди задания.
+    INTEGRAL_FUTURE *future = submit_long(manager);
+    wait_progress(manager, 0);
+    kill(pool.pids[0], SIGKILL);
+    double value = 0;
+    int status = integral_future_wait(future, &value);
+    integral_future_free(future);
+    check_long("job survives a killed worker", status, value);
+    MANAGER_STATS stats;
+    manager_get_stats(manager, &stats);
+    TEST_CHECK(stats.workers_lost == 1 && stats.workers_ready == 1, "one worker lost, one ready (%lu lost, %lu ready)",
+               stats.workers_lost, stats.workers_ready);
+    test_reap(pool.pids[0]);
+
+    // Узел на замену подключается посреди следующего задания и получает куски.
+    uint64_t steps_before = stats.steps;
+    future = submit_long(manager);
+    wait_progress(manager, steps_before);
+    pool.pids[0] = test_spawn_worker(pool.port, 1, NULL);
+    status = integral_future_wait(future, &value);
+    integral_future_free(future);
+    check_long("job with a worker joining midway", status, value);
+    WORKER_STATS workers[4];
+    size_t num_workers = manager_get_worker_stats(manager, workers, 4);
+    TEST_CHECK(num_workers == 3 && workers[2].connected && workers[2].chunks != 0,
+               "joining worker got chunks (%zu workers, %lu chunks)", num_workers, num_workers == 3 ? workers[2].chunks : 0);
+
+    // Без узлов задание не досчитать.
+    manager_get_stats(manager, &stats);
+    future = submit_long(manager);
+    wait_progress(manager, stats.steps);
+    kill(pool.pids[0], SIGKILL);
+    kill(pool.pids[1], SIGKILL);
+    status = integral_future_wait(future, NULL);
+    integral_future_free(future);
+    TEST_CHECK(status == -ENOWORKERS, "job without workers fails with -ENOWORKERS (status %d)", status);
+
+    test_pool_stop(&pool);
+    return test_finish();
+}
@@ -0,0 +1,96 @@
+//============================
+// Тест ретранслятора
+//============================
+// Менеджер видит один ретранслятор, под которым два рабочих узла. Интегралы
+// встроенных функций по всем формулам, выражение и подключаемая функция должны
+// посчитаться поддеревом и совпасть с аналитическими ответами. Пакет из многих
+// коротких интегралов проходит через ретранслятор пакетными кадрами.
+
+#include "manager.c"
+#include "test-common.h"
+
+#define TEST_PRECISION 1e-10
+
+static const char *const test_rule_names[QUAD_RULES] = {
+    [RULE_MIDPOINT] = "midpoint",
+    [RULE_SIMPSON]  = "simpson",
+    [RULE_GAUSS2]   = "gauss2",
+    [RULE_GAUSS3]   = "gauss3",
+    [RULE_GAUSS4]   = "gauss4",
+};
+
+static void check_request(INFO_MANAGER *manager, const INTEGRAL_REQUEST *request, const char *name, double exact)
+{
+    double value = 0;
+    int rc = manager_pool_submit(manager, request->func_id, request->left, request->right, request->precision, request->rule,
+                                 &value);
+    double tolerance = test_tolerance(test_count_steps(manager, request), request->precision, exact);
+    TEST_CHECK(rc == 0 && fabs(value - exact) <= tolerance, "%s on [%g, %g], %s: %.17g, expected %.17g (rc %d)", name,
+               request->left, request->right, test_rule_names[request->rule], value, exact, rc);
+}
+
+int main(int argc, char **argv)
+{
+    test_init(argc, argv);
+    if (test_relay_path == NULL)
+    {
+        fprintf(stderr, "Relay test needs the relay path\n");
+        return EXIT_FAILURE;
+    }
+
+    FUNC_TABLE cube, expr;
+    int rc = integrand_load(TEST_PLUGIN_PATH, &cube);
+    rc = rc != 0 ? rc : integrand_compile("x * exp(-x)", &expr);
+    TEST_CHECK(rc == 0, "plugin and expression are registered (rc %d)", rc);
+    if (rc != 0)
+        return test_finish();
+
+    TEST_POOL pool;
+    test_pool_init(&pool, 1);
+    test_relay_pool_start(&pool, 2, 1, TEST_PLUGIN_PATH);
+    INFO_MANAGER *manager = &pool.manager;
+
+    static const char *const func_names[NOT_SUPPORT] = {[EXP] = "exp", [SIN] = "sin", [SQR] = "sqr"};
+    for (FUNC_TABLE func_id = EXP; func_id < NOT_SUPPORT; ++func_id)
+    {
+        for (QUAD_RULE rule = 0; rule < QUAD_RULES; ++rule)
+        {
+            INTEGRAL_REQUEST request = {.func_id = func_id, .rule = rule, .left = -2, .right = 3, .precision = TEST_PRECISION};
+            check_request(manager, &request, func_names[func_id], test_exact(func_id, -2, 3));
+        }
+    }
+    INTEGRAL_REQUEST request = {.func_id = expr, .rule = RULE_GAUSS3, .left = 0, .right = 5, .precision = TEST_PRECISION};
+    check_request(manager, &request, "x * exp(-x)", 1 - 6 * exp(-5));
+    request = (INTEGRAL_REQUEST){.func_id = cube, .rule = RULE_SIMPSON, .left = -1, .right = 2, .precision = TEST_PRECISION};
+    check_request(manager, &request, "cube plugin", (16.0 - 1.0) / 4);
+
+    // Короткие интегралы упаковываются в пакетные кадры и на ретранслятор.
+    enum { NUM_SHORT = 300 };
+    INTEGRAL_REQUEST requests[NUM_SHORT];
+    double results[NUM_SHORT];
+    for (size_t request_i = 0; request_i < NUM_SHORT; ++request_i)
+    {
+        requests[request_i] = (INTEGRAL_REQUEST){.func_id = (FUNC_TABLE)(request_i % NOT_SUPPORT), .rule = RULE_GAUSS2,
+                                                 .left = 0.01 * request_i, .right = 0.01 * request_i + 0.25,
+                                                 .precision = TEST_PRECISION};
+    }
+    rc = manager_pool_submit_batch(manager, requests, NUM_SHORT, results);
+    size_t num_wrong = 0;
+    for (size_t request_i = 0; request_i < NUM_SHORT && rc == 0; ++request_i)
+    {
+        const INTEGRAL_REQUEST *short_request = &requests[request_i];
+        double exact = test_exact(short_request->func_id, short_request->left, short_request->right);
+        double tolerance = test_tolerance(test_count_steps(manager, short_request), TEST_PRECISION, exact);
+        num_wrong += !(fabs(results[request_i] - exact) <= tolerance);
+    }
+    TEST_CHECK(rc == 0 && num_wrong == 0, "batch of %d short integrals through the relay: %zu wrong (rc %d)", NUM_SHORT,
+               num_wrong, rc);
+
+    MANAGER_STATS stats;
+    manager_get_stats(manager, &stats);
+    TEST_CHECK(stats.workers_lost == 0 && stats.workers_ready == 1, "relay stays connected (%lu lost, %lu ready)",
+               stats.workers_lost, stats.workers_ready);
+
+    test_pool_stop(&pool);
+    return test_finish();
+}
@@ -0,0 +1,77 @@
+//============================
+// Тест квадратурных формул
+//============================
+// Каждая формула считает exp на [0, 1] на узлах с заданным числом шагов N и 2N.
+// Отношение ошибок показывает порядок формулы, а сама ошибка должна сходиться
+// к главному члену C * h^p * (f^(p-1)(1) - f^(p-1)(0)) с константой C, по
+// которой менеджер выбирает шаг.
+
+#include "manager.c"
+#include "test-common.h"
+
+// Допустимое отклонение измеренного порядка и главного члена ошибки.
+#define ORDER_SLACK 0.25
+#define ERROR_CONST_SLACK 0.2
+
+typedef struct
+{
+    QUAD_RULE rule;
+    const char *name;
+    // Шагов на грубой сетке: ошибка ещё заметно больше ошибок округления.
+    uint64_t num_steps;
+} RULE_CASE;
+
+// Считает exp на [0, 1] ровно за num_steps шагов формулы rule.
+static int run_steps(INFO_MANAGER *manager, QUAD_RULE rule, uint64_t num_steps, double *value)
+{
+    struct timespec start_time;
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    *value = 0;
+    JOB job = {.func_id = EXP, .rule = rule, .results = value, .num_results = 1, .summation = SUMMATION_COMPENSATED};
+    queue_push_segment(&job.queue, 0, EXP, rule, 0, 1, num_steps);
+    return manager_run_job(manager, &job, &start_time);
+}
+
+int main(int argc, char **argv)
+{
+    test_init(argc, argv);
+
+    TEST_POOL pool;
+    test_pool_init(&pool, 1);
+    test_pool_start(&pool, 1, NULL);
+
+    const RULE_CASE cases[] = {
+        {RULE_MIDPOINT, "midpoint", 256},
+        {RULE_SIMPSON, "simpson", 16},
+        {RULE_GAUSS2, "gauss2", 16},
+        {RULE_GAUSS3, "gauss3", 4},
+        {RULE_GAUSS4, "gauss4", 2},
+    };
+    const double exact = test_exact(EXP, 0, 1);
+    for (size_t case_i = 0; case_i < sizeof(cases) / sizeof(cases[0]); ++case_i)
+    {
+        const RULE_CASE *c = &cases[case_i];
+        double coarse, fine;
+        int rc = run_steps(&pool.manager, c->rule, c->num_steps, &coarse);
+        rc = rc != 0 ? rc : run_steps(&pool.manager, c->rule, 2 * c->num_steps, &fine);
+        TEST_CHECK(rc == 0, "%s computes on the workers (rc %d)", c->name, rc);
+        if (rc != 0)
+            continue;
+
+        double coarse_error = fabs(coarse - exact);
+        double fine_error = fabs(fine - exact);
+        double order = log2(coarse_error / fine_error);
+        const RULE_INFO *info = &rule_infos[c->rule];
+        TEST_CHECK(fabs(order - info->order) <= ORDER_SLACK, "%s: measured order %.3f, expected %d (errors %.3g, %.3g)",
+                   c->name, order, info->order, coarse_error, fine_error);
+
+        // У exp все производные равны exp, главный член ошибки — C * h^p * (e - 1).
+        double h = 1.0 / (2 * c->num_steps);
+        double leading = info->error_const * pow(h, info->order) * exact;
+        TEST_CHECK(fabs(fine_error / leading - 1) <= ERROR_CONST_SLACK, "%s: error %.3g, leading term %.3g", c->name,
+                   fine_error, leading);
+    }
+
+    test_pool_stop(&pool);
+    return test_finish();
+}
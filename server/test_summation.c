@@ -0,0 +1,87 @@
+//============================
+// Тест компенсированного суммирования
+//============================
+// В компенсированном режиме ответ не должен зависеть от устройства пула: один
+// и тот же пакет на пулах разной формы (число узлов, потоков на узле, раздача,
+// ретранслятор) должен давать побитово одинаковые ответы. Ответы к тому же
+// сверяются с аналитическими.
+
+#include "manager.c"
+#include "test-common.h"
+
+typedef struct
+{
+    const char *name;
+    long num_workers;
+    long cores;
+    SCHEDULE_MODE schedule;
+    bool relay;
+} POOL_SHAPE;
+
+// Интегралы на несколько клеток сетки частей и короткие, упакованные в один кусок.
+static const INTEGRAL_REQUEST test_requests[] = {
+    {.func_id = EXP, .rule = RULE_MIDPOINT, .left = 0, .right = 10, .precision = 1e-13},
+    {.func_id = SIN, .rule = RULE_SIMPSON, .left = 0, .right = 20, .precision = 1e-15},
+    {.func_id = SQR, .rule = RULE_GAUSS3, .left = -3, .right = 5, .precision = 1e-12},
+    {.func_id = EXP, .rule = RULE_GAUSS2, .left = 1, .right = 2, .precision = 1e-12},
+    {.func_id = SIN, .rule = RULE_MIDPOINT, .left = -1, .right = 0.5, .precision = 1e-12},
+};
+
+#define TEST_NUM_REQUESTS (sizeof(test_requests) / sizeof(test_requests[0]))
+
+static int run_shape(const POOL_SHAPE *shape, double *results)
+{
+    TEST_POOL pool;
+    test_pool_init(&pool, shape->relay ? 1 : shape->num_workers);
+    info_manager_set_summation(&pool.manager, SUMMATION_COMPENSATED);
+    info_manager_set_schedule(&pool.manager, shape->schedule);
+    if (shape->relay)
+        test_relay_pool_start(&pool, shape->num_workers, shape->cores, NULL);
+    else
+        test_pool_start(&pool, shape->cores, NULL);
+    int rc = manager_pool_submit_batch(&pool.manager, test_requests, TEST_NUM_REQUESTS, results);
+    test_pool_stop(&pool);
+    return rc;
+}
+
+int main(int argc, char **argv)
+{
+    test_init(argc, argv);
+
+    const POOL_SHAPE shapes[] = {
+        {"1 worker x 1 thread", 1, 1, SCHEDULE_DYNAMIC, false},
+        {"2 workers x 1 thread", 2, 1, SCHEDULE_DYNAMIC, false},
+        {"3 workers x 2 threads", 3, 2, SCHEDULE_DYNAMIC, false},
+        {"3 workers x 3 threads, static", 3, 3, SCHEDULE_STATIC, false},
+        {"relay over 2 workers x 2 threads", 2, 2, SCHEDULE_DYNAMIC, true},
+    };
+    const size_t num_shapes = sizeof(shapes) / sizeof(shapes[0]) - (test_relay_path == NULL);
+
+    // Шаги считаются для равномерного разбиения, как в пулах теста.
+    INFO_MANAGER counter = {0};
+    double reference[TEST_NUM_REQUESTS];
+    int rc = run_shape(&shapes[0], reference);
+    TEST_CHECK(rc == 0, "%s computes the batch (rc %d)", shapes[0].name, rc);
+    for (size_t request_i = 0; request_i < TEST_NUM_REQUESTS && rc == 0; ++request_i)
+    {
+        const INTEGRAL_REQUEST *request = &test_requests[request_i];
+        double exact = test_exact(request->func_id, request->left, request->right);
+        double tolerance = test_tolerance(test_count_steps(&counter, request), request->precision, exact);
+        TEST_CHECK(fabs(reference[request_i] - exact) <= tolerance, "integral %zu is %.17g, expected %.17g", request_i,
+                   reference[request_i], exact);
+    }
+
+    for (size_t shape_i = 1; shape_i < num_shapes && rc == 0; ++shape_i)
+    {
+        double results[TEST_NUM_REQUESTS];
+        int shape_rc = run_shape(&shapes[shape_i], results);
+        TEST_CHECK(shape_rc == 0, "%s computes the batch (rc %d)", shapes[shape_i].name, shape_rc);
+        for (size_t request_i = 0; request_i < TEST_NUM_REQUESTS && shape_rc == 0; ++request_i)
+        {
+            TEST_CHECK(memcmp(&results[request_i], &reference[request_i], sizeof(double)) == 0,
+                       "%s: integral %zu is %a, on one worker %a", shapes[shape_i].name, request_i, results[request_i],
+                       reference[request_i]);
+        }
+    }
+    return test_finish();
+}
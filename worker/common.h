@@ -1,25 +1,195 @@
-enum FUNC_TABLE = 
+typedef enum
 {
     EXP,
     SIN,
     SQR,
     NOT_SUPPORT,
+} FUNC_TABLE;
+
+// Квадратурная формула, применяемая на каждом шаге.
+typedef enum
+{
+    RULE_MIDPOINT,
+    RULE_SIMPSON,
+    RULE_GAUSS2,
+    RULE_GAUSS3,
+    RULE_GAUSS4,
+    QUAD_RULES,
+} QUAD_RULE;
+
+// Способ суммирования слагаемых квадратурной суммы.
+typedef enum
+{
+    // Обычное сложение в порядке разбора блоков потоками.
+    SUMMATION_NAIVE,
+    // Компенсированное сложение (Ноймайер) по блокам фиксированного размера и
+    // сложение блоков по порядку — ответ не зависит ни от планирования потоков,
+    // ни от их числа.
+    SUMMATION_COMPENSATED,
+} SUMMATION_MODE;
+
+// Типы кадров протокола обмена с сервером.
+enum FRAME_TYPE
+{
+    FRAME_NODE_INFO = 1,
+    FRAME_TASK      = 2,
+    FRAME_RESULT    = 3,
+    FRAME_STOP      = 4,
+    // Замер производительности узла на заданной функции и ответ на него.
+    FRAME_CALIBRATE   = 5,
+    FRAME_CALIBRATION = 6,
+    // Несколько кусков в одном кадре и ответ на них — по значению на кусок.
+    FRAME_TASK_BATCH   = 7,
+    FRAME_RESULT_BATCH = 8,
+    // Байт-код подынтегрального выражения; ответа не требует.
+    FRAME_EXPR = 9,
+    // Трасса счёта задания; узел отправляет её перед ответом, если задание
+    // попросило флагом WORK_TRACE.
+    FRAME_TRACE = 10,
+};
+
+// Заголовок кадра, за ним следует length байт полезной нагрузки.
+// Ответ на задание несёт request_id этого задания.
+struct frame_header {
+    uint32_t type;
+    uint32_t length;
+    uint64_t request_id;
+};
+
+#define MAX_FRAME_PAYLOAD 4096U
+
+// Флаги задания в worker_data.flags; в пакете действуют флаги первой части.
+enum WORK_FLAGS
+{
+    WORK_TRACE = 1,
 };
 
 struct worker_data {
-    FUNC_TABLE func_id; 
+    int func_id;
+    int rule;
+    // SUMMATION_MODE.
+    int summation;
+    // WORK_FLAGS.
+    int flags;
     double left;
-    double right;
     double step;
-    long long num_steps;
+    uint64_t num_steps;
+};
+
+// Коды ошибок в worker_result.status.
+enum WORKER_STATUS
+{
+    WORKER_EFUNC = 1,
+    WORKER_ERULE = 2,
 };
 
 struct worker_result {
     int status;
     double value;
+    // Время счёта куска: по часам и суммарно по всем потокам узла.
+    double compute_sec;
+    double cpu_sec;
+};
+
+// Сколько кусков помещается в один кадр FRAME_TASK_BATCH.
+#define MAX_BATCH_PARTS (MAX_FRAME_PAYLOAD / sizeof(struct worker_data))
+
+// Ответ на FRAME_TASK_BATCH; передаются только первые num_values значений.
+struct worker_batch_result {
+    int status;
+    uint32_t num_values;
+    double compute_sec;
+    double cpu_sec;
+    double values[MAX_BATCH_PARTS];
+};
+
+// Трасса счёта задания (FRAME_TRACE). Времена — в секундах от прихода заголовка
+// задания на узел; передаются только первые num_threads записей потоков.
+#define MAX_TRACE_THREADS 120U
+
+struct trace_thread {
+    double start_sec;
+    double end_sec;
+    uint64_t steps;
+    // Ядро, на котором поток начал последнюю часть задания (-1 — неизвестно).
+    int32_t cpu;
+    // Сколько частей задания поток начинал считать.
+    uint32_t parts;
+};
+
+struct worker_trace {
+    // Задание прочитано из сокета.
+    double recv_sec;
+    // Все части посчитаны.
+    double join_sec;
+    // Трасса собрана и уходит вместе с ответом.
+    double send_sec;
+    uint32_t num_threads;
+    struct trace_thread threads[MAX_TRACE_THREADS];
+};
+
+struct calibrate_request {
+    int func_id;
+    int rule;
+    double left;
+    double right;
+};
+
+struct calibration_result {
+    int status;
+    // Сколько шагов заданной формулы узел считает за секунду всеми ядрами.
+    double steps_per_sec;
+};
+
+// Подынтегральное выражение, скомпилированное менеджером в байт-код стековой
+// машины (см. expr.h). Приходит кадром FRAME_EXPR до первого задания с ним.
+enum EXPR_OP
+{
+    EXPR_X,
+    // За кодом операции следует байт с номером константы.
+    EXPR_CONST,
+    // Двуместные операции.
+    EXPR_ADD,
+    EXPR_SUB,
+    EXPR_MUL,
+    EXPR_DIV,
+    EXPR_POW,
+    // Одноместные операции.
+    EXPR_NEG,
+    EXPR_EXP,
+    EXPR_LOG,
+    EXPR_SIN,
+    EXPR_COS,
+    EXPR_TAN,
+    EXPR_SQRT,
+    EXPR_ABS,
+    EXPR_ATAN,
+    EXPR_SINH,
+    EXPR_COSH,
+    EXPR_TANH,
+    EXPR_OPS,
+};
+
+#define EXPR_MAX_CODE 512U
+#define EXPR_MAX_CONSTS 128U
+#define EXPR_MAX_STACK 16U
+
+struct expr_program
+{
+    int func_id;
+    uint16_t code_length;
+    uint16_t num_consts;
+    uint8_t code[EXPR_MAX_CODE];
+    double consts[EXPR_MAX_CONSTS];
 };
 
 struct node_info {
     time_t max_worker_time;
     int n_cores;
+    // Топология: доступные процессу логические ЦП, физические ядра среди них,
+    // процессорные сокеты и узлы NUMA.
+    int n_cpus;
+    int n_physical_cores;
+    int n_packages;
+    int n_numa_nodes;
 };
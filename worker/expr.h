@@ -0,0 +1,174 @@
+//============================
+// Подынтегральные выражения
+//============================
+// Менеджер присылает выражение байт-кодом стековой машины (struct expr_program).
+// Байт-код исполняется блоками по EXPR_BLOCK точек: каждая операция один раз
+// выбирается по коду и применяется сразу ко всему блоку, так что разбор кода
+// не попадает во внутренний цикл, а арифметические циклы векторизуются.
+
+#define MAX_INTEGRAND_EXPRS 64U
+#define EXPR_BLOCK 256U
+
+static struct expr_program integrand_exprs[MAX_INTEGRAND_EXPRS];
+static size_t num_integrand_exprs;
+
+// Проверяет байт-код, пришедший по сети: индексы констант и глубину стека.
+static bool expr_program_valid(const struct expr_program *program)
+{
+    if (program->code_length == 0 || program->code_length > EXPR_MAX_CODE || program->num_consts > EXPR_MAX_CONSTS)
+        return false;
+    unsigned depth = 0;
+    for (unsigned pc = 0; pc < program->code_length; ++pc)
+    {
+        uint8_t op = program->code[pc];
+        if (op == EXPR_X || op == EXPR_CONST)
+        {
+            if (op == EXPR_CONST && (++pc == program->code_length || program->code[pc] >= program->num_consts))
+                return false;
+            if (++depth > EXPR_MAX_STACK)
+                return false;
+        }
+        else if (op <= EXPR_POW)
+        {
+            if (depth < 2)
+                return false;
+            depth--;
+        }
+        else if (op < EXPR_OPS)
+        {
+            if (depth < 1)
+                return false;
+        }
+        else
+            return false;
+    }
+    return depth == 1;
+}
+
+static const struct expr_program *expr_find(int func_id)
+{
+    for (size_t expr_i = 0; expr_i < num_integrand_exprs; ++expr_i)
+    {
+        if (integrand_exprs[expr_i].func_id == func_id)
+            return &integrand_exprs[expr_i];
+    }
+    return NULL;
+}
+
+// Запоминает выражение; повторное определение того же идентификатора заменяет старое.
+// Вызывается между заданиями, когда потоки пула не читают байт-код.
+static bool expr_define(const struct expr_program *program)
+{
+    if (!expr_program_valid(program) || (program->func_id >= 0 && program->func_id < NOT_SUPPORT))
+        return false;
+    struct expr_program *slot = (struct expr_program *)expr_find(program->func_id);
+    if (slot == NULL)
+    {
+        if (num_integrand_exprs == MAX_INTEGRAND_EXPRS)
+            return false;
+        slot = &integrand_exprs[num_integrand_exprs++];
+    }
+    *slot = *program;
+    return true;
+}
+
+// Применяет одноместную функцию libm ко всему блоку.
+#define EXPR_UNARY_CASE(OP, FUNC)                                               \
+    case OP:                                                                    \
+        for (unsigned i = 0; i < len; ++i)                                      \
+            top[i] = FUNC(top[i]);                                              \
+        break;
+
+static double expr_sum(const void *ctx, double x0, double h, uint64_t n)
+{
+    const struct expr_program *program = ctx;
+    double stack[EXPR_MAX_STACK][EXPR_BLOCK];
+    double acc0 = 0, acc1 = 0, acc2 = 0, acc3 = 0;
+
+    for (uint64_t first = 0; first < n; first += EXPR_BLOCK)
+    {
+        unsigned len = n - first < EXPR_BLOCK ? (unsigned)(n - first) : EXPR_BLOCK;
+        // Вершина стека; после проверки байт-кода выход за границы невозможен.
+        unsigned depth = 0;
+        for (unsigned pc = 0; pc < program->code_length; ++pc)
+        {
+            uint8_t op = program->code[pc];
+            double *top = stack[depth == 0 ? 0 : depth - 1];
+            double *next = stack[depth];
+            switch (op)
+            {
+            case EXPR_X:
+                for (unsigned i = 0; i < len; ++i)
+                    next[i] = x0 + h * (first + i);
+                depth++;
+                break;
+            case EXPR_CONST:
+            {
+                double value = program->consts[program->code[++pc]];
+                for (unsigned i = 0; i < len; ++i)
+                    next[i] = value;
+                depth++;
+                break;
+            }
+            case EXPR_ADD:
+            case EXPR_SUB:
+            case EXPR_MUL:
+            case EXPR_DIV:
+            case EXPR_POW:
+            {
+                double *restrict a = stack[depth - 2];
+                const double *restrict b = stack[depth - 1];
+                if (op == EXPR_ADD)
+                    for (unsigned i = 0; i < len; ++i)
+                        a[i] += b[i];
+                else if (op == EXPR_SUB)
+                    for (unsigned i = 0; i < len; ++i)
+                        a[i] -= b[i];
+                else if (op == EXPR_MUL)
+                    for (unsigned i = 0; i < len; ++i)
+                        a[i] *= b[i];
+                else if (op == EXPR_DIV)
+                    for (unsigned i = 0; i < len; ++i)
+                        a[i] /= b[i];
+                else
+                    for (unsigned i = 0; i < len; ++i)
+                        a[i] = pow(a[i], b[i]);
+                depth--;
+                break;
+            }
+            case EXPR_NEG:
+                for (unsigned i = 0; i < len; ++i)
+                    top[i] = -top[i];
+                break;
+            EXPR_UNARY_CASE(EXPR_EXP, exp)
+            EXPR_UNARY_CASE(EXPR_LOG, log)
+            EXPR_UNARY_CASE(EXPR_SIN, sin)
+            EXPR_UNARY_CASE(EXPR_COS, cos)
+            EXPR_UNARY_CASE(EXPR_TAN, tan)
+            EXPR_UNARY_CASE(EXPR_SQRT, sqrt)
+            EXPR_UNARY_CASE(EXPR_ABS, fabs)
+            EXPR_UNARY_CASE(EXPR_ATAN, atan)
+            EXPR_UNARY_CASE(EXPR_SINH, sinh)
+            EXPR_UNARY_CASE(EXPR_COSH, cosh)
+            EXPR_UNARY_CASE(EXPR_TANH, tanh)
+            default:
+                break;
+            }
+        }
+
+        const double *values = stack[0];
+        unsigned i = 0;
+        for (; i + 4 <= len; i += 4)
+        {
+            acc0 += values[i];
+            acc1 += values[i + 1];
+            acc2 += values[i + 2];
+            acc3 += values[i + 3];
+        }
+        for (; i < len; ++i)
+            acc0 += values[i];
+    }
+    return (acc0 + acc1) + (acc2 + acc3);
+}
+
+#undef EXPR_UNARY_CASE
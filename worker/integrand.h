@@ -0,0 +1,39 @@
+//============================
+// Подключаемые подынтегральные функции
+//============================
+// Разделяемая библиотека экспортирует функцию integrand_plugin(), возвращающую
+// описание подынтегральной функции. Библиотека загружается через dlopen и в
+// менеджере, и на узлах; по сети функция передаётся идентификатором, который
+// вычисляется по её имени. Заголовок одинаков для менеджера, узлов и библиотек.
+
+#define INTEGRAND_ABI_VERSION 1U
+#define INTEGRAND_PLUGIN_SYMBOL "integrand_plugin"
+// Идентификаторы подключаемых функций не пересекаются со встроенными.
+#define INTEGRAND_PLUGIN_ID_BASE 0x40000000U
+
+typedef struct
+{
+    // INTEGRAND_ABI_VERSION, с которой собрана библиотека.
+    uint32_t abi_version;
+    // Имя функции, по нему вычисляется идентификатор.
+    const char *name;
+    // Сумма f(x0 + i * h), i = 0 .. n - 1. Вызывается из нескольких потоков сразу.
+    double (*sum)(double x0, double h, uint64_t n);
+    // Оценка сверху модуля производной чётного порядка order на [left, right].
+    // Нужна только менеджеру, на узлах может быть NULL.
+    double (*max_derivative)(unsigned order, double left, double right);
+} INTEGRAND_PLUGIN;
+
+typedef const INTEGRAND_PLUGIN *(*INTEGRAND_PLUGIN_ENTRY)(void);
+
+// FNV-1a от имени, сжатый в диапазон идентификаторов подключаемых функций.
+static inline int integrand_plugin_id(const char *name)
+{
+    uint32_t hash = 2166136261U;
+    for (const unsigned char *c = (const unsigned char *)name; *c != '\0'; ++c)
+    {
+        hash ^= *c;
+        hash *= 16777619U;
+    }
+    return (int)(INTEGRAND_PLUGIN_ID_BASE | (hash & (INTEGRAND_PLUGIN_ID_BASE - 1)));
+}
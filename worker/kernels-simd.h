@@ -0,0 +1,118 @@
+// Векторные ядра одной ширины. Файл подключается из kernels.h несколько раз,
+// перед подключением задаются SIMD_WIDTH, SIMD_NAME и SIMD_TARGET.
+
+#define SIMD_CAT_(a, b) a##_##b
+#define SIMD_CAT(a, b) SIMD_CAT_(a, b)
+
+#define VDF SIMD_CAT(vdf, SIMD_NAME)
+#define VDI SIMD_CAT(vdi, SIMD_NAME)
+#define SIMD_INLINE static inline __attribute__((always_inline, target(SIMD_TARGET)))
+#define SIMD_KERNEL static __attribute__((noinline, target(SIMD_TARGET)))
+
+typedef double VDF __attribute__((vector_size(SIMD_WIDTH * sizeof(double))));
+typedef int64_t VDI __attribute__((vector_size(SIMD_WIDTH * sizeof(int64_t))));
+
+// exp(x) для x из [EXP_SIMD_MIN, EXP_SIMD_MAX]:
+// x = n * ln2 + r, |r| <= ln2 / 2, exp(x) = 2^n * P(r).
+SIMD_INLINE VDF SIMD_CAT(vexp, SIMD_NAME)(VDF x)
+{
+    // Прибавление 1.5 * 2^52 округляет до целого, а младшие биты мантиссы хранят n.
+    VDF t = x * M_LOG2E + 0x1.8p52;
+    VDF n = t - 0x1.8p52;
+    VDF r = (x - n * LN2_HI) - n * LN2_LO;
+
+    VDF p = r * (1.0 / 479001600.0) + 1.0 / 39916800.0;
+    p = p * r + 1.0 / 3628800.0;
+    p = p * r + 1.0 / 362880.0;
+    p = p * r + 1.0 / 40320.0;
+    p = p * r + 1.0 / 5040.0;
+    p = p * r + 1.0 / 720.0;
+    p = p * r + 1.0 / 120.0;
+    p = p * r + 1.0 / 24.0;
+    p = p * r + 1.0 / 6.0;
+    p = p * r + 1.0 / 2.0;
+    p = p * r + 1.0;
+    p = p * r + 1.0;
+
+    // Собираем 2^n прямо в битах показателя.
+    VDI ni = (VDI)t - EXP_SHIFT_BITS;
+    VDI scale = (ni + 1023) << 52;
+    return p * (VDF)scale;
+}
+
+// sin(x) для |x| <= SIN_SIMD_MAX:
+// x = k * pi/2 + r, |r| <= pi/4, значение берётся из sin(r) или cos(r) по k mod 4.
+SIMD_INLINE VDF SIMD_CAT(vsin, SIMD_NAME)(VDF x)
+{
+    VDF t = x * M_2_PI + 0x1.8p52;
+    VDF k = t - 0x1.8p52;
+    VDI q = (VDI)t;
+    VDF r = ((x - k * PIO2_1) - k * PIO2_2) - k * PIO2_3;
+    VDF r2 = r * r;
+
+    VDF s = r2 * (1.0 / 355687428096000.0) - 1.0 / 1307674368000.0;
+    s = s * r2 + 1.0 / 6227020800.0;
+    s = s * r2 - 1.0 / 39916800.0;
+    s = s * r2 + 1.0 / 362880.0;
+    s = s * r2 - 1.0 / 5040.0;
+    s = s * r2 + 1.0 / 120.0;
+    s = s * r2 - 1.0 / 6.0;
+    s = s * r2 * r + r;
+
+    VDF c = r2 * (1.0 / 20922789888000.0) - 1.0 / 87178291200.0;
+    c = c * r2 + 1.0 / 479001600.0;
+    c = c * r2 - 1.0 / 3628800.0;
+    c = c * r2 + 1.0 / 40320.0;
+    c = c * r2 - 1.0 / 720.0;
+    c = c * r2 + 1.0 / 24.0;
+    c = c * r2 - 1.0 / 2.0;
+    c = c * r2 + 1.0;
+
+    // Нечётная четверть — берём косинус, четверти 2 и 3 — меняем знак.
+    VDI use_cos = -(q & 1);
+    VDI negate = (q & 2) << 62;
+    VDI res = (((VDI)s & ~use_cos) | ((VDI)c & use_cos)) ^ negate;
+    return (VDF)res;
+}
+
+SIMD_INLINE VDF SIMD_CAT(vsqr, SIMD_NAME)(VDF x)
+{
+    return x * x;
+}
+
+// Сумма f(x0 + i * h) по i = 0 .. n - 1. Два независимых аккумулятора
+// разрывают цепочку зависимостей по сложению, хвост досчитывается скалярно.
+#define DEFINE_SIMD_SUM(FUNC)                                                   \
+SIMD_KERNEL double SIMD_CAT(sum_##FUNC, SIMD_NAME)(const void *ctx, double x0, double h, uint64_t n) \
+{                                                                               \
+    VDF idx;                                                                    \
+    for (int lane = 0; lane < SIMD_WIDTH; ++lane)                               \
+        idx[lane] = lane;                                                       \
+                                                                                \
+    VDF acc0 = {0};                                                             \
+    VDF acc1 = {0};                                                             \
+    uint64_t i = 0;                                                             \
+    for (; i + 2 * SIMD_WIDTH <= n; i += 2 * SIMD_WIDTH)                        \
+    {                                                                           \
+        acc0 += SIMD_CAT(v##FUNC, SIMD_NAME)(x0 + h * (idx + (double)i));      \
+        acc1 += SIMD_CAT(v##FUNC, SIMD_NAME)(x0 + h * (idx + (double)(i + SIMD_WIDTH))); \
+    }                                                                           \
+                                                                                \
+    acc0 += acc1;                                                               \
+    double sum = 0;                                                             \
+    for (int lane = 0; lane < SIMD_WIDTH; ++lane)                               \
+        sum += acc0[lane];                                                      \
+    return sum + sum_##FUNC##_scalar(ctx, x0 + h * i, h, n - i);                \
+}
+
+DEFINE_SIMD_SUM(exp)
+DEFINE_SIMD_SUM(sin)
+DEFINE_SIMD_SUM(sqr)
+
+#undef DEFINE_SIMD_SUM
+#undef SIMD_KERNEL
+#undef SIMD_INLINE
+#undef VDI
+#undef VDF
+#undef SIMD_CAT
+#undef SIMD_CAT_
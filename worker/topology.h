@@ -0,0 +1,173 @@
+//============================
+// Топология узла
+//============================
+// Потоки пула закрепляются только за ЦП из маски процесса (её сужают cgroups,
+// taskset, планировщик кластера). Сначала каждому потоку достаётся своё физическое
+// ядро: соседи по SMT делят конвейер и блок FP, а цикл интегрирования упирается
+// именно в него. Ядра берутся по очереди из разных узлов NUMA, чтобы потоки не
+// делили кэш последнего уровня и шину памяти одного сокета. Вторые потоки ядер
+// (SMT) используются, только когда физических ядер меньше, чем потоков.
+// Сведения берутся из sysfs; если их нет, каждый ЦП считается отдельным ядром
+// единственного узла NUMA.
+
+#define SYSFS_CPU_DIR "/sys/devices/system/cpu"
+
+typedef struct
+{
+    int cpu;
+    int package;
+    int core;
+    int node;
+    // Номер ЦП среди соседей по физическому ядру (0 — первый поток ядра)
+    // и номер ядра среди ядер его узла NUMA.
+    int sibling;
+    int node_core;
+} CPU_PLACE;
+
+typedef struct
+{
+    // Доступные процессу ЦП в порядке, в котором их получают потоки пула.
+    CPU_PLACE *cpus;
+    int num_cpus;
+    int num_cores;
+    int num_packages;
+    int num_nodes;
+} TOPOLOGY;
+
+// Читает целое из файла sysfs; возвращает fallback, если файла нет.
+static int sysfs_read_int(const char *path, int fallback)
+{
+    FILE *file = fopen(path, "r");
+    if (file == NULL)
+        return fallback;
+    int value;
+    if (fscanf(file, "%d", &value) != 1)
+        value = fallback;
+    fclose(file);
+    return value;
+}
+
+// Узел NUMA, к которому относится ЦП: в каталоге ЦП есть ссылка nodeN.
+static int sysfs_cpu_node(int cpu)
+{
+    char path[128];
+    snprintf(path, sizeof(path), SYSFS_CPU_DIR "/cpu%d", cpu);
+    DIR *dir = opendir(path);
+    if (dir == NULL)
+        return 0;
+    int node = 0;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (strncmp(entry->d_name, "node", 4) == 0 && isdigit((unsigned char)entry->d_name[4]))
+        {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+// Порядок выдачи ЦП потокам: сначала первые потоки ядер, среди них — по
+// очереди из каждого узла NUMA.
+static int cpu_place_compare(const void *a, const void *b)
+{
+    const CPU_PLACE *x = a, *y = b;
+    if (x->sibling != y->sibling)
+        return x->sibling - y->sibling;
+    if (x->node_core != y->node_core)
+        return x->node_core - y->node_core;
+    if (x->node != y->node)
+        return x->node - y->node;
+    return x->cpu - y->cpu;
+}
+
+static bool same_core(const CPU_PLACE *x, const CPU_PLACE *y)
+{
+    return x->package == y->package && x->core == y->core;
+}
+
+static TOPOLOGY topology_read(void)
+{
+    TOPOLOGY topo = {0};
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == -1)
+    {
+        // Маска недоступна — считаем доступными все ЦП системы.
+        CPU_ZERO(&allowed);
+        for (int cpu = 0; cpu < get_nprocs() && cpu < CPU_SETSIZE; ++cpu)
+            CPU_SET(cpu, &allowed);
+    }
+
+    topo.cpus = calloc(CPU_COUNT(&allowed), sizeof(CPU_PLACE));
+    if (topo.cpus == NULL)
+    {
+        fprintf(stderr, "Unable to allocate cpu topology\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if (!CPU_ISSET(cpu, &allowed))
+            continue;
+        char path[128];
+        CPU_PLACE *place = &topo.cpus[topo.num_cpus++];
+        place->cpu = cpu;
+        snprintf(path, sizeof(path), SYSFS_CPU_DIR "/cpu%d/topology/physical_package_id", cpu);
+        place->package = sysfs_read_int(path, 0);
+        snprintf(path, sizeof(path), SYSFS_CPU_DIR "/cpu%d/topology/core_id", cpu);
+        place->core = sysfs_read_int(path, cpu);
+        place->node = sysfs_cpu_node(cpu);
+    }
+
+    // Нумеруем соседей по ядру и ядра внутри узлов; ЦП перебираются по возрастанию
+    // номера, так что первым потоком ядра становится его младший ЦП.
+    for (int i = 0; i < topo.num_cpus; ++i)
+    {
+        CPU_PLACE *place = &topo.cpus[i];
+        int first = i;
+        for (int j = 0; j < i; ++j)
+        {
+            if (same_core(&topo.cpus[j], place))
+            {
+                place->sibling++;
+                if (first == i)
+                    first = j;
+            }
+        }
+        if (first != i)
+        {
+            place->node_core = topo.cpus[first].node_core;
+            continue;
+        }
+        topo.num_cores++;
+        for (int j = 0; j < i; ++j)
+        {
+            if (topo.cpus[j].sibling == 0 && topo.cpus[j].node == place->node)
+                place->node_core++;
+        }
+        bool new_package = true, new_node = true;
+        for (int j = 0; j < i; ++j)
+        {
+            new_package = new_package && topo.cpus[j].package != place->package;
+            new_node = new_node && topo.cpus[j].node != place->node;
+        }
+        topo.num_packages += new_package;
+        topo.num_nodes += new_node;
+    }
+
+    qsort(topo.cpus, topo.num_cpus, sizeof(CPU_PLACE), cpu_place_compare);
+    return topo;
+}
+
+// ЦП для потока thread_i; потоков больше, чем ЦП, — идём по кругу.
+static int topology_thread_cpu(const TOPOLOGY *topo, int thread_i)
+{
+    return topo->cpus[thread_i % topo->num_cpus].cpu;
+}
+
+static void topology_free(TOPOLOGY *topo)
+{
+    free(topo->cpus);
+    topo->cpus = NULL;
+}
@@ -4,57 +4,50 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <stddef.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdatomic.h>
 #include <math.h>
 #include <pthread.h>
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 #include <sys/stat.h>
 #include <sys/sysinfo.h>
+#include <dirent.h>
+#include <ctype.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
 
 #include <fcntl.h>
 #include <netdb.h>
 #include <unistd.h>
 #include <errno.h>
 #include <time.h>
-#include <shed.h>
+#include <sched.h>
+#include <dlfcn.h>
 
 #include "common.h"
+#include "integrand.h"
+#include "expr.h"
+#include "kernels.h"
+#include "topology.h"
 #include "worker.h"
 
-//================
-// Данные исполнителя.
-//================
-
-typedef struct
-{
-    // Дескриптор сокета для подключения к серверу.
-    int server_conn_fd;
-
-    // Адрес для подключению к серверу.
-    struct sockaddr server_addr;
-
-    // Максимальное время вычисления.
-    time_t max_time;
-
-    // Количество ядер.
-    int n_cores;
-
-    // Данные для вычисления интеграла.
-    struct worker_data data;
-    
-    // Результат вычислений.
-    double result;
-} INFO_WORKER;
-
-
 //==================
 // Управление сетью
 //==================
 static bool worker_connect_to_server(INFO_WORKER* worker)
 {
+    worker->server_conn_fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (worker->server_conn_fd == -1)
+    {
+        fprintf(stderr, "[worker_connect_to_server] Unable to create socket()\n");
+        exit(EXIT_FAILURE);
+    }
+
     if (connect(worker->server_conn_fd, &worker->server_addr, sizeof(worker->server_addr)) == -1)
     {
         if (errno == ECONNREFUSED)
@@ -68,6 +61,14 @@ static bool worker_connect_to_server(INFO_WORKER* worker)
         exit(EXIT_FAILURE);
     }
 
+    // Disable Nagle's algorithm: ответы на подряд идущие задания не должны ждать ACK.
+    int setsockopt_arg = 1;
+    if (setsockopt(worker->server_conn_fd, IPPROTO_TCP, TCP_NODELAY, &setsockopt_arg, sizeof(setsockopt_arg)) == -1)
+    {
+        fprintf(stderr, "[worker_connect_to_server] Unable to enable TCP_NODELAY socket option\n");
+        exit(EXIT_FAILURE);
+    }
+
     return true;
 }
 
@@ -85,111 +86,404 @@ static void worker_close_socket(INFO_WORKER* worker)
 // Передача данных по сети.
 //=================================
 
-#define TRANSFER_BLOCK_SIZE 1024U
+// Ставит кадр в очередь на отправку; payload не копируется.
+static void queue_frame(INFO_WORKER *worker, uint32_t type, uint64_t request_id, const void *payload, uint32_t length)
+{
+    unsigned frame_i = worker->num_out_frames++;
+    worker->out_headers[frame_i] = (struct frame_header){.type = type, .length = length, .request_id = request_id};
+    worker->out_iov[2 * frame_i] = (struct iovec){.iov_base = &worker->out_headers[frame_i], .iov_len = sizeof(struct frame_header)};
+    worker->out_iov[2 * frame_i + 1] = (struct iovec){.iov_base = (void *)payload, .iov_len = length};
+}
+
+// Отправляет все кадры очереди одним системным вызовом (несколькими, если сокет
+// принял их не целиком).
+static bool flush_frames(INFO_WORKER *worker)
+{
+    struct iovec *iov = worker->out_iov;
+    int iov_count = 2 * worker->num_out_frames;
+    worker->num_out_frames = 0;
+    while (iov_count > 0)
+    {
+        ssize_t bytes_written = writev(worker->server_conn_fd, iov, iov_count);
+        if (bytes_written == -1)
+        {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        while (iov_count > 0 && (size_t)bytes_written >= iov->iov_len)
+        {
+            bytes_written -= iov->iov_len;
+            iov++;
+            iov_count--;
+        }
+        if (iov_count > 0)
+        {
+            iov->iov_base = (char *)iov->iov_base + bytes_written;
+            iov->iov_len -= bytes_written;
+        }
+    }
+    return true;
+}
+
+static bool send_frame(INFO_WORKER *worker, uint32_t type, uint64_t request_id, const void *payload, uint32_t length)
+{
+    queue_frame(worker, type, request_id, payload, length);
+    return flush_frames(worker);
+}
+
+// Читает ровно length байт. Из сокета берётся всё, что в нём есть, так что задания,
+// пришедшие подряд, разбираются из буфера без системных вызовов. Возвращает
+// false при ошибке или конце потока; eof — поток кончился до первого байта.
+static bool recv_exact(INFO_WORKER *worker, void *dst, size_t length, bool *eof)
+{
+    *eof = false;
+    while (worker->input_tail - worker->input_head < length)
+    {
+        if (worker->input_head != 0)
+        {
+            memmove(worker->input, worker->input + worker->input_head, worker->input_tail - worker->input_head);
+            worker->input_tail -= worker->input_head;
+            worker->input_head = 0;
+        }
+        ssize_t bytes_read = recv(worker->server_conn_fd, worker->input + worker->input_tail,
+                                  sizeof(worker->input) - worker->input_tail, 0);
+        if (bytes_read == -1 && errno == EINTR)
+            continue;
+        if (bytes_read <= 0)
+        {
+            *eof = bytes_read == 0 && worker->input_tail == 0;
+            return false;
+        }
+        worker->input_tail += bytes_read;
+    }
+    memcpy(dst, worker->input + worker->input_head, length);
+    worker->input_head += length;
+    return true;
+}
 
 static bool get_data(INFO_WORKER* worker)
 {
-    size_t bytes_read = recv(worker->server_conn_fd, &worker->data, sizeof(worker->data), MSG_WAITALL);
-    if (bytes_read != sizeof(worker->data))
+    struct frame_header hdr;
+    bool eof;
+    if (!recv_exact(worker, &hdr, sizeof(hdr), &eof))
     {
-        fprintf(stderr, "Unable to recv data from server\n");
+        if (eof)
+        {
+            // Сервер закрыл соединение — считаем это окончанием сеанса.
+            worker->stop = true;
+            return true;
+        }
+        fprintf(stderr, "Unable to recv frame header from server\n");
         return false;
     }
+    struct timespec received;
+    clock_gettime(CLOCK_MONOTONIC, &received);
 
-    return true;
+    worker->calibrate = false;
+    switch (hdr.type)
+    {
+    case FRAME_STOP:
+        worker->stop = true;
+        return true;
+    case FRAME_TASK:
+    case FRAME_TASK_BATCH:
+        if (hdr.length == 0 || hdr.length > sizeof(worker->data) || hdr.length % sizeof(struct worker_data) != 0)
+            break;
+        if (hdr.type == FRAME_TASK && hdr.length != sizeof(struct worker_data))
+            break;
+        if (!recv_exact(worker, worker->data, hdr.length, &eof))
+            break;
+        worker->num_parts = hdr.length / sizeof(struct worker_data);
+        worker->batch = hdr.type == FRAME_TASK_BATCH;
+        worker->request_id = hdr.request_id;
+        worker->received = received;
+        worker->tracing = (worker->data[0].flags & WORK_TRACE) != 0;
+        return true;
+    case FRAME_CALIBRATE:
+        if (hdr.length != sizeof(worker->calibration))
+            break;
+        if (!recv_exact(worker, &worker->calibration, sizeof(worker->calibration), &eof))
+            break;
+        worker->request_id = hdr.request_id;
+        worker->calibrate = true;
+        worker->tracing = false;
+        return true;
+    case FRAME_EXPR:
+    {
+        struct expr_program program;
+        if (hdr.length != sizeof(program))
+            break;
+        if (!recv_exact(worker, &program, sizeof(program), &eof))
+            break;
+        // Непринятое выражение не страшно: задания с ним узел отклонит.
+        if (!expr_define(&program))
+            fprintf(stderr, "Rejected integrand expression %d\n", program.func_id);
+        // Ответа кадр не требует — ждём следующий.
+        return get_data(worker);
+    }
+    default:
+        break;
+    }
+
+    fprintf(stderr, "Unable to recv data from server\n");
+    return false;
 }
 
 static bool send_result(INFO_WORKER *worker)
 {
     if (!worker)
         return false;
-    struct worker_result res_to_send = {0, worker->result};
+    bool success;
+    if (worker->batch)
+    {
+        struct worker_batch_result res_to_send = {.status = worker->status, .num_values = worker->num_parts,
+                                                  .compute_sec = worker->compute_sec, .cpu_sec = worker->cpu_sec};
+        memcpy(res_to_send.values, worker->result, worker->num_parts * sizeof(double));
+        uint32_t length = offsetof(struct worker_batch_result, values) + worker->num_parts * sizeof(double);
+        success = send_frame(worker, FRAME_RESULT_BATCH, worker->request_id, &res_to_send, length);
+    }
+    else
+    {
+        struct worker_result res_to_send = {worker->status, worker->result[0], worker->compute_sec, worker->cpu_sec};
+        success = send_frame(worker, FRAME_RESULT, worker->request_id, &res_to_send, sizeof(res_to_send));
+    }
 
-    size_t bytes_written = write(conn->server_sock_fd, &res_to_send, sizeof(res_to_send));
-    if (bytes_written != sizeof(res_to_send))
+    if (!success)
     {
         fprintf(stderr, "Unable to send result to server\n");
         return false;
     }
+    return true;
+}
+
+static bool send_calibration(INFO_WORKER *worker, struct calibration_result *res)
+{
+    if (!send_frame(worker, FRAME_CALIBRATION, worker->request_id, res, sizeof(*res)))
+    {
+        fprintf(stderr, "Unable to send calibration to server\n");
+        return false;
+    }
+    return true;
 }
 
 static bool send_node_info(INFO_WORKER *worker, struct node_info *info)
 {
     if (!worker)
         return false;
-    struct worker_result res_to_send = {0, worker->result};
-
-    size_t bytes_written = write(conn->server_sock_fd, info, sizeof(*info));
-    if (bytes_written != sizeof(res_to_send))
+    if (!send_frame(worker, FRAME_NODE_INFO, 0, info, sizeof(*info)))
     {
         fprintf(stderr, "Unable to send node info to server\n");
         return false;
     }
+    return true;
 }
 
 //============================
-// Вычисление значений функций
+// Квадратурные формулы
 //============================
-static double func_val(FUNC_TABLE func_id, double x)
+// Каждая формула сводится к суммам значений функции по сдвинутым
+// арифметическим прогрессиям, которые считают ядра из kernels.h.
+
+// Узлы на [-1, 1] и веса формул Гаусса-Лежандра.
+struct gauss_rule
+{
+    int n;
+    double nodes[4];
+    double weights[4];
+};
+
+static const struct gauss_rule gauss_rules[QUAD_RULES] = {
+    [RULE_GAUSS2] = {2, {-0.57735026918962576, 0.57735026918962576}, {1.0, 1.0}},
+    [RULE_GAUSS3] = {3, {-0.77459666924148338, 0.0, 0.77459666924148338},
+                        {0.55555555555555556, 0.88888888888888889, 0.55555555555555556}},
+    [RULE_GAUSS4] = {4, {-0.86113631159405258, -0.33998104358485626, 0.33998104358485626, 0.86113631159405258},
+                        {0.34785484513745386, 0.65214515486254614, 0.65214515486254614, 0.34785484513745386}},
+};
+
+// Интеграл по n шагам длины h, начиная с left.
+static double integrate_range(QUAD_RULE rule, INTEGRAND_SUM sum, const void *ctx, double left, double h, uint64_t n)
 {
-    switch(func_id) {
-        case EXP:
-            return exp(x);
-        case SIN:
-            return sin(x);
-        case SQR:
-            return x * x;
-        default:
-            fprintf(stderr, "Unexpected id for function\n");
-            exit("EXIT_FAILURE");
+    if (n == 0)
+        return 0;
+
+    switch (rule)
+    {
+    case RULE_MIDPOINT:
+        return h * sum(ctx, left + h / 2, h, n);
+    case RULE_SIMPSON:
+    {
+        // Внутренние узлы сетки входят в два соседних шага.
+        double right = left + h * n;
+        double nodes = 2 * sum(ctx, left, h, n + 1) - sum(ctx, left, 0, 1) - sum(ctx, right, 0, 1);
+        return h / 6 * (nodes + 4 * sum(ctx, left + h / 2, h, n));
+    }
+    case RULE_GAUSS2:
+    case RULE_GAUSS3:
+    case RULE_GAUSS4:
+    {
+        const struct gauss_rule *gauss = &gauss_rules[rule];
+        double result = 0;
+        for (int k = 0; k < gauss->n; ++k)
+            result += gauss->weights[k] * sum(ctx, left + h * (1 + gauss->nodes[k]) / 2, h, n);
+        return h / 2 * result;
+    }
+    default:
+        return 0;
     }
 }
 
+// Слагаемых на один вызов ядра при компенсированном суммировании: на таких
+// отрезках ошибка ядра пренебрежимо мала, а отрезки складываются с компенсацией.
+#define COMPENSATED_BLOCK_STEPS 512U
+
+// Компенсированное сложение Ноймайера: comp накапливает потерянные младшие разряды.
+static inline void neumaier_add(double *sum, double *comp, double value)
+{
+    double t = *sum + value;
+    if (fabs(*sum) >= fabs(value))
+        *comp += (*sum - t) + value;
+    else
+        *comp += (value - t) + *sum;
+    *sum = t;
+}
+
+static double integrate_range_compensated(QUAD_RULE rule, INTEGRAND_SUM sum, const void *ctx, double left, double h, uint64_t n)
+{
+    double result = 0, comp = 0;
+    for (uint64_t first = 0; first < n; first += COMPENSATED_BLOCK_STEPS)
+    {
+        uint64_t parts = n - first < COMPENSATED_BLOCK_STEPS ? n - first : COMPENSATED_BLOCK_STEPS;
+        neumaier_add(&result, &comp, integrate_range(rule, sum, ctx, left + first * h, h, parts));
+    }
+    return result + comp;
+}
+
 //============================
-// Распределение задач
+// Пул потоков
 //============================
-struct thread_args = 
+
+// Сколько раз поток опрашивает флаг, прежде чем заснуть на условной переменной:
+// короткие задания подхватываются без системных вызовов.
+#define POOL_SPIN_ITERS 20000U
+
+static inline void cpu_relax(void)
 {
-    int func_id;
-    long long parts;
-    double left;
-    double step;
-    double retval;
-};
+#if defined(__x86_64__)
+    __builtin_ia32_pause();
+#endif
+}
+
+// Ждёт задание с номером, отличным от seen.
+static uint64_t pool_wait_start(THREAD_POOL *pool, uint64_t seen)
+{
+    for (unsigned spin = 0; spin < pool->spin_iters; ++spin)
+    {
+        uint64_t generation = atomic_load_explicit(&pool->generation, memory_order_acquire);
+        if (generation != seen || atomic_load(&pool->shutdown))
+            return generation;
+        cpu_relax();
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    while (atomic_load(&pool->generation) == seen && !atomic_load(&pool->shutdown))
+        pthread_cond_wait(&pool->start_cond, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+    return atomic_load(&pool->generation);
+}
+
+static double timespec_diff_sec(const struct timespec *from, const struct timespec *to)
+{
+    return (to->tv_sec - from->tv_sec) + (to->tv_nsec - from->tv_nsec) * 1e-9;
+}
 
 static void *thread_func(void *t_args)
 {
-    double result = 0;
-    struct thread_args *args = (struct thread_args) t_args;
-    for (long long i = 0; i < parts; ++i) {
-        result += args->step * func_val(args->func_id, left + step * i + step / 2);
+    struct thread_args *args = (struct thread_args *) t_args;
+    THREAD_POOL *pool = args->pool;
+    uint64_t seen = 0;
+
+    while (true)
+    {
+        seen = pool_wait_start(pool, seen);
+        if (atomic_load(&pool->shutdown))
+            break;
+
+        // Блоки берутся из общего счётчика: поток, которому досталось ядро
+        // похуже, просто возьмёт меньше блоков.
+        POOL_TASK *task = &pool->task;
+        double result = 0;
+        uint64_t block;
+        clock_gettime(CLOCK_MONOTONIC, &args->start);
+        args->cpu = sched_getcpu();
+        args->steps = 0;
+        while ((block = atomic_fetch_add_explicit(&task->next_block, 1, memory_order_relaxed)) < task->num_blocks)
+        {
+            uint64_t first = block * task->block_steps;
+            uint64_t parts = task->num_steps - first < task->block_steps ? task->num_steps - first : task->block_steps;
+            double left = task->left + first * task->step;
+            args->steps += parts;
+            if (task->summation == SUMMATION_COMPENSATED)
+                task->block_sums[block] = integrate_range_compensated(task->rule, task->sum, task->ctx, left, task->step, parts);
+            else
+                result += integrate_range(task->rule, task->sum, task->ctx, left, task->step, parts);
+        }
+        clock_gettime(CLOCK_MONOTONIC, &args->end);
+        args->retval = result;
+        args->busy_sec = timespec_diff_sec(&args->start, &args->end);
+
+        // Последний закончивший поток будит ожидающего.
+        if (atomic_fetch_sub_explicit(&pool->pending, 1, memory_order_acq_rel) == 1)
+        {
+            pthread_mutex_lock(&pool->lock);
+            pthread_cond_signal(&pool->done_cond);
+            pthread_mutex_unlock(&pool->lock);
+        }
     }
-    args->retval = result;
     return NULL;
 }
 
-static double distributed_counting(INFO_WORKER *worker)
+static THREAD_POOL *thread_pool_create(int threads_num)
 {
-    // Проверка валидности запрашиваемого числа ядер
-    if (worker->n_cores > get_nprocs()) {
-        fprintf(strerr, "[distributed_counting] the number of processors currently \
-                available in the system is less than %s\n", worker->n_cores);
+    THREAD_POOL *pool = calloc(1, sizeof(THREAD_POOL));
+    if (pool == NULL) {
+        fprintf(stderr, "Unable to allocate thread pool\n");
+        exit(EXIT_FAILURE);
     }
+    pool->topology = topology_read();
 
-    int threads_num = n_cores;
-    pthread_t threads[threads_num];
-    struct thread_args args[threads_num];
-    // Левая граница подотрезка для потока.
-    double left = worker->data.left;
-    // Число подотрезков для одного потока.
-    long long thread_parts = worker->data.num_steps / threads_num;
+    // Проверка валидности запрашиваемого числа ядер
+    int n_cpus = pool->topology.num_cpus;
+    if (threads_num > n_cpus) {
+        fprintf(stderr, "[thread_pool_init] the number of processors "
+                "available to the process is less than %d\n", threads_num);
+    } else if (threads_num > pool->topology.num_cores) {
+        fprintf(stderr, "[thread_pool_init] %d threads share %d physical cores\n",
+                threads_num, pool->topology.num_cores);
+    }
+    pool->threads_num = threads_num;
+    // Если потокам не хватает ядер, ожидание в цикле только отнимает у них время.
+    pool->spin_iters = threads_num < n_cpus ? POOL_SPIN_ITERS : 0;
+    pool->threads = calloc(threads_num, sizeof(pthread_t));
+    pool->args = aligned_alloc(_Alignof(struct thread_args), threads_num * sizeof(struct thread_args));
+    if (pool->threads == NULL || pool->args == NULL) {
+        fprintf(stderr, "Unable to allocate thread pool\n");
+        exit(EXIT_FAILURE);
+    }
+    memset(pool->args, 0, threads_num * sizeof(struct thread_args));
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start_cond, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    atomic_init(&pool->generation, 0);
+    atomic_init(&pool->pending, 0);
+    atomic_init(&pool->shutdown, false);
 
     for (int i = 0; i < threads_num; ++i) {
         // Выбор ядра для выполнения потока.
         cpu_set_t cpuset;
         CPU_ZERO(&cpuset);
-        CPU_SET(i % n_cores, &cpuset);
-        
+        CPU_SET(topology_thread_cpu(&pool->topology, i), &cpuset);
+
         pthread_attr_t thread_attr;
         if(pthread_attr_init(&thread_attr)) {
             fprintf(stderr, "pthread_attr_init returns with error\n");
@@ -197,19 +491,13 @@ static double distributed_counting(INFO_WORKER *worker)
         }
 
         // Устанавливаем аффинность потока.
-        if (pthread_attr_setaffinity_np(&thread_attr, sizeof(cpu_set_t), &assigned_harts)) {
+        if (pthread_attr_setaffinity_np(&thread_attr, sizeof(cpu_set_t), &cpuset)) {
             fprintf(stderr, "pthread_attr_setaffinity_np returns with error\n");
             exit(EXIT_FAILURE);
         }
 
-        args[i].func_id = worker->data.func_id;
-        args[i].left    = left;
-        args[i].step    = worker->data.step;
-        args[i].parts   = thread_parts;
-        if (i < worker->data.num_steps % threads_num)
-            ++args[i].parts;
-         
-        if (pthread_create(&threads[i], &thread_attr, thread_func, &args[i])) {
+        pool->args[i].pool = pool;
+        if (pthread_create(&pool->threads[i], &thread_attr, thread_func, &pool->args[i])) {
             fprintf(stderr, "Unable to create thread\n");
             exit(EXIT_FAILURE);
         }
@@ -219,36 +507,234 @@ static double distributed_counting(INFO_WORKER *worker)
             fprintf(stderr, "Unable to destroy a thread attributes object\n");
             exit(EXIT_FAILURE);
         }
+    }
+    return pool;
+}
 
+// Раздаёт потокам подготовленные args и ждёт, пока все закончат.
+static void thread_pool_run(THREAD_POOL *pool)
+{
+    atomic_store(&pool->pending, pool->threads_num);
+
+    pthread_mutex_lock(&pool->lock);
+    atomic_fetch_add_explicit(&pool->generation, 1, memory_order_release);
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (unsigned spin = 0; spin < pool->spin_iters; ++spin)
+    {
+        if (atomic_load_explicit(&pool->pending, memory_order_acquire) == 0)
+            return;
+        cpu_relax();
     }
 
-    double result = 0;
-    // Ждём завершения потоков и вычисляем результат.
-    for (size_t i = 0; i < threads_num; ++i)
+    pthread_mutex_lock(&pool->lock);
+    while (atomic_load(&pool->pending) != 0)
+        pthread_cond_wait(&pool->done_cond, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void thread_pool_destroy(THREAD_POOL *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    atomic_store(&pool->shutdown, true);
+    pthread_cond_broadcast(&pool->start_cond);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->threads_num; ++i)
     {
-        if (pthread_join(&threads[i], NULL)) {
+        if (pthread_join(pool->threads[i], NULL)) {
             fprintf(stderr, "Unable to join a thread\n");
             exit(EXIT_FAILURE);
         }
-        result += args[i].retval;
     }
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_cond_destroy(&pool->start_cond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->task.block_sums);
+    topology_free(&pool->topology);
+    free(pool->args);
+    free(pool->threads);
+    free(pool);
+}
+
+//============================
+// Трасса задания
+//============================
+
+static double trace_offset_sec(const INFO_WORKER *worker, const struct timespec *time)
+{
+    return timespec_diff_sec(&worker->received, time);
+}
+
+static double trace_now_sec(const INFO_WORKER *worker)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return trace_offset_sec(worker, &now);
+}
+
+static void trace_begin(INFO_WORKER *worker)
+{
+    struct worker_trace *trace = &worker->trace;
+    trace->recv_sec = trace_now_sec(worker);
+    trace->num_threads = (uint32_t)worker->pool->threads_num < MAX_TRACE_THREADS ? (uint32_t)worker->pool->threads_num : MAX_TRACE_THREADS;
+    for (uint32_t i = 0; i < trace->num_threads; ++i)
+        trace->threads[i] = (struct trace_thread){.cpu = -1};
+}
+
+// Добавляет к трассе работу потоков над только что посчитанной частью задания.
+static void trace_threads(INFO_WORKER *worker)
+{
+    struct worker_trace *trace = &worker->trace;
+    for (uint32_t i = 0; i < trace->num_threads; ++i)
+    {
+        const struct thread_args *args = &worker->pool->args[i];
+        struct trace_thread *thread = &trace->threads[i];
+        double start = trace_offset_sec(worker, &args->start);
+        if (thread->parts == 0 || start < thread->start_sec)
+            thread->start_sec = start;
+        thread->end_sec = trace_offset_sec(worker, &args->end);
+        thread->steps += args->steps;
+        thread->cpu = args->cpu;
+        thread->parts++;
+    }
+}
+
+static void queue_trace(INFO_WORKER *worker)
+{
+    worker->trace.send_sec = trace_now_sec(worker);
+    uint32_t length = offsetof(struct worker_trace, threads) + worker->trace.num_threads * sizeof(struct trace_thread);
+    // Трасса уходит одним вызовом вместе с ответом (см. send_result).
+    queue_frame(worker, FRAME_TRACE, worker->request_id, &worker->trace, length);
+}
+
+//============================
+// Распределение задач
+//============================
+
+// Блоков на поток: достаточно мелко, чтобы выровнять хвост, и достаточно
+// крупно, чтобы атомарный счётчик не стал узким местом.
+#define BLOCKS_PER_THREAD 16U
+#define MIN_BLOCK_STEPS 2048U
+// При компенсированном суммировании размер блока не зависит от числа потоков:
+// суммы блоков складываются по порядку, и ответ части одинаков на любом узле.
+#define COMPENSATED_TASK_BLOCK_STEPS (1U << 14)
+
+static double distributed_counting(INFO_WORKER *worker, const struct worker_data *data, INTEGRAND_SUM sum, const void *ctx)
+{
+    THREAD_POOL *pool = worker->pool;
+    POOL_TASK *task = &pool->task;
+
+    task->rule      = data->rule;
+    task->summation = data->summation == SUMMATION_COMPENSATED ? SUMMATION_COMPENSATED : SUMMATION_NAIVE;
+    task->sum       = sum;
+    task->ctx       = ctx;
+    task->left      = data->left;
+    task->step      = data->step;
+    task->num_steps = data->num_steps;
+    if (task->summation == SUMMATION_COMPENSATED)
+    {
+        task->block_steps = COMPENSATED_TASK_BLOCK_STEPS;
+    }
+    else
+    {
+        task->block_steps = task->num_steps / ((uint64_t)pool->threads_num * BLOCKS_PER_THREAD);
+        if (task->block_steps < MIN_BLOCK_STEPS)
+            task->block_steps = MIN_BLOCK_STEPS;
+    }
+    task->num_blocks = (task->num_steps + task->block_steps - 1) / task->block_steps;
+    atomic_store_explicit(&task->next_block, 0, memory_order_relaxed);
+    if (task->summation == SUMMATION_COMPENSATED && task->num_blocks > task->block_sums_capacity)
+    {
+        task->block_sums = realloc(task->block_sums, task->num_blocks * sizeof(double));
+        if (task->block_sums == NULL)
+        {
+            fprintf(stderr, "Unable to allocate block sums\n");
+            exit(EXIT_FAILURE);
+        }
+        task->block_sums_capacity = task->num_blocks;
+    }
+
+    thread_pool_run(pool);
+
+    for (int i = 0; i < pool->threads_num; ++i)
+        worker->cpu_sec += pool->args[i].busy_sec;
+    if (worker->tracing)
+        trace_threads(worker);
+
+    if (task->summation == SUMMATION_COMPENSATED)
+    {
+        double result = 0, comp = 0;
+        for (uint64_t block = 0; block < task->num_blocks; ++block)
+            neumaier_add(&result, &comp, task->block_sums[block]);
+        return result + comp;
+    }
+
+    double result = 0;
+    for (int i = 0; i < pool->threads_num; ++i)
+        result += pool->args[i].retval;
     return result;
 }
 
 //============================
-// Интерфейс исполнителя
+// Замер производительности
 //============================
 
-INFO_WORKER init_worker(int n_cores, time_t max_time, char *node, char *service)
+// Замер повторяется с удвоением числа шагов, пока не займёт CALIBRATION_SEC:
+// короткие прогоны не показывают установившуюся скорость.
+#define CALIBRATION_MIN_STEPS (1U << 14)
+#define CALIBRATION_MAX_STEPS (1ULL << 32)
+#define CALIBRATION_SEC 0.01
+
+static struct calibration_result calibrate(INFO_WORKER *worker)
 {
-    INFO_WORKER worker = {.n_cores = n_cores, .max_time = max_time};
+    struct calibration_result res = {0};
+    struct calibrate_request *req = &worker->calibration;
+    const void *ctx;
+    INTEGRAND_SUM sum = select_sum(req->func_id, req->left, req->right, &ctx);
+    if (sum == NULL)
+    {
+        res.status = WORKER_EFUNC;
+        return res;
+    }
+    if (req->rule < 0 || req->rule >= QUAD_RULES)
+    {
+        res.status = WORKER_ERULE;
+        return res;
+    }
 
-    worker->server_conn_fd = socket(AF_INET, SOCK_STREAM, 0);
-    if (worker->server_conn_fd == -1)
+    struct worker_data data = {.func_id = req->func_id, .rule = req->rule, .left = req->left};
+    for (uint64_t num_steps = CALIBRATION_MIN_STEPS; num_steps <= CALIBRATION_MAX_STEPS; num_steps *= 2)
     {
-        fprintf(stderr, "[worker_create_socket] Unable to create socket()\n");
-        exit(EXIT_FAILURE);
+        data.step = (req->right - req->left) / num_steps;
+        data.num_steps = num_steps;
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        distributed_counting(worker, &data, sum, ctx);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        double elapsed = timespec_diff_sec(&start, &end);
+        if (elapsed >= CALIBRATION_SEC || num_steps == CALIBRATION_MAX_STEPS)
+        {
+            res.steps_per_sec = num_steps / elapsed;
+            break;
+        }
     }
+    return res;
+}
+
+//============================
+// Интерфейс исполнителя
+//============================
+
+INFO_WORKER init_worker(int n_cores, time_t max_time, char *node, char *service)
+{
+    INFO_WORKER worker = {.server_conn_fd = -1, .n_cores = n_cores, .max_time = max_time};
+
+    // Потоки создаются один раз и обслуживают все задания сеанса.
+    worker.pool = thread_pool_create(n_cores);
 
     // Формируем желаемый адрес для подключения.
     struct addrinfo hints;
@@ -274,8 +760,9 @@ INFO_WORKER init_worker(int n_cores, time_t max_time, char *node, char *service)
         exit(EXIT_FAILURE);
     }
 
-    worker->server_addr = *res->ai_addr;
-    
+    worker.server_addr = *res->ai_addr;
+    freeaddrinfo(res);
+
     return worker;
 }
 
@@ -293,7 +780,10 @@ void connect_to_server(INFO_WORKER *worker) {
     }
 
     // Отправка данных об узле.
-    struct node_info info = {.n_cores = worker->n_cores, .max_worker_time = worker->max_time};
+    const TOPOLOGY *topology = &worker->pool->topology;
+    struct node_info info = {.n_cores = worker->n_cores, .max_worker_time = worker->max_time,
+                             .n_cpus = topology->num_cpus, .n_physical_cores = topology->num_cores,
+                             .n_packages = topology->num_packages, .n_numa_nodes = topology->num_nodes};
     bool success = send_node_info(worker, &info);
     if (!success)
     {
@@ -301,35 +791,93 @@ void connect_to_server(INFO_WORKER *worker) {
         exit(EXIT_FAILURE);
     }
 
-    // Получение данных.
-    success = get_data(worker);
-    if (!success)
+    // Обрабатываем задания в порядке поступления, пока сервер не сообщит
+    // об окончании сеанса. Следующие задания ждут в буфере сокета.
+    while (true)
     {
-        worker_close_socket(worker);
-        exit(EXIT_FAILURE);
-    }
+        // Получение данных.
+        success = get_data(worker);
+        if (!success)
+        {
+            worker_close_socket(worker);
+            exit(EXIT_FAILURE);
+        }
+        if (worker->stop)
+            break;
 
-    // Вычисление результата.
-    worker->result = distributed_counting(worker);
+        if (worker->calibrate)
+        {
+            struct calibration_result res = calibrate(worker);
+            if (!send_calibration(worker, &res))
+            {
+                worker_close_socket(worker);
+                exit(EXIT_FAILURE);
+            }
+            continue;
+        }
 
-    // Отправка результата.
-    success = send_result(worker);
-    if (!success)
-    {
-        worker_close_socket(worker);
-        exit(EXIT_FAILURE);
+        worker->status = 0;
+        worker->cpu_sec = 0;
+        if (worker->tracing)
+            trace_begin(worker);
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (uint32_t part_i = 0; part_i < worker->num_parts; ++part_i)
+        {
+            struct worker_data *data = &worker->data[part_i];
+            worker->result[part_i] = 0;
+
+            // Цикл под конкретную функцию выбирается один раз на кусок.
+            double right = data->left + data->step * data->num_steps;
+            const void *ctx;
+            INTEGRAND_SUM sum = select_sum(data->func_id, data->left, right, &ctx);
+            if (sum == NULL)
+            {
+                fprintf(stderr, "Unexpected id for function\n");
+                worker->status = WORKER_EFUNC;
+            }
+            else if (data->rule < 0 || data->rule >= QUAD_RULES)
+            {
+                fprintf(stderr, "Unexpected quadrature rule\n");
+                worker->status = WORKER_ERULE;
+            }
+            else
+            {
+                // Вычисление результата.
+                worker->result[part_i] = distributed_counting(worker, data, sum, ctx);
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        worker->compute_sec = timespec_diff_sec(&start, &end);
+
+        // Отправка результата; трасса уходит перед ним.
+        if (worker->tracing)
+        {
+            worker->trace.join_sec = trace_offset_sec(worker, &end);
+            queue_trace(worker);
+        }
+        success = send_result(worker);
+        if (!success)
+        {
+            worker_close_socket(worker);
+            exit(EXIT_FAILURE);
+        }
     }
-    
+
     // Освобождение сокета.
     worker_close_socket(worker);
     worker->server_conn_fd = -1;
 }
 
-void worker_close(&worker)
+void worker_close(INFO_WORKER *worker)
 {
     // Освобождение сокета.
     if (worker->server_conn_fd >= 0)
         worker_close_socket(worker);
+
+    // Остановка вычислительных потоков.
+    thread_pool_destroy(worker->pool);
+    worker->pool = NULL;
 }
 
 //============================
@@ -341,14 +889,40 @@ void worker_close(&worker)
 
 int main(int argc, char** argv)
 {
-    if (argc != 3)
+    if (argc < 5)
+    {
+        fprintf(stderr, "Usage: worker <node> <service> <n_cores> <max_time> [integrand.so ...]\n");
+        exit(EXIT_FAILURE);
+    }
+
+    char *endptr = argv[3];
+    N_CORES = strtol(argv[3], &endptr, 10);
+    if (*argv[3] == '\0' || *endptr != '\0' || N_CORES <= 0)
+    {
+        fprintf(stderr, "Unable to parse number of cores!\n");
+        exit(EXIT_FAILURE);
+    }
+
+    endptr = argv[4];
+    MAX_TIME = strtol(argv[4], &endptr, 10);
+    if (*argv[4] == '\0' || *endptr != '\0')
     {
-        fprintf(stderr, "Usage: worker <node> <service>\n");
+        fprintf(stderr, "Unable to parse time!\n");
         exit(EXIT_FAILURE);
     }
 
+    // Выбираем векторные ядра под процессор.
+    kernels_init();
+
+    // Подключаемые функции: узел считает только те, что загружены.
+    for (int arg_i = 5; arg_i < argc; ++arg_i)
+    {
+        if (!integrand_plugin_load(argv[arg_i]))
+            exit(EXIT_FAILURE);
+    }
+
     // Данные исполнителя.
-    INFO_WORKER worker = init_worker(args[1], args[2]);
+    INFO_WORKER worker = init_worker(N_CORES, MAX_TIME, argv[1], argv[2]);
 
     connect_to_server(&worker);
 
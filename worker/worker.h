@@ -4,6 +4,123 @@ int MAX_TIME;
 // Максимальное количество ядер, задействованных для вычисления на данном рабочем узле.
 int N_CORES;
 
+struct thread_pool;
+
+// Данные потока пула. Каждый поток пишет только в свою запись, поэтому записи
+// выровнены по строке кэша, чтобы соседние потоки не делили её между собой.
+struct thread_args
+{
+    _Alignas(64) struct thread_pool *pool;
+    // Частичная сумма по взятым потоком блокам.
+    double retval;
+    // Время, которое поток считал текущее задание.
+    double busy_sec;
+    // Для трассы: когда поток начал и закончил задание, сколько шагов посчитал
+    // и на каком ядре.
+    struct timespec start;
+    struct timespec end;
+    uint64_t steps;
+    int cpu;
+};
+
+// Задание, которое потоки пула разбирают блоками по block_steps шагов.
+typedef struct
+{
+    QUAD_RULE rule;
+    SUMMATION_MODE summation;
+    INTEGRAND_SUM sum;
+    const void *ctx;
+    double left;
+    double step;
+    uint64_t num_steps;
+    uint64_t block_steps;
+    uint64_t num_blocks;
+    // Номер следующего невзятого блока.
+    atomic_uint_fast64_t next_block;
+    // При компенсированном суммировании — значение каждого блока,
+    // блоки складываются по порядку после окончания задания.
+    double *block_sums;
+    uint64_t block_sums_capacity;
+} POOL_TASK;
+
+// Долгоживущий пул вычислительных потоков, закреплённых за ядрами.
+typedef struct thread_pool
+{
+    pthread_t *threads;
+    struct thread_args *args;
+    int threads_num;
+    unsigned spin_iters;
+
+    pthread_mutex_t lock;
+    pthread_cond_t start_cond;
+    pthread_cond_t done_cond;
+    // Номер текущего задания: поток берётся за работу, когда номер меняется.
+    atomic_uint_fast64_t generation;
+    // Сколько потоков ещё не закончили текущее задание.
+    atomic_int pending;
+    atomic_bool shutdown;
+
+    POOL_TASK task;
+    // Доступные процессу ЦП в порядке закрепления за ними потоков.
+    TOPOLOGY topology;
+} THREAD_POOL;
+
+// Сколько кадров может ждать отправки (трасса и ответ) и размер буфера приёма:
+// в него помещаются все задания, которые менеджер держит в очереди узла.
+#define MAX_OUT_FRAMES 2U
+#define INPUT_BUFFER_SIZE (8U * (sizeof(struct frame_header) + MAX_FRAME_PAYLOAD))
+
+typedef struct
+{
+    // Дескриптор сокета для подключения к серверу.
+    int server_conn_fd;
+
+    // Кадры, ждущие отправки одним writev: заголовки и указатели на полезную
+    // нагрузку, которая должна жить до отправки.
+    struct frame_header out_headers[MAX_OUT_FRAMES];
+    struct iovec out_iov[2 * MAX_OUT_FRAMES];
+    unsigned num_out_frames;
+    // Принятые, но ещё не разобранные данные лежат в input[input_head, input_tail).
+    char input[INPUT_BUFFER_SIZE];
+    size_t input_head;
+    size_t input_tail;
+
+    // Адрес для подключению к серверу.
+    struct sockaddr server_addr;
+
+    // Максимальное время вычисления.
+    time_t max_time;
+
+    // Количество ядер.
+    int n_cores;
+
+    // Вычислительные потоки, переиспользуемые между заданиями.
+    THREAD_POOL *pool;
+
+    // Данные для вычисления интеграла: один кусок или пакет кусков.
+    struct worker_data data[MAX_BATCH_PARTS];
+    uint32_t num_parts;
+    bool batch;
+    // Идентификатор текущего задания.
+    uint64_t request_id;
+    // Сервер завершил сеанс.
+    bool stop;
+    // Вместо задания пришёл запрос на замер производительности.
+    bool calibrate;
+    struct calibrate_request calibration;
+    
+    // Результаты по кускам и код ошибки (0 — успех).
+    double result[MAX_BATCH_PARTS];
+    int status;
+    // Время счёта задания по часам и суммарно по потокам пула.
+    double compute_sec;
+    double cpu_sec;
+    // Задание попросило трассу (WORK_TRACE); времена в ней отсчитываются от received.
+    bool tracing;
+    struct timespec received;
+    struct worker_trace trace;
+} INFO_WORKER;
+
 // Инициализация структуры исполнителя.
 INFO_WORKER init_worker(int n_cores, time_t max_time, char *node, char *service);
 
@@ -11,4 +128,4 @@ INFO_WORKER init_worker(int n_cores, time_t max_time, char *node, char *service)
 void connect_to_server(INFO_WORKER *worker);
 
 // Закрытие открытого сокета.
-void worker_close(&worker);
+void worker_close(INFO_WORKER *worker);